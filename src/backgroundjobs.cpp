@@ -12,6 +12,41 @@
 #include "context.h"    //meshLoad()
 
 #include "common/cmft.h"
+#include "common/imageproc.h" // cs::imageCubemapPrepass(), cs::imageIrradianceFilterSh(), cs::imageTonemap()
+#include "filtercache.h"         // filterCacheKey(), filterCacheLoad(), filterCacheStore()
+#include "clpool.h"              // clPoolAcquire(), clPoolRelease()
+#include "filtertune.h"          // filterTune()
+#include <bx/cpu.h>              // bx::atomicFetchAndAdd()
+#include <string.h>              // memcpy()
+#include "common/mipmap.h"       // cs::mipNumLevels()
+
+void threadStatusOnComplete(int32_t _result, void* _threadStatus)
+{
+    uint8_t* status = (uint8_t*)_threadStatus;
+
+    if (ThreadStatus::Halted == _result)
+    {
+        *status = ThreadStatus::Completed | ThreadStatus::Halted;
+    }
+    else
+    {
+        *status = ThreadStatus::Completed | (EXIT_SUCCESS == _result ? ThreadStatus::ExitSuccess : ThreadStatus::ExitFailure);
+    }
+}
+
+bool threadStart(cs::JobFn _fn, void* _params, uint8_t& _threadStatus, cs::JobPriority::Enum _priority)
+{
+    _threadStatus = ThreadStatus::Started;
+
+    const cs::JobHandle job = cs::jobSubmit(_fn, _params, _priority, &threadStatusOnComplete, (void*)&_threadStatus);
+    if (!cs::isValid(job))
+    {
+        _threadStatus = ThreadStatus::Idle;
+        return false;
+    }
+
+    return true;
+}
 
 void onProjectSaveValidFile(uint32_t /*_flags*/, const void* /*_data*/)
 {
@@ -53,16 +88,7 @@ int32_t projectSaveFunc(void* _projectSaveThreadParams)
                                    );
 
     // Result.
-    if (success)
-    {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitSuccess;
-        return EXIT_SUCCESS;
-    }
-    else
-    {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitFailure;
-        return EXIT_FAILURE;
-    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 void onProjectLoadValidFile(uint32_t /*_flags*/, const void* /*_data*/)
@@ -109,16 +135,7 @@ int32_t projectLoadFunc(void* _projectLoadThreadParams)
                                    );
 
     // Result.
-    if (success)
-    {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitSuccess;
-        return EXIT_SUCCESS;
-    }
-    else
-    {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitFailure;
-        return EXIT_FAILURE;
-    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int32_t modelLoadFunc(void* _modelLoadThreadParameters)
@@ -143,16 +160,82 @@ int32_t modelLoadFunc(void* _modelLoadThreadParameters)
     // Load mesh.
     params->m_mesh = cs::meshLoad(params->m_filePath, (void*)params->m_userData, params->m_stackAlloc);
 
-    if (cs::isValid(params->m_mesh))
-    {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitSuccess;
-        return EXIT_SUCCESS;
-    }
-    else
+    // Result.
+    return cs::isValid(params->m_mesh) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int32_t tonemapFunc(void* _tonemapThreadParams)
+{
+    TonemapThreadParams* params = (TonemapThreadParams*)_tonemapThreadParams;
+
+    cs::imageTonemap(params->m_output, params->m_input, params->m_gamma, params->m_minLum, params->m_lumRange);
+    cmft::imageUnload(params->m_input);
+
+    return EXIT_SUCCESS;
+}
+
+int32_t filterTuneFunc(void* _filterTuneThreadParams)
+{
+    FilterTuneThreadParams* params = (FilterTuneThreadParams*)_filterTuneThreadParams;
+
+    if (!filterTune(params->m_numCpuThreads, params->m_useOpenCL, &params->m_cancel))
     {
-        params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitFailure;
-        return EXIT_FAILURE;
+        return ThreadStatus::Halted;
     }
+
+    outputWindowPrint("Filter calibration: %u cpu threads, OpenCL %s."
+                     , uint32_t(params->m_numCpuThreads)
+                     , params->m_useOpenCL ? "on" : "off"
+                     );
+
+    return EXIT_SUCCESS;
+}
+
+static inline int32_t atomicLoad(const volatile int32_t* _ptr)
+{
+    return bx::atomicFetchAndAdd(const_cast<volatile int32_t*>(_ptr), 0);
+}
+
+float cmftFilterProgress(const CmftFilterThreadParams& _params)
+{
+    return float(atomicLoad(&_params.m_progress))/float(CmftFilterThreadParams::ProgressMax);
+}
+
+void cmftFilterCancel(CmftFilterThreadParams& _params)
+{
+    bx::atomicInc(&_params.m_cancel);
+}
+
+void filterTuneCancel(FilterTuneThreadParams& _params)
+{
+    bx::atomicInc(&_params.m_cancel);
+}
+
+static inline bool cmftFilterCanceled(const CmftFilterThreadParams* _params)
+{
+    return 0 != atomicLoad(&_params->m_cancel);
+}
+
+// Notice: progress is written only by the job.
+static inline void cmftFilterSetProgress(CmftFilterThreadParams* _params, int32_t _progress)
+{
+    bx::atomicFetchAndAdd(&_params->m_progress, _progress - atomicLoad(&_params->m_progress));
+}
+
+// Radiance and irradiance filters can run concurrently, their output window lines are told apart by name.
+static inline const char* cmftFilterName(const CmftFilterThreadParams* _params)
+{
+    return (cs::Environment::Pmrem == _params->m_filterType) ? "radiance" : "irradiance";
+}
+
+// Advances progress and reports whether processing should continue.
+static inline bool cmftFilterStepDone(CmftFilterThreadParams* _params, int32_t _progress)
+{
+    bx::atomicFetchAndAdd(&_params->m_progress, _progress);
+
+    outputWindowPrint("cmft %s progress: %3u%%", cmftFilterName(_params), uint32_t(cmftFilterProgress(*_params)*100.0f));
+
+    return !cmftFilterCanceled(_params);
 }
 
 int32_t cmftFilterFunc(void* _cmftFilterThreadParams)
@@ -166,98 +249,475 @@ int32_t cmftFilterFunc(void* _cmftFilterThreadParams)
     if (cs::Environment::Pmrem == params->m_filterType)
     {
         const char* msg = "[ Cmft radiance filter running in background... ]";
-        imguiStatusMessage(msg, 0.0f, false, NULL, 0, StatusWindowId::FilterPmrem);
+        imguiStatusMessage(msg, 0.0f, false, "Cancel", StatusEvent::CancelFilterPmrem, StatusWindowId::FilterPmrem);
     }
     else //if (cs::Environment::Iem == params->m_filterType).
     {
         const char* msg = "[ Cmft irradiance filter running in background... ]";
-        imguiStatusMessage(msg, 0.0f, false, NULL, 0, StatusWindowId::FilterIem);
+        imguiStatusMessage(msg, 0.0f, false, "Cancel", StatusEvent::CancelFilterIem, StatusWindowId::FilterIem);
     }
 
     // Show output window.
-    outputWindowClear();
-    outputWindowPrint("Preparing data and starting cmft...");
+    // Notice: output window is not cleared here, the other filter may be running and printing into it.
+    outputWindowPrint("Preparing data and starting cmft %s filter...", cmftFilterName(params));
     outputWindowShow();
 
     // Allow for animation to finish smoothly.
     bx::sleep(300);
 
-    // Processing is done on rgba32f.
-    cmft::imageConvert(params->m_output, cmft::TextureFormat::RGBA32F, params->m_input);
+    return cmftFilter(*params);
+}
 
-    if (cs::Environment::Pmrem == params->m_filterType)
+void cmftFilterPreviewUpdate(CmftFilterThreadParams& _params)
+{
+    if (0 == atomicLoad(&_params.m_previewPending) )
     {
-        // Init OpenCL context.
-        cmft::ClContext clContext;
+        return;
+    }
 
-        int32_t clLoaded = 0;
-        if (params->m_useOpenCL)
-        {
-            clLoaded = bx::clLoad(); // Dynamically load OpenCL lib.
+    // Keep the current radiance map if the filter got canceled in the meantime.
+    if (!cmftFilterCanceled(&_params) )
+    {
+        cs::Environment& env = cs::getObj(_params.m_envHandle);
 
-            if (clLoaded)
-            {
-                clContext.init(CMFT_CL_VENDOR_ANY_GPU, CMFT_CL_DEVICE_TYPE_GPU, 0);
-            }
+        // Radiance map replaced by the first preview is kept, it is put back if the filter does not finish.
+        if (!_params.m_previewApplied)
+        {
+            _params.m_previewApplied = true;
+            _params.m_origEdgeFixup  = env.m_edgeFixup;
+            cmft::imageCopy(_params.m_origPmrem, cs::envGetImage(_params.m_envHandle, cs::Environment::Pmrem));
         }
 
-        // Resize.
-        if (params->m_srcSize != params->m_input.m_width)
+        env.m_edgeFixup = (cmft::EdgeFixup::Enum)_params.m_edgeFixup;
+
+        cs::envLoad(_params.m_envHandle, cs::Environment::Pmrem, _params.m_preview);
+        cs::createGpuBuffers(_params.m_envHandle);
+    }
+
+    cmft::imageUnload(_params.m_preview);
+    bx::atomicDec(&_params.m_previewPending);
+}
+
+void cmftFilterPreviewEnd(CmftFilterThreadParams& _params, bool _succeeded)
+{
+    // Preview that was not picked up is stale once the job is done.
+    if (0 != atomicLoad(&_params.m_previewPending) )
+    {
+        cmft::imageUnload(_params.m_preview);
+        bx::atomicDec(&_params.m_previewPending);
+    }
+
+    if (_params.m_previewApplied)
+    {
+        if (!_succeeded)
         {
-            cmft::imageResize(params->m_output, params->m_srcSize, params->m_srcSize);
+            cs::getObj(_params.m_envHandle).m_edgeFixup = _params.m_origEdgeFixup;
+
+            cs::envLoad(_params.m_envHandle, cs::Environment::Pmrem, _params.m_origPmrem);
+            cs::createGpuBuffers(_params.m_envHandle);
         }
 
-        // Input gamma.
-        cmft::imageApplyGamma(params->m_output, params->m_inputGamma);
-
-        // Notice: Nvidia crashes the driver if memory is not from crt allcator.
-        // Don't know what seems to be the reason. Could be a driver issue.
-        cmft::setAllocator(dm::crtAlloc);
-
-        // Radiance filter.
-        const bool success = cmft::imageRadianceFilter(params->m_output
-                                                     , params->m_dstSize
-                                                     , params->m_lightingModel
-                                                     , params->m_excludeBase
-                                                     , params->m_mipCount
-                                                     , params->m_glossScale
-                                                     , params->m_glossBias
-                                                     , params->m_edgeFixup
-                                                     , params->m_numCpuThreads
-                                                     , &clContext
-                                                     );
+        cmft::imageUnload(_params.m_origPmrem);
+        _params.m_previewApplied = false;
+    }
+}
+
+// Number of radiance mips cmft produces, requested mip count is clamped to the full chain of the output face size.
+static inline uint8_t cmftRadianceMipCount(const CmftFilterThreadParams& _params)
+{
+    return dm::min(_params.m_mipCount, cs::mipNumLevels(_params.m_dstSize, _params.m_dstSize));
+}
+
+// Cmft gloss of mip 'ii' in a chain of 'mipCount' mips is 1 - ii/(mipCount-1), specular power is 2^(glossScale*gloss + glossBias).
+// Computes gloss scale and bias for a chain of '_numMips' mips that starts at mip '_firstMip' of the whole chain, such that each of
+// its mips gets the specular power of the matching mip of the whole chain. Returns false if the values are rounded to integers.
+static bool cmftGlossForMips(uint8_t& _glossScale
+                           , uint8_t& _glossBias
+                           , const CmftFilterThreadParams& _params
+                           , uint8_t _firstMip
+                           , uint8_t _numMips
+                           )
+{
+    const int32_t lastMip = int32_t(cmftRadianceMipCount(_params)) - 1;
+    if (0 == lastMip)
+    {
+        _glossScale = _params.m_glossScale;
+        _glossBias  = _params.m_glossBias;
+        return true;
+    }
+
+    // Both are multiplied by 'lastMip'.
+    const int32_t scale = int32_t(_params.m_glossScale)*(int32_t(_numMips)-1);
+    const int32_t bias  = int32_t(_params.m_glossScale)*(lastMip - int32_t(_firstMip) - int32_t(_numMips) + 1)
+                        + int32_t(_params.m_glossBias)*lastMip;
+
+    const int32_t glossScale = (scale + lastMip/2)/lastMip;
+    const int32_t glossBias  = (bias  + lastMip/2)/lastMip;
+    _glossScale = uint8_t(dm::min(glossScale, 255));
+    _glossBias  = uint8_t(dm::min(glossBias,  255));
+
+    return 0 == scale%lastMip
+        && 0 == bias%lastMip
+        && glossScale <= 255
+        && glossBias  <= 255
+        ;
+}
+
+// Filters a radiance map with '_skipMips' top mips left out and hands it over to the main thread.
+// Gloss scale and bias are adjusted so remaining mips get the gloss of the matching mips of the final result.
+// They are integers in cmft, so unless the adjusted values are integral, preview gloss only approximates the final one.
+static bool cmftFilterPreview(CmftFilterThreadParams* _params
+                            , const cmft::Image& _source
+                            , uint8_t _skipMips
+                            , cmft::ClContext* _clContext
+                            , bx::AllocatorI* _allocator
+                            )
+{
+    cmft::Image preview;
+    cmft::imageCopy(preview, _source, _allocator);
+
+    const uint32_t faceSize = _params->m_dstSize>>_skipMips;
+    const uint8_t numMips = cmftRadianceMipCount(*_params) - _skipMips;
+
+    uint8_t glossScale;
+    uint8_t glossBias;
+    cmftGlossForMips(glossScale, glossBias, *_params, _skipMips, numMips);
+
+    const bool success = cmft::imageRadianceFilter(preview
+                                                 , faceSize
+                                                 , _params->m_lightingModel
+                                                 , false
+                                                 , numMips
+                                                 , glossScale
+                                                 , glossBias
+                                                 , _params->m_edgeFixup
+                                                 , _params->m_numCpuThreads
+                                                 , _clContext
+                                                 , _allocator
+                                                 );
+    if (!success)
+    {
+        cmft::imageUnload(preview, _allocator);
+        return false;
+    }
+
+    cs::imageApplyGammaRgba32f(preview, _params->m_outputGamma);
+
+    // Previous preview was not picked up yet, this one is dropped.
+    if (0 != atomicLoad(&_params->m_previewPending) )
+    {
+        cmft::imageUnload(preview, _allocator);
+        return true;
+    }
+
+    // Preview leaves the job, it is copied to the global allocator. Main thread picks it up with cmftFilterPreviewUpdate().
+    cmft::imageCopy(_params->m_preview, preview);
+    cmft::imageUnload(preview, _allocator);
+    bx::atomicInc(&_params->m_previewPending);
+
+    outputWindowPrint("cmft preview: %ux%u", faceSize, faceSize);
+
+    return true;
+}
+
+static uint32_t gcd(uint32_t _a, uint32_t _b)
+{
+    while (0 != _b)
+    {
+        const uint32_t tmp = _a%_b;
+        _a = _b;
+        _b = tmp;
+    }
+
+    return _a;
+}
+
+// Copies first '_numMips' mips of each face of rgba32f cubemap '_src' to mips starting at '_dstMip' of '_dst'.
+// Faces are stored one after another, each one with its mip chain.
+static void cmftCopyCubemapMips(cmft::Image& _dst, uint8_t _dstMip, const cmft::Image& _src, uint8_t _numMips)
+{
+    const uint32_t bytesPerPixel = 4*sizeof(float);
+
+    uint32_t srcFaceBytes = 0;
+    uint32_t copyBytes = 0;
+    for (uint8_t mip = 0; mip < _src.m_numMips; ++mip)
+    {
+        const uint32_t size = dm::max(_src.m_width>>mip, uint32_t(1));
+        srcFaceBytes += size*size*bytesPerPixel;
+        copyBytes    += (mip < _numMips) ? size*size*bytesPerPixel : 0;
+    }
+
+    uint32_t dstFaceBytes = 0;
+    uint32_t dstOffset = 0;
+    for (uint8_t mip = 0; mip < _dst.m_numMips; ++mip)
+    {
+        const uint32_t size = dm::max(_dst.m_width>>mip, uint32_t(1));
+        dstFaceBytes += size*size*bytesPerPixel;
+        dstOffset    += (mip < _dstMip) ? size*size*bytesPerPixel : 0;
+    }
+
+    for (uint8_t face = 0; face < 6; ++face)
+    {
+        memcpy((uint8_t*)_dst.m_data + face*dstFaceBytes + dstOffset
+             , (const uint8_t*)_src.m_data + face*srcFaceBytes
+             , copyBytes
+             );
+    }
+}
+
+// Cmft filters all radiance mips in a single call without any progress report. To pick up cancel requests and report progress
+// in between, the chain is filtered in slices with adjusted gloss, see cmftGlossForMips(). Slices start where the adjusted gloss
+// is integral: with a step of one mip, each mip is filtered on its own. With larger steps, adjacent slices share their boundary
+// mip, which is filtered twice and is 4^step times smaller than the top mip of the slice. If gloss can't be matched, the whole
+// chain is filtered at once. '_image' is the source on input and the radiance map on output.
+static int32_t cmftFilterRadiance(CmftFilterThreadParams* _params
+                                , cmft::Image& _image
+                                , int32_t _progress
+                                , cmft::ClContext* _clContext
+                                , bx::AllocatorI* _allocator
+                                )
+{
+    struct Slice
+    {
+        uint8_t m_firstMip;
+        uint8_t m_numMips; // Filtered.
+        uint8_t m_numKept;
+        uint8_t m_glossScale;
+        uint8_t m_glossBias;
+    };
+
+    const uint8_t mipCount = cmftRadianceMipCount(*_params);
+    const uint32_t lastMip = mipCount-1;
+    const uint32_t step = (0 == lastMip) ? 1 : lastMip/gcd(_params->m_glossScale, lastMip);
+
+    Slice slices[32];
+    uint8_t numSlices = 0;
+    bool sliced = (0 != lastMip);
+    for (uint32_t mip = 0; sliced && mip <= lastMip; )
+    {
+        Slice& slice = slices[numSlices++];
+        const uint32_t last = dm::min(mip + (1 == step ? 0 : step), lastMip);
+        slice.m_firstMip = uint8_t(mip);
+        slice.m_numMips  = uint8_t(last - mip + 1);
+        slice.m_numKept  = (1 == step || lastMip == last) ? slice.m_numMips : uint8_t(slice.m_numMips-1);
+        sliced = cmftGlossForMips(slice.m_glossScale, slice.m_glossBias, *_params, slice.m_firstMip, slice.m_numMips);
+
+        mip += slice.m_numKept;
+    }
+
+    if (!sliced)
+    {
+        numSlices = 1;
+        slices[0].m_firstMip   = 0;
+        slices[0].m_numMips    = mipCount;
+        slices[0].m_numKept    = mipCount;
+        slices[0].m_glossScale = _params->m_glossScale;
+        slices[0].m_glossBias  = _params->m_glossBias;
+    }
 
-        cmft::setAllocator(dm::mainAlloc);
+    // Progress is distributed by the number of kept texels.
+    uint64_t totalTexels = 0;
+    for (uint8_t mip = 0; mip < mipCount; ++mip)
+    {
+        const uint64_t size = dm::max(_params->m_dstSize>>mip, uint32_t(1));
+        totalTexels += size*size;
+    }
+
+    cmft::Image radiance;
+    if (1 < numSlices)
+    {
+        cmft::imageCreate(radiance, _params->m_dstSize, _params->m_dstSize, 0, mipCount, 6, cmft::TextureFormat::RGBA32F, _allocator);
+    }
 
-        // Cleanup.
-        clContext.destroy();
-        if (clLoaded)
+    uint64_t doneTexels = 0;
+    int32_t doneProgress = 0;
+    for (uint8_t ii = 0; ii < numSlices; ++ii)
+    {
+        const Slice& slice = slices[ii];
+
+        if (cmftFilterCanceled(_params) )
         {
-            bx::clUnload(); // Dynamically unload OpenCL lib.
+            cmft::imageUnload(radiance, _allocator);
+            return ThreadStatus::Halted;
         }
 
-        // Check result.
+        // Single slice is filtered in place.
+        cmft::Image sliceImage;
+        cmft::Image& image = (1 < numSlices) ? sliceImage : _image;
+        if (1 < numSlices)
+        {
+            cmft::imageCopy(sliceImage, _image, _allocator);
+        }
+
+        const bool success = cmft::imageRadianceFilter(image
+                                                     , _params->m_dstSize>>slice.m_firstMip
+                                                     , _params->m_lightingModel
+                                                     , _params->m_excludeBase && 0 == slice.m_firstMip
+                                                     , slice.m_numMips
+                                                     , slice.m_glossScale
+                                                     , slice.m_glossBias
+                                                     , _params->m_edgeFixup
+                                                     , _params->m_numCpuThreads
+                                                     , _clContext
+                                                     , _allocator
+                                                     );
         if (!success)
         {
-            params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitFailure;
+            cmft::imageUnload(sliceImage, _allocator);
+            cmft::imageUnload(radiance, _allocator);
             return EXIT_FAILURE;
         }
 
-        // Output gamma.
-        cmft::imageApplyGamma(params->m_output, params->m_outputGamma);
+        if (1 < numSlices)
+        {
+            cmftCopyCubemapMips(radiance, slice.m_firstMip, sliceImage, slice.m_numKept);
+            cmft::imageUnload(sliceImage, _allocator);
+        }
+
+        for (uint8_t mip = slice.m_firstMip, end = slice.m_firstMip + slice.m_numKept; mip < end; ++mip)
+        {
+            const uint64_t size = dm::max(_params->m_dstSize>>mip, uint32_t(1));
+            doneTexels += size*size;
+        }
 
+        const int32_t progress = int32_t(uint64_t(_progress)*doneTexels/totalTexels);
+        cmftFilterStepDone(_params, progress - doneProgress);
+        doneProgress = progress;
     }
-    else //if (cs::Environment::Iem == params->m_filterType).
+
+    if (1 < numSlices)
     {
-        cmft::imageApplyGamma(params->m_output, params->m_inputGamma);
-        cmft::imageIrradianceFilterSh(params->m_output, params->m_dstSize);
-        cmft::imageApplyGamma(params->m_output, params->m_outputGamma);
+        cmft::imageUnload(_image, _allocator);
+        cmft::imageMove(_image, radiance, _allocator);
     }
 
-    // Result.
-    params->m_threadStatus = ThreadStatus::Completed | ThreadStatus::ExitSuccess;
+    return cmftFilterCanceled(_params) ? int32_t(ThreadStatus::Halted) : int32_t(EXIT_SUCCESS);
+}
+
+// Processing steps of cmftFilter(). All intermediate images are allocated from '_allocator', result is left in '_image'.
+static int32_t cmftFilterProcess(CmftFilterThreadParams* _params
+                               , cmft::Image& _image
+                               , cmft::ClContext* _clContext
+                               , bx::AllocatorI* _allocator
+                               )
+{
+    // Processing is done on rgba32f.
+    // Conversion, resize and input gamma are done in a single pass over the input image.
+    const uint32_t faceSize = (cs::Environment::Pmrem == _params->m_filterType) ? _params->m_srcSize : _params->m_input.m_width;
+    cs::imageCubemapPrepass(_image, _params->m_input, faceSize, _params->m_inputGamma, _allocator);
+    if (!cmftFilterStepDone(_params, CmftFilterThreadParams::ProgressPrepass))
+    {
+        return ThreadStatus::Halted;
+    }
+
+    if (cs::Environment::Pmrem == _params->m_filterType)
+    {
+        // Coarse previews first. Each one costs a fraction of the final filter, as the top mips dominate processing time.
+        if (_params->m_progressive)
+        {
+            enum { PreviewFaceSize = 64 };
+
+            uint8_t skipMips = 0;
+            while ((_params->m_dstSize>>skipMips) > PreviewFaceSize
+               &&  skipMips+1 < cmftRadianceMipCount(*_params) )
+            {
+                ++skipMips;
+            }
+
+            for (int32_t skip = skipMips; skip >= 2 && !cmftFilterCanceled(_params); skip -= 2)
+            {
+                if (!cmftFilterPreview(_params, _image, uint8_t(skip), _clContext, _allocator))
+                {
+                    break;
+                }
+            }
+        }
+
+        // Radiance filter, checks for cancel before each slice.
+        const int32_t result = cmftFilterRadiance(_params, _image, CmftFilterThreadParams::ProgressFilter, _clContext, _allocator);
+        if (EXIT_SUCCESS != result)
+        {
+            return result;
+        }
+    }
+    else //if (cs::Environment::Iem == _params->m_filterType).
+    {
+        cs::imageIrradianceFilterSh(_image, _params->m_dstSize, _allocator);
+
+        if (!cmftFilterStepDone(_params, CmftFilterThreadParams::ProgressFilter))
+        {
+            return ThreadStatus::Halted;
+        }
+    }
+
+    // Output gamma.
+    cs::imageApplyGammaRgba32f(_image, _params->m_outputGamma);
+    cmftFilterStepDone(_params, CmftFilterThreadParams::ProgressGamma);
 
     return EXIT_SUCCESS;
 }
 
+int32_t cmftFilter(CmftFilterThreadParams& _params)
+{
+    CmftFilterThreadParams* params = &_params;
+
+    // Notice: cancellation is cooperative. It is checked between processing steps and radiance filter slices,
+    // a step that is already running is always finished.
+
+    params->m_memoryPeak = 0;
+    cmftFilterSetProgress(params, 0);
+
+    // Same input and parameters were filtered before, skip processing.
+    const uint64_t cacheKey = filterCacheKey(*params);
+    if (filterCacheLoad(params->m_output, cacheKey))
+    {
+        cmftFilterSetProgress(params, CmftFilterThreadParams::ProgressMax);
+        outputWindowPrint("cmft %s progress: 100%% (cached)", cmftFilterName(params));
+        return EXIT_SUCCESS;
+    }
+
+    // OpenCL context is shared between jobs and kept for the whole session, setup cost is paid only once.
+    // When OpenCL is unavailable or the context is used by another job, cmft filters on cpu.
+    cmft::ClContext* clContext = NULL;
+    if (cs::Environment::Pmrem == params->m_filterType
+    &&  params->m_useOpenCL)
+    {
+        clContext = clPoolAcquire();
+    }
+
+    // Calibration may pick OpenCL alone (zero cpu threads), cpu has to do the work when no context is available.
+    if (NULL == clContext
+    &&  0 == params->m_numCpuThreads)
+    {
+        params->m_numCpuThreads = cs::cpuNumCores();
+    }
+
+    // Each job gets its own allocator, cmft global allocator is never swapped, so filter jobs can run concurrently.
+    // Notice: Nvidia crashes the driver if memory is not from crt allcator.
+    // Don't know what seems to be the reason. Could be a driver issue.
+    cs::JobAllocator allocator(NULL != clContext ? dm::crtAlloc : dm::mainAlloc);
+
+    cmft::Image image;
+    const int32_t result = cmftFilterProcess(params, image, clContext, &allocator);
+
+    clPoolRelease(clContext);
+
+    // Result leaves the job, it is copied to the global allocator.
+    if (EXIT_SUCCESS == result)
+    {
+        cmft::imageCopy(params->m_output, image);
+    }
+    cmft::imageUnload(image, &allocator);
+
+    params->m_memoryPeak = allocator.peak();
+    outputWindowPrint("cmft %s memory peak: %.1fMB", cmftFilterName(params), double(allocator.peak())/(1024.0*1024.0));
+
+    if (EXIT_SUCCESS == result)
+    {
+        filterCacheStore(params->m_output, cacheKey);
+    }
+
+    return result;
+}
+
 /* vim: set sw=4 ts=4 expandtab: */
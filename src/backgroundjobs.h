@@ -7,6 +7,7 @@
 #define CMFTSTUDIO_BACKGROUNDJOBS_H_HEADER_GUARD
 
 #include "common/common.h"
+#include "common/jobs.h" // cs::JobHandle
 #include <stdint.h>
 
 #include "guimanager.h" // imguiEnqueueStatusMessage()
@@ -39,6 +40,19 @@ static inline bool threadStatus(ThreadStatus::Enum _state, uint8_t& _states)
     return false;
 }
 
+/// Job completion callback, executed on the main thread from cs::jobsUpdate().
+/// Publishes job result through '_threadStatus' (pointer to m_threadStatus).
+/// Jobs that were canceled return ThreadStatus::Halted as their result.
+void threadStatusOnComplete(int32_t _result, void* _threadStatus);
+
+/// Marks '_threadStatus' as started and submits '_fn' to the job system.
+/// Returns false if the job queue is full, in which case '_threadStatus' is left idle.
+bool threadStart(cs::JobFn _fn
+               , void* _params
+               , uint8_t& _threadStatus
+               , cs::JobPriority::Enum _priority = cs::JobPriority::Normal
+               );
+
 // Project save.
 //-----
 
@@ -172,6 +186,65 @@ struct ModelLoadThreadParams
 
 int32_t modelLoadFunc(void* _modelLoadThreadParameters);
 
+// Skybox tonemap.
+//-----
+
+struct TonemapThreadParams
+{
+    TonemapThreadParams()
+    {
+        m_threadStatus = ThreadStatus::Idle;
+        m_gamma        = 1.0f;
+        m_minLum       = 0.0f;
+        m_lumRange     = 1.0f;
+        m_envHandle    = cs::EnvHandle::invalid();
+        m_skyboxVersion = 0;
+    }
+
+    uint8_t m_threadStatus;
+    float m_gamma;
+    float m_minLum;
+    float m_lumRange;
+    cs::EnvHandle m_envHandle;     // Acquired while the job is running.
+    uint32_t m_skyboxVersion;      // Environment::m_skyboxVersion when the job was started.
+    cmft::Image m_input;           // Copy of the source skybox, owned by the job.
+    cmft::Image m_output;
+};
+
+/// Tonemaps 'm_input' into 'm_output' and releases 'm_input'. Result is applied on the main thread with cs::envTonemap(),
+/// unless the skybox was changed in the meantime.
+int32_t tonemapFunc(void* _tonemapThreadParams);
+
+// Filter calibration.
+//-----
+
+struct FilterTuneThreadParams
+{
+    FilterTuneThreadParams()
+    {
+        m_threadStatus     = ThreadStatus::Idle;
+        m_numCpuThreads    = 4;
+        m_useOpenCL        = true;
+        m_pending          = false;
+        m_cancel           = 0;
+        m_widgetCpuThreads = 0.0f;
+        m_widgetUseOpenCL  = false;
+    }
+
+    uint8_t m_threadStatus;
+    uint8_t m_numCpuThreads;
+    bool m_useOpenCL;
+    bool m_pending;           // Started once the application is idle.
+    volatile int32_t m_cancel; // Non-zero once canceled.
+    float m_widgetCpuThreads; // Radiance filter widget settings when calibration started,
+    bool  m_widgetUseOpenCL;  // result is applied to the widget only if the user did not change them meanwhile.
+};
+
+/// Measures the fastest radiance filter hardware settings with filterTune(). Result is stored in the config on the main thread.
+/// Exits with ThreadStatus::Halted when canceled, config is left as it is then.
+int32_t filterTuneFunc(void* _filterTuneThreadParams);
+void filterTuneCancel(FilterTuneThreadParams& _params);
+
 // Cmft filter.
 //-----
 
@@ -196,8 +269,23 @@ struct CmftFilterThreadParams
         m_excludeBase   = false;
         m_useOpenCL     = true;
         m_envHandle     = cs::EnvHandle::invalid();
+        m_progressive   = false;
+        m_memoryPeak    = 0;
+        m_progress      = 0;
+        m_cancel        = 0;
+        m_previewPending = 0;
+        m_previewApplied = false;
+        m_origEdgeFixup  = cmft::EdgeFixup::None;
     }
 
+    enum
+    {
+        ProgressPrepass = 50,  // Convert, resize, input gamma.
+        ProgressFilter  = 900, // Advanced per radiance filter slice.
+        ProgressGamma   = 50,  // Output gamma.
+        ProgressMax     = ProgressPrepass + ProgressFilter + ProgressGamma,
+    };
+
     uint8_t m_threadStatus;
     uint32_t m_srcSize;
     uint32_t m_dstSize;
@@ -215,10 +303,42 @@ struct CmftFilterThreadParams
     cmft::ImageSoftRef m_output;
     cmft::ImageSoftRef m_input;
     cs::EnvHandle m_envHandle;
+    bool m_progressive; // Publish coarse radiance mips to '_envHandle' while filtering. Requires cmftFilterPreviewUpdate() on the main thread.
+    size_t m_memoryPeak; // Peak memory used by the filter in bytes, set when the filter finishes.
+
+    // Shared between the job and the main thread, accessed with bx atomics.
+    volatile int32_t m_progress; // Out of ProgressMax.
+    volatile int32_t m_cancel;   // Non-zero once canceled.
+    volatile int32_t m_previewPending; // Set by the job when 'm_preview' is handed over, cleared by the main thread.
+    cmft::Image m_preview;
+
+    // Main thread only. Radiance map replaced by previews.
+    bool m_previewApplied;
+    cmft::EdgeFixup::Enum m_origEdgeFixup;
+    cmft::Image m_origPmrem;
 };
 
+/// Returns progress of a running cmft filter job in [0.0, 1.0] range.
+float cmftFilterProgress(const CmftFilterThreadParams& _params);
+
+/// Requests the job to stop. Job checks the request between processing steps and radiance filter slices, and finishes as ThreadStatus::Halted.
+void cmftFilterCancel(CmftFilterThreadParams& _params);
+
+/// Installs the latest radiance preview handed over by a progressive job into 'm_envHandle'.
+/// Call once per frame from the main thread while environment images are not being read (project save).
+void cmftFilterPreviewUpdate(CmftFilterThreadParams& _params);
+
+/// Call from the main thread when a progressive job is done. Drops pending preview. Unless '_succeeded',
+/// radiance map replaced by previews is put back.
+void cmftFilterPreviewEnd(CmftFilterThreadParams& _params, bool _succeeded);
+
+/// Job entry point. Shows status messages and runs cmftFilter().
 int32_t cmftFilterFunc(void* _cmftFilterThreadParams);
 
+/// Runs filter processing on the calling thread, without any gui interaction. Output is stored in '_params.m_output'.
+/// Returns EXIT_SUCCESS, EXIT_FAILURE or ThreadStatus::Halted if canceled.
+int32_t cmftFilter(CmftFilterThreadParams& _params);
+
 #endif // CMFTSTUDIO_BACKGROUNDJOBS_H_HEADER_GUARD
 
 /* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common/common.h"
+#include "batch.h"
+
+#include <stdio.h>          // printf
+#include <string.h>         // memset, strrchr
+#include <bx/string.h>      // bx::stricmp, bx::snprintf
+#include <bx/os.h>          // bx::sleep
+#include <dm/misc.h>        // DM_PATH_LEN, dm::strscpya, dm::max
+
+#include "common/cmft.h"
+#include "common/jobs.h"    // cs::jobSubmit(), cs::jobsUpdate()
+#include "common/timer.h"   // timerCurrentSec()
+#include "common/config.h"  // Config
+#include "backgroundjobs.h" // CmftFilterThreadParams, cmftFilter()
+
+/// Notice: Always call tinydir functions between push/pop(_stackAlloc);
+#define _TINYDIR_MALLOC(_size) DM_ALLOC(dm::stackAlloc, _size)
+#define _TINYDIR_FREE(_ptr)    DM_FREE(dm::stackAlloc, _ptr)
+#include <tinydir/tinydir.h>
+
+struct BatchState
+{
+    const Config* m_config;
+    cmft::OutputType::Enum m_outputType;
+    uint16_t m_numFiles;
+    uint16_t m_numDone;
+    uint16_t m_numFailed;
+    uint16_t m_numInFlight;
+};
+
+struct BatchFile
+{
+    char m_inPath[DM_PATH_LEN];
+    char m_name[DM_PATH_LEN]; // Without extension.
+    const char* m_outDir;
+    BatchState* m_state;
+    uint8_t m_numCpuThreads;
+    double m_duration;
+    size_t m_memoryPeak; // Filter memory peak of the file, in bytes.
+};
+
+static bool batchIsSupportedFile(const char* _ext)
+{
+    static const char* sc_extensions[] = { "dds", "ktx", "tga", "hdr" };
+    for (uint8_t ii = 0; ii < BX_COUNTOF(sc_extensions); ++ii)
+    {
+        if (0 == bx::stricmp(_ext, sc_extensions[ii]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool batchFilterAndSave(CmftFilterThreadParams& _params, const BatchFile& _file, const char* _suffix)
+{
+    if (EXIT_SUCCESS != cmftFilter(_params))
+    {
+        cmft::imageUnload(_params.m_output);
+        return false;
+    }
+
+    // Notice: cmft appends file extension.
+    char path[DM_PATH_LEN];
+    bx::snprintf(path, sizeof(path), "%s" DM_DIRSLASH "%s%s", _file.m_outDir, _file.m_name, _suffix);
+
+    const Config& config = *_file.m_state->m_config;
+    const bool saved = cmft::imageSave(_params.m_output
+                                     , path
+                                     , config.m_batchFileType
+                                     , _file.m_state->m_outputType
+                                     , config.m_batchFormat
+                                     , false
+                                     );
+    cmft::imageUnload(_params.m_output);
+
+    return saved;
+}
+
+static int32_t batchFileFunc(void* _batchFile)
+{
+    BatchFile* file = (BatchFile*)_batchFile;
+    const Config& config = *file->m_state->m_config;
+
+    const double beginTime = timerCurrentSec();
+
+    cmft::Image image;
+    if (!cmft::imageLoad(image, file->m_inPath))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!cmft::imageIsEnvironmentMap(image, true))
+    {
+        cmft::imageUnload(image);
+        return EXIT_FAILURE;
+    }
+
+    cmft::Image cubemap;
+    if (cmft::imageIsLatLong(image))
+    {
+        cmft::imageCubemapFromLatLong(cubemap, image, true);
+    }
+    else
+    {
+        cmft::imageToCubemap(cubemap, image);
+    }
+    cmft::imageUnload(image);
+
+    // Notice: OpenCL is not used, concurrent jobs would compete for the same device.
+    CmftFilterThreadParams pmrem;
+    pmrem.m_filterType    = cs::Environment::Pmrem;
+    pmrem.m_srcSize       = (0 == config.m_batchSrcSize) ? cubemap.m_width : dm::min(config.m_batchSrcSize, cubemap.m_width);
+    pmrem.m_dstSize       = config.m_batchDstSize;
+    pmrem.m_mipCount      = config.m_batchMipCount;
+    pmrem.m_glossScale    = config.m_batchGlossScale;
+    pmrem.m_glossBias     = config.m_batchGlossBias;
+    pmrem.m_lightingModel = config.m_batchLightingModel;
+    pmrem.m_numCpuThreads = file->m_numCpuThreads;
+    pmrem.m_useOpenCL     = false;
+    cmft::imageRef(pmrem.m_input, cubemap);
+
+    CmftFilterThreadParams iem;
+    iem.m_filterType = cs::Environment::Iem;
+    iem.m_dstSize    = 128;
+    cmft::imageRef(iem.m_input, cubemap);
+
+    const bool success = batchFilterAndSave(pmrem, *file, "_pmrem")
+                      && batchFilterAndSave(iem,   *file, "_iem")
+                       ;
+
+    cmft::imageUnload(cubemap);
+
+    file->m_duration   = timerCurrentSec() - beginTime;
+    file->m_memoryPeak = dm::max(pmrem.m_memoryPeak, iem.m_memoryPeak);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void batchFileOnComplete(int32_t _result, void* _batchFile)
+{
+    const BatchFile* file = (const BatchFile*)_batchFile;
+    BatchState* state = file->m_state;
+
+    state->m_numInFlight--;
+    state->m_numDone++;
+
+    if (EXIT_SUCCESS == _result)
+    {
+        printf("[%u/%u] %s - done in %.1fs, %.1fMB memory peak.\n"
+              , state->m_numDone
+              , state->m_numFiles
+              , file->m_inPath
+              , file->m_duration
+              , double(file->m_memoryPeak)/(1024.0*1024.0)
+              );
+    }
+    else
+    {
+        state->m_numFailed++;
+        printf("[%u/%u] %s - failed!\n", state->m_numDone, state->m_numFiles, file->m_inPath);
+    }
+}
+
+static bool batchIsValidFormat(cmft::ImageFileType::Enum _fileType, cmft::TextureFormat::Enum _format)
+{
+    const cmft::TextureFormat::Enum* formats = cmft::getValidTextureFormats(_fileType);
+    for (uint8_t ii = 0; cmft::TextureFormat::Null != formats[ii]; ++ii)
+    {
+        if (_format == formats[ii])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Cubemap when the file type supports it, first supported layout otherwise.
+static cmft::OutputType::Enum batchOutputType(cmft::ImageFileType::Enum _fileType)
+{
+    const cmft::OutputType::Enum* outputTypes = cmft::getValidOutputTypes(_fileType);
+    for (uint8_t ii = 0; cmft::OutputType::Null != outputTypes[ii]; ++ii)
+    {
+        if (cmft::OutputType::Cubemap == outputTypes[ii])
+        {
+            return cmft::OutputType::Cubemap;
+        }
+    }
+
+    return outputTypes[0];
+}
+
+int32_t batchRun(const Config& _config)
+{
+    const char* inDir  = _config.m_batchInputDir;
+    const char* outDir = _config.m_batchOutputDir;
+    const uint8_t numFiles = _config.m_batchNumFiles;
+
+    if (!dm::fileExists(outDir))
+    {
+        fprintf(stderr, "Batch: output directory '%s' does not exist.\n", outDir);
+        return EXIT_FAILURE;
+    }
+
+    if (!batchIsValidFormat(_config.m_batchFileType, _config.m_batchFormat))
+    {
+        fprintf(stderr, "Batch: %s format can't be saved as %s file.\n"
+               , cmft::getTextureFormatStr(_config.m_batchFormat)
+               , cmft::getFilenameExtensionStr(_config.m_batchFileType)
+               );
+        return EXIT_FAILURE;
+    }
+
+    BatchState state;
+    memset(&state, 0, sizeof(state));
+    state.m_config     = &_config;
+    state.m_outputType = batchOutputType(_config.m_batchFileType);
+
+    // Gather input files.
+    BatchFile* files = NULL;
+    {
+        dm::StackAllocScope scope(dm::stackAlloc);
+
+        tinydir_dir dir;
+        if (-1 == tinydir_open_sorted(&dir, inDir))
+        {
+            fprintf(stderr, "Batch: input directory '%s' could not be opened.\n", inDir);
+            return EXIT_FAILURE;
+        }
+
+        files = (BatchFile*)DM_ALLOC(dm::mainAlloc, dm::max(dir.n_files, size_t(1))*sizeof(BatchFile));
+
+        for (size_t ii = 0, end = dir.n_files; ii < end; ++ii)
+        {
+            tinydir_file file;
+            if (-1 == tinydir_readfile_n(&dir, &file, ii)
+            ||  !file.is_reg
+            ||  !batchIsSupportedFile(file.extension))
+            {
+                continue;
+            }
+
+            BatchFile& batchFile = files[state.m_numFiles++];
+            dm::strscpya(batchFile.m_inPath, file.path);
+            dm::strscpya(batchFile.m_name,   file.name);
+            char* ext = strrchr(batchFile.m_name, '.');
+            if (NULL != ext)
+            {
+                *ext = '\0';
+            }
+            batchFile.m_outDir     = outDir;
+            batchFile.m_state      = &state;
+            batchFile.m_duration   = 0.0;
+            batchFile.m_memoryPeak = 0;
+        }
+
+        tinydir_close(&dir);
+    }
+
+    if (0 == state.m_numFiles)
+    {
+        fprintf(stderr, "Batch: no environment maps found in '%s'.\n", inDir);
+        DM_FREE(dm::mainAlloc, files);
+        return EXIT_FAILURE;
+    }
+
+    // Split cpu cores between files processed concurrently.
+    const uint8_t numCores      = cs::cpuNumCores();
+    const uint8_t numConcurrent = uint8_t(dm::min(uint16_t(0 == numFiles ? dm::min(numCores, uint8_t(4)) : numFiles), state.m_numFiles));
+    const uint8_t numCpuThreads = dm::max(uint8_t(numCores/numConcurrent), uint8_t(1));
+    for (uint16_t ii = 0; ii < state.m_numFiles; ++ii)
+    {
+        files[ii].m_numCpuThreads = numCpuThreads;
+    }
+
+    printf("Batch: processing %u files, %u at a time, %u cpu threads each.\n", state.m_numFiles, numConcurrent, numCpuThreads);
+
+    const double beginTime = timerCurrentSec();
+
+    uint16_t next = 0;
+    while (state.m_numDone < state.m_numFiles)
+    {
+        while (state.m_numInFlight < numConcurrent && next < state.m_numFiles)
+        {
+            const cs::JobHandle job = cs::jobSubmit(batchFileFunc
+                                                  , (void*)&files[next]
+                                                  , cs::JobPriority::Normal
+                                                  , batchFileOnComplete
+                                                  , (void*)&files[next]
+                                                  );
+            if (!cs::isValid(job))
+            {
+                break;
+            }
+
+            state.m_numInFlight++;
+            next++;
+        }
+
+        cs::jobsUpdate();
+        bx::sleep(10);
+    }
+
+    // Report.
+    const double elapsedSec    = timerCurrentSec() - beginTime;
+    const uint16_t numSucceded = state.m_numFiles - state.m_numFailed;
+    const double filesPerHour  = elapsedSec > 0.0 ? double(numSucceded)*3600.0/elapsedSec : 0.0;
+    printf("Batch: %u files processed, %u failed, %.1fs total, %.1f files/hour.\n"
+          , numSucceded
+          , state.m_numFailed
+          , elapsedSec
+          , filesPerHour
+          );
+
+    DM_FREE(dm::mainAlloc, files);
+
+    return (0 == state.m_numFailed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,22 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_BATCH_H_HEADER_GUARD
+#define CMFTSTUDIO_BATCH_H_HEADER_GUARD
+
+#include <stdint.h>
+
+struct Config;
+
+/// Headless batch processing. Requires allocators and job system to be initialized, bgfx is not used.
+/// Filters every environment map from '_config.m_batchInputDir' and saves radiance and irradiance cubemaps to
+/// '_config.m_batchOutputDir'. Filter settings and output file type and format are taken from '_config.m_batch*'.
+/// Up to '_config.m_batchNumFiles' files are processed concurrently, 0 picks the number based on available cpu cores.
+/// Returns EXIT_SUCCESS if all files were processed successfully.
+int32_t batchRun(const Config& _config);
+
+#endif // CMFTSTUDIO_BATCH_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -1,8 +1,12 @@
 #include "../assets.cpp"
 #include "../backgroundjobs.cpp"
+#include "../batch.cpp"
+#include "../clpool.cpp"
 #include "../cmftstudio.cpp"
 #include "../context.cpp"
 #include "../eventstate.cpp"
+#include "../filtercache.cpp"
+#include "../filtertune.cpp"
 #include "../gui.cpp"
 #include "../guimanager.cpp"
 #include "../inflatedeflate.cpp"
@@ -14,4 +18,9 @@
 #include "../common/allocator.cpp"
 #include "../common/config.cpp"
 #include "../common/globals.cpp"
+#include "../common/imageproc.cpp"
+#include "../common/jobs.cpp"
+#include "../common/mappedfile.cpp"
+#include "../common/mipmap.cpp"
+#include "../common/texcompress.cpp"
 #include "../common/timer.cpp"
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common/common.h"
+#include "clpool.h"
+
+#include <bx/thread.h> // bx::Mutex
+#include "common/cmft.h"
+
+struct ClPool
+{
+    enum
+    {
+        MaxContexts = 2, // Jobs sharing a device compete for it, more contexts don't pay off.
+    };
+
+    struct State
+    {
+        enum Enum
+        {
+            Unloaded,
+            Loaded,
+            Unavailable,
+        };
+    };
+
+    ClPool()
+    {
+        m_state       = State::Unloaded;
+        m_numContexts = 0;
+        for (uint8_t ii = 0; ii < MaxContexts; ++ii)
+        {
+            m_inUse[ii] = false;
+        }
+    }
+
+    bx::Mutex m_mutex;
+    State::Enum m_state;
+    uint8_t m_numContexts;
+    bool m_inUse[MaxContexts];
+    cmft::ClContext m_contexts[MaxContexts];
+};
+static ClPool s_clPool;
+
+static bool clPoolInitContext(cmft::ClContext& _context)
+{
+    // Prefer gpu, fall back to any cpu implementation.
+    return _context.init(CMFT_CL_VENDOR_ANY_GPU, CMFT_CL_DEVICE_TYPE_GPU, 0)
+        || _context.init(CMFT_CL_VENDOR_ANY_CPU|CMFT_CL_VENDOR_OTHER, CMFT_CL_DEVICE_TYPE_CPU, 0)
+         ;
+}
+
+cmft::ClContext* clPoolAcquire()
+{
+    ClPool& pool = s_clPool;
+    bx::MutexScope lock(pool.m_mutex);
+
+    if (ClPool::State::Unavailable == pool.m_state)
+    {
+        return NULL;
+    }
+
+    if (ClPool::State::Unloaded == pool.m_state)
+    {
+        if (!bx::clLoad()) // Dynamically load OpenCL lib.
+        {
+            pool.m_state = ClPool::State::Unavailable;
+            return NULL;
+        }
+
+        pool.m_state = ClPool::State::Loaded;
+    }
+
+    // Reuse an idle context.
+    for (uint8_t ii = 0; ii < pool.m_numContexts; ++ii)
+    {
+        if (!pool.m_inUse[ii])
+        {
+            pool.m_inUse[ii] = true;
+            return &pool.m_contexts[ii];
+        }
+    }
+
+    if (ClPool::MaxContexts == pool.m_numContexts)
+    {
+        return NULL;
+    }
+
+    // Create a new one.
+    cmft::ClContext& context = pool.m_contexts[pool.m_numContexts];
+    if (!clPoolInitContext(context))
+    {
+        // No usable platform or device. Later jobs don't retry if there was none from the start.
+        if (0 == pool.m_numContexts)
+        {
+            bx::clUnload();
+            pool.m_state = ClPool::State::Unavailable;
+        }
+
+        return NULL;
+    }
+
+    pool.m_inUse[pool.m_numContexts] = true;
+    pool.m_numContexts++;
+
+    return &context;
+}
+
+void clPoolRelease(cmft::ClContext* _context)
+{
+    if (NULL == _context)
+    {
+        return;
+    }
+
+    ClPool& pool = s_clPool;
+    bx::MutexScope lock(pool.m_mutex);
+
+    const uint8_t idx = uint8_t(_context - pool.m_contexts);
+    CS_CHECK(idx < pool.m_numContexts && pool.m_inUse[idx], "Invalid OpenCL context!");
+    pool.m_inUse[idx] = false;
+}
+
+void clPoolShutdown()
+{
+    ClPool& pool = s_clPool;
+    bx::MutexScope lock(pool.m_mutex);
+
+    for (uint8_t ii = 0; ii < pool.m_numContexts; ++ii)
+    {
+        CS_CHECK(!pool.m_inUse[ii], "OpenCL context is still in use!");
+        pool.m_contexts[ii].destroy();
+    }
+    pool.m_numContexts = 0;
+
+    if (ClPool::State::Loaded == pool.m_state)
+    {
+        bx::clUnload(); // Dynamically unload OpenCL lib.
+    }
+    pool.m_state = ClPool::State::Unloaded;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_CLPOOL_H_HEADER_GUARD
+#define CMFTSTUDIO_CLPOOL_H_HEADER_GUARD
+
+namespace cmft { struct ClContext; }
+
+/// Process-lifetime OpenCL contexts shared by radiance filter jobs. OpenCL lib is loaded and contexts are created on first
+/// acquire, and kept until clPoolShutdown(). Gpu devices are preferred, cpu implementations (for example pocl) are used
+/// when no gpu device is found. When there is no OpenCL platform, the pool is marked unavailable and is not retried.
+
+/// Returns a context for exclusive use by the calling job, or NULL when OpenCL is unavailable or all contexts are in use.
+/// Thread safe.
+cmft::ClContext* clPoolAcquire();
+
+/// Returns '_context' to the pool. NULL is ignored. Thread safe.
+void clPoolRelease(cmft::ClContext* _context);
+
+/// Destroys all contexts and unloads OpenCL lib. Call from the main thread, after all jobs have finished.
+void clPoolShutdown();
+
+#endif // CMFTSTUDIO_CLPOOL_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
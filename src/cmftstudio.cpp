@@ -17,6 +17,9 @@
 #include "geometry/loaders.h"
 
 #include "backgroundjobs.h"
+#include "batch.h"
+#include "filtercache.h"
+#include "clpool.h"
 #include "context.h"
 #include "assets.h"
 #include "settings.h"
@@ -1190,7 +1193,7 @@ struct CmftStudioApp
 private:
     static inline void cmftSaveAction(cs::EnvHandle _env, CmftSaveWidgetState& _widget)
     {
-        const cs::Environment& env = cs::getObj(_env);
+        const cs::Environment& env = cs::envGetResident(_env);
         const cmft::Image& output = env.m_cubemapImage[_widget.m_envType];
 
         const bool hasMem = (NULL != output.m_data) && (0 != output.m_dataSize);
@@ -1240,6 +1243,50 @@ private:
         }
     }
 
+    static const char* gpuFormatName(bgfx::TextureFormat::Enum _format)
+    {
+        switch (_format)
+        {
+        case bgfx::TextureFormat::BGRA8:   return "BGRA8";
+        case bgfx::TextureFormat::RGBA16:  return "RGBA16";
+        case bgfx::TextureFormat::RGBA16F: return "RGBA16F";
+        case bgfx::TextureFormat::RGBA32F: return "RGBA32F";
+        case bgfx::TextureFormat::RGB9E5F: return "RGB9E5F";
+        default:                           return "Other";
+        };
+    }
+
+    static void printEnvGpuFormats(cs::EnvHandle _env)
+    {
+        static const char* s_mapName[cs::Environment::Count] = { "Skybox", "Pmrem", "Iem" };
+
+        const cs::Environment& env = cs::getObj(_env);
+
+        uint32_t srcTotal = 0;
+        uint32_t gpuTotal = 0;
+        for (uint8_t ii = 0; ii < cs::Environment::Count; ++ii)
+        {
+            const cs::EnvGpuFormat& info = env.m_gpuFormat[ii];
+            outputWindowPrint("[Env gpu]  %-6s %-7s %.1fMB -> %.1fMB, max value %.1f, error %.3f%%."
+                            , s_mapName[ii]
+                            , gpuFormatName(info.m_format)
+                            , double(info.m_srcSize)/(1024.0*1024.0)
+                            , double(info.m_gpuSize)/(1024.0*1024.0)
+                            , info.m_maxValue
+                            , info.m_error*100.0f
+                            );
+
+            srcTotal += info.m_srcSize;
+            gpuTotal += info.m_gpuSize;
+        }
+
+        outputWindowPrint("[Env gpu]  '%s': %.1fMB on gpu, %.1fMB saved."
+                        , cs::getName(_env)
+                        , double(gpuTotal)/(1024.0*1024.0)
+                        , double(srcTotal - gpuTotal)/(1024.0*1024.0)
+                        );
+    }
+
     static inline void envBrowseAction(EnvMapBrowserState& _state, cs::EnvHandle _currentEnv)
     {
         const bool loaded = cs::envLoad(_currentEnv, _state.m_selection, _state.m_filePath);
@@ -1247,6 +1294,7 @@ private:
         if (loaded)
         {
             cs::createGpuBuffers(_currentEnv);
+            printEnvGpuFormats(_currentEnv);
 
             char msg[128];
             bx::snprintf(msg, sizeof(msg), "Cubemap '%s' successfully loaded.", _state.m_fileName);
@@ -1260,6 +1308,150 @@ private:
         }
     }
 
+    static inline void cmftFilterResult(CmftFilterThreadParams& _params)
+    {
+        if (ThreadStatus::Completed & _params.m_threadStatus)
+        {
+            if (threadStatus(ThreadStatus::Halted, _params.m_threadStatus))
+            {
+                if (cs::Environment::Iem == _params.m_filterType)
+                {
+                    imguiRemoveStatusMessage(StatusWindowId::FilterIem);
+                    imguiStatusMessage("Irradiance filter canceled.", 3.0f, false, "Close");
+                }
+                else //if (cs::Environment::Pmrem == _params.m_filterType).
+                {
+                    cmftFilterPreviewEnd(_params, false);
+                    imguiRemoveStatusMessage(StatusWindowId::FilterPmrem);
+                    imguiStatusMessage("Radiance filter canceled.", 3.0f, false, "Close");
+                }
+            }
+            else if (threadStatus(ThreadStatus::ExitSuccess, _params.m_threadStatus))
+            {
+                if (cs::Environment::Iem == _params.m_filterType)
+                {
+                    cs::envLoad(_params.m_envHandle, cs::Environment::Iem, _params.m_output);
+                    cs::createGpuBuffers(_params.m_envHandle);
+                    printEnvGpuFormats(_params.m_envHandle);
+                    imguiRemoveStatusMessage(StatusWindowId::FilterIem);
+                    imguiStatusMessage("Irraidance filter completed!", 3.0f, false, "Close");
+                }
+                else //if (cs::Environment::Pmrem == _params.m_filterType).
+                {
+                    cmftFilterPreviewEnd(_params, true);
+
+                    cs::Environment& env = cs::getObj(_params.m_envHandle);
+                    env.m_edgeFixup = (cmft::EdgeFixup::Enum)_params.m_edgeFixup;
+
+                    cs::envLoad(_params.m_envHandle, cs::Environment::Pmrem, _params.m_output);
+                    cs::createGpuBuffers(_params.m_envHandle);
+                    printEnvGpuFormats(_params.m_envHandle);
+                    imguiRemoveStatusMessage(StatusWindowId::FilterPmrem);
+                    imguiStatusMessage("Radiance filter completed!", 3.0f, false, "Close");
+                }
+            }
+            else
+            {
+                if (cs::Environment::Iem == _params.m_filterType)
+                {
+                    imguiRemoveStatusMessage(StatusWindowId::FilterIem);
+                    imguiStatusMessage("Irraidance filter failed!", 3.0f, true, "Close");
+                }
+                else //if (cs::Environment::Pmrem == _params.m_filterType).
+                {
+                    cmftFilterPreviewEnd(_params, false);
+                    imguiRemoveStatusMessage(StatusWindowId::FilterPmrem);
+                    imguiStatusMessage("Radiance filter failed!", 3.0f, true, "Close");
+                }
+            }
+
+            // Cleanup.
+            _params.m_threadStatus = ThreadStatus::Idle;
+        }
+    }
+
+    static inline void cmftFilterStatus(const CmftFilterThreadParams& _params)
+    {
+        if (ThreadStatus::Started != _params.m_threadStatus)
+        {
+            return;
+        }
+
+        const uint32_t percent = uint32_t(cmftFilterProgress(_params)*100.0f);
+
+        char msg[128];
+        if (cs::Environment::Iem == _params.m_filterType)
+        {
+            bx::snprintf(msg, sizeof(msg), "[ Cmft irradiance filter running in background... %u%% ]", percent);
+            imguiStatusMessageSetText(StatusWindowId::FilterIem, msg);
+        }
+        else //if (cs::Environment::Pmrem == _params.m_filterType).
+        {
+            bx::snprintf(msg, sizeof(msg), "[ Cmft radiance filter running in background... %u%% ]", percent);
+            imguiStatusMessageSetText(StatusWindowId::FilterPmrem, msg);
+        }
+    }
+
+    bool backgroundJobsInProgress() const
+    {
+        return ThreadStatus::Idle != m_threadParams.m_cmftPmrem.m_threadStatus
+            || ThreadStatus::Idle != m_threadParams.m_cmftIem.m_threadStatus
+            || ThreadStatus::Idle != m_threadParams.m_modelLoad.m_threadStatus
+            || ThreadStatus::Idle != m_threadParams.m_projectSave.m_threadStatus
+            || ThreadStatus::Idle != m_threadParams.m_tonemap.m_threadStatus
+            || 0 != cs::textureLoadsInFlight() // Browsed textures are added to the current texture list once uploaded.
+            ;
+    }
+
+    void queueGpuUploads(cs::TextureList& _textureList, cs::MeshInstanceList& _meshInstList, cs::EnvList& _envList)
+    {
+        for (uint16_t ii = 0, end = _textureList.count(); ii < end; ++ii)
+        {
+            cs::gpuUploadQueue(_textureList[ii]);
+        }
+        for (uint16_t ii = 0, end = _meshInstList.count(); ii < end; ++ii)
+        {
+            cs::gpuUploadQueue(_meshInstList[ii].m_mesh);
+        }
+        for (uint16_t ii = 0, end = _envList.count(); ii < end; ++ii)
+        {
+            cs::gpuUploadQueue(_envList[ii]);
+        }
+    }
+
+    void printGpuUploadStats(const char* _what)
+    {
+        const cs::GpuUploadStats& stats = cs::gpuUploadStats();
+        outputWindowPrint("%s: %u resources, %.1fMB uploaded to gpu in %u frames, %.1fms (max %.1fms per frame), %.1fMB/s."
+                        , _what
+                        , stats.m_numUploaded
+                        , double(stats.m_totalBytes)/(1024.0*1024.0)
+                        , stats.m_numFrames
+                        , stats.m_totalMs
+                        , stats.m_maxFrameMs
+                        , stats.m_mbPerSec
+                        );
+    }
+
+    void textureUploadHandler()
+    {
+        // Decoded textures are in the gpu upload queue, it is already updated while sending project resources to gpu.
+        if (!onState(State::SendResourcesToGpu))
+        {
+            cs::gpuUploadUpdate();
+        }
+
+        cs::TextureHandle textures[TextureBrowser_MaxSelectedFiles];
+        uint16_t texPickerFor[TextureBrowser_MaxSelectedFiles];
+        const uint16_t count = cs::textureUploadPending(textures, texPickerFor, TextureBrowser_MaxSelectedFiles);
+
+        for (uint16_t ii = 0; ii < count; ++ii)
+        {
+            m_textureList.add(textures[ii]);
+            m_widgets.m_texPicker[texPickerFor[ii]].m_selection = m_textureList.count()-1;
+        }
+    }
+
     void guiActionHandler()
     {
         cs::MeshInstance&   instance  = m_meshInstList[m_settings.m_selectedMeshIdx];
@@ -1422,16 +1614,58 @@ private:
         // TextureBrowser action.
         if (guiEvent(GuiEvent::HandleAction, m_widgets.m_textureBrowser.m_events))
         {
+            // Mip filtering and block format follow how the material shader samples each slot.
+            struct TextureImport
+            {
+                cs::MipContent::Enum m_mipContent;
+                cs::TextureCompression::Enum m_compression;
+            };
+
+            static const TextureImport s_import[cs::Material::TextureCount] =
+            {
+                { cs::MipContent::Srgb,   cs::TextureCompression::Color  }, // Material::Albedo
+                { cs::MipContent::Normal, cs::TextureCompression::Normal }, // Material::Normal
+                { cs::MipContent::Linear, cs::TextureCompression::Mask   }, // Material::Surface
+                { cs::MipContent::Srgb,   cs::TextureCompression::Color  }, // Material::Reflectivity
+                { cs::MipContent::Linear, cs::TextureCompression::Mask   }, // Material::Occlusion
+                { cs::MipContent::Srgb,   cs::TextureCompression::Color  }, // Material::Emissive
+            };
+
+            const cs::Material::Texture texPickerFor = m_widgets.m_textureBrowser.m_texPickerFor;
+            const TextureImport& import = s_import[texPickerFor];
+            cs::TextureCompression::Enum compression = g_config.m_compressTextures
+                                                     ? import.m_compression
+                                                     : cs::TextureCompression::None
+                                                     ;
+
+            // BC4 keeps only the red channel, masks swizzled from other channels are compressed as color.
+            if (cs::TextureCompression::Mask == compression)
+            {
+                const cs::Material& material = cs::getObj(instance.getActiveMaterial());
+                const float* swizzle = (cs::Material::Surface == texPickerFor) ? material.m_swizSurface : material.m_swizOcclusion;
+                if (1.0f != swizzle[0])
+                {
+                    compression = cs::TextureCompression::Color;
+                }
+            }
+
             for (uint16_t ii = m_widgets.m_textureBrowser.m_files.count(); ii--; )
             {
                 const TextureBrowserWidgetState::BrowserState::File& file = m_widgets.m_textureBrowser.m_files[ii];
 
-                if ('\0' != file.m_path[0])
+                // Decoded in the background, added to the list once uploaded, see textureUploadHandler().
+                if ('\0' != file.m_path[0]
+                &&  !cs::textureLoadAsync(file.m_path
+                                         , file.m_name
+                                         , uint16_t(texPickerFor)
+                                         , g_config.m_mipFilter
+                                         , import.m_mipContent
+                                         , compression
+                                         ))
                 {
-                    const cs::TextureHandle texture = cs::textureLoad(file.m_path);
-                    cs::setName(texture, file.m_name);
-                    m_textureList.add(texture);
-                    m_widgets.m_texPicker[m_widgets.m_textureBrowser.m_texPickerFor].m_selection = m_textureList.count()-1;
+                    char msg[128];
+                    bx::snprintf(msg, sizeof(msg), "Too many textures loading, '%s' skipped.", file.m_nameExt);
+                    imguiStatusMessage(msg, 3.0f, true, "Close");
                 }
             }
 
@@ -1526,37 +1760,44 @@ private:
         // CmftPmremWidget action.
         if (guiEvent(GuiEvent::HandleAction, m_widgets.m_cmftPmrem.m_events))
         {
-            if (!m_backgroundThread.isRunning()
-            &&  ThreadStatus::Idle == m_threadParams.m_cmftFilter.m_threadStatus)
+            if (ThreadStatus::Idle == m_threadParams.m_cmftPmrem.m_threadStatus
+            &&  ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus)
             {
                 // Hide CmftPmremWidget.
                 widgetHide(Widget::RightSideSubwidgetMask);
 
                 // Copy parameters.
                 const cs::EnvHandle handle = m_envList[m_settings.m_selectedEnvMap];
-                const cs::Environment& env = cs::getObj(handle);
-                cmft::imageRef(m_threadParams.m_cmftFilter.m_input, env.m_cubemapImage[cs::Environment::Skybox]);
-                m_threadParams.m_cmftFilter.m_srcSize       = uint32_t(m_widgets.m_cmftPmrem.m_srcSize);
-                m_threadParams.m_cmftFilter.m_dstSize       = uint32_t(m_widgets.m_cmftPmrem.m_dstSize);
-                m_threadParams.m_cmftFilter.m_inputGamma    = m_widgets.m_cmftPmrem.m_inputGamma;
-                m_threadParams.m_cmftFilter.m_outputGamma   = m_widgets.m_cmftPmrem.m_outputGamma;
-                m_threadParams.m_cmftFilter.m_mipCount      = uint8_t(m_widgets.m_cmftPmrem.m_mipCount);
-                m_threadParams.m_cmftFilter.m_glossScale    = uint8_t(m_widgets.m_cmftPmrem.m_glossScale);
-                m_threadParams.m_cmftFilter.m_glossBias     = uint8_t(m_widgets.m_cmftPmrem.m_glossBias);
-                m_threadParams.m_cmftFilter.m_numCpuThreads = uint8_t(m_widgets.m_cmftPmrem.m_numCpuThreads);
-                m_threadParams.m_cmftFilter.m_filterType    = cs::Environment::Pmrem;
-                m_threadParams.m_cmftFilter.m_lightingModel = (cmft::LightingModel::Enum)m_widgets.m_cmftPmrem.m_lightingModel;
-                m_threadParams.m_cmftFilter.m_edgeFixup     = (cmft::EdgeFixup::Enum)m_widgets.m_cmftPmrem.m_edgeFixup;
-                m_threadParams.m_cmftFilter.m_excludeBase   = m_widgets.m_cmftPmrem.m_excludeBase;
-                m_threadParams.m_cmftFilter.m_useOpenCL     = m_widgets.m_cmftPmrem.m_useOpenCL;
-                m_threadParams.m_cmftFilter.m_envHandle     = handle;
-
-                // Start background thread.
-                m_backgroundThread.init(cmftFilterFunc, (void*)&m_threadParams.m_cmftFilter);
+                const cs::Environment& env = cs::envGetResident(handle);
+                cmft::imageRef(m_threadParams.m_cmftPmrem.m_input, env.m_cubemapImage[cs::Environment::Skybox]);
+                m_threadParams.m_cmftPmrem.m_srcSize       = uint32_t(m_widgets.m_cmftPmrem.m_srcSize);
+                m_threadParams.m_cmftPmrem.m_dstSize       = uint32_t(m_widgets.m_cmftPmrem.m_dstSize);
+                m_threadParams.m_cmftPmrem.m_inputGamma    = m_widgets.m_cmftPmrem.m_inputGamma;
+                m_threadParams.m_cmftPmrem.m_outputGamma   = m_widgets.m_cmftPmrem.m_outputGamma;
+                m_threadParams.m_cmftPmrem.m_mipCount      = uint8_t(m_widgets.m_cmftPmrem.m_mipCount);
+                m_threadParams.m_cmftPmrem.m_glossScale    = uint8_t(m_widgets.m_cmftPmrem.m_glossScale);
+                m_threadParams.m_cmftPmrem.m_glossBias     = uint8_t(m_widgets.m_cmftPmrem.m_glossBias);
+                m_threadParams.m_cmftPmrem.m_numCpuThreads = uint8_t(m_widgets.m_cmftPmrem.m_numCpuThreads);
+                m_threadParams.m_cmftPmrem.m_filterType    = cs::Environment::Pmrem;
+                m_threadParams.m_cmftPmrem.m_lightingModel = (cmft::LightingModel::Enum)m_widgets.m_cmftPmrem.m_lightingModel;
+                m_threadParams.m_cmftPmrem.m_edgeFixup     = (cmft::EdgeFixup::Enum)m_widgets.m_cmftPmrem.m_edgeFixup;
+                m_threadParams.m_cmftPmrem.m_excludeBase   = m_widgets.m_cmftPmrem.m_excludeBase;
+                m_threadParams.m_cmftPmrem.m_useOpenCL     = m_widgets.m_cmftPmrem.m_useOpenCL;
+                m_threadParams.m_cmftPmrem.m_envHandle     = handle;
+                m_threadParams.m_cmftPmrem.m_progressive   = true;
+                m_threadParams.m_cmftPmrem.m_progress      = 0;
+                m_threadParams.m_cmftPmrem.m_cancel        = 0;
+
+                // Start background job.
+                if (!threadStart(cmftFilterFunc, (void*)&m_threadParams.m_cmftPmrem, m_threadParams.m_cmftPmrem.m_threadStatus))
+                {
+                    const char* msg = "cmft radiance filter could not be started at this time. Radiance filter or project loading is in progress!";
+                    imguiStatusMessage(msg, 6.0f, true, "Close");
+                }
             }
             else
             {
-                const char* msg = "cmft processing could not be started at this time. Background thread is in use!";
+                const char* msg = "cmft radiance filter could not be started at this time. Radiance filter or project loading is in progress!";
                 imguiStatusMessage(msg, 6.0f, true, "Close");
             }
         }
@@ -1564,29 +1805,35 @@ private:
         // CmftIemWidget action.
         if (guiEvent(GuiEvent::HandleAction, m_widgets.m_cmftIem.m_events))
         {
-            if (!m_backgroundThread.isRunning()
-            &&  ThreadStatus::Idle == m_threadParams.m_cmftFilter.m_threadStatus)
+            if (ThreadStatus::Idle == m_threadParams.m_cmftIem.m_threadStatus
+            &&  ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus)
             {
                 // Hide CmftIemWidget.
                 widgetHide(Widget::RightSideSubwidgetMask);
 
                 // Copy parameters.
                 const cs::EnvHandle handle = m_envList[m_settings.m_selectedEnvMap];
-                const cs::Environment& env = cs::getObj(handle);
-                cmft::imageRef(m_threadParams.m_cmftFilter.m_input, env.m_cubemapImage[cs::Environment::Skybox]);
-                m_threadParams.m_cmftFilter.m_srcSize     = uint32_t(m_widgets.m_cmftIem.m_srcSize);
-                m_threadParams.m_cmftFilter.m_dstSize     = uint32_t(m_widgets.m_cmftIem.m_dstSize);
-                m_threadParams.m_cmftFilter.m_inputGamma  = m_widgets.m_cmftIem.m_inputGamma;
-                m_threadParams.m_cmftFilter.m_outputGamma = m_widgets.m_cmftIem.m_outputGamma;
-                m_threadParams.m_cmftFilter.m_filterType  = cs::Environment::Iem;
-                m_threadParams.m_cmftFilter.m_envHandle   = handle;
-
-                // Start background thread.
-                m_backgroundThread.init(cmftFilterFunc, (void*)&m_threadParams.m_cmftFilter);
+                const cs::Environment& env = cs::envGetResident(handle);
+                cmft::imageRef(m_threadParams.m_cmftIem.m_input, env.m_cubemapImage[cs::Environment::Skybox]);
+                m_threadParams.m_cmftIem.m_srcSize     = uint32_t(m_widgets.m_cmftIem.m_srcSize);
+                m_threadParams.m_cmftIem.m_dstSize     = uint32_t(m_widgets.m_cmftIem.m_dstSize);
+                m_threadParams.m_cmftIem.m_inputGamma  = m_widgets.m_cmftIem.m_inputGamma;
+                m_threadParams.m_cmftIem.m_outputGamma = m_widgets.m_cmftIem.m_outputGamma;
+                m_threadParams.m_cmftIem.m_filterType  = cs::Environment::Iem;
+                m_threadParams.m_cmftIem.m_envHandle   = handle;
+                m_threadParams.m_cmftIem.m_progress    = 0;
+                m_threadParams.m_cmftIem.m_cancel      = 0;
+
+                // Start background job.
+                if (!threadStart(cmftFilterFunc, (void*)&m_threadParams.m_cmftIem, m_threadParams.m_cmftIem.m_threadStatus))
+                {
+                    const char* msg = "cmft irradiance filter could not be started at this time. Irradiance filter or project loading is in progress!";
+                    imguiStatusMessage(msg, 6.0f, true, "Close");
+                }
             }
             else
             {
-                const char* msg = "cmft processing could not be started at this time. Background thread is in use!";
+                const char* msg = "cmft irradiance filter could not be started at this time. Irradiance filter or project loading is in progress!";
                 imguiStatusMessage(msg, 6.0f, true, "Close");
             }
         }
@@ -1607,58 +1854,119 @@ private:
             }
             else //if (TonemapWidgetState::Tonemapped == m_widgets.m_tonemapWidget.m_selection).
             {
-                envTonemap(m_widgets.m_tonemapWidget.m_env
-                         , 1.0f/m_widgets.m_tonemapWidget.m_invGamma
-                         , m_widgets.m_tonemapWidget.m_minLum
-                         , m_widgets.m_tonemapWidget.m_lumRange
-                         );
-                imguiStatusMessage("Tonemap operator applied!", 3.0f, false);
+                if (ThreadStatus::Idle == m_threadParams.m_tonemap.m_threadStatus)
+                {
+                    // Tonemap is always applied to the original image.
+                    const cs::EnvHandle handle = m_widgets.m_tonemapWidget.m_env;
+                    const cs::Environment& env = cs::envGetResident(handle);
+                    const cmft::Image& source = cmft::imageIsValid(env.m_origSkyboxImage)
+                                              ? env.m_origSkyboxImage
+                                              : env.m_cubemapImage[cs::Environment::Skybox]
+                                              ;
+
+                    // Job works on its own copy, skybox can be replaced, restored or removed while it is running.
+                    cmft::imageCopy(m_threadParams.m_tonemap.m_input, source);
+                    m_threadParams.m_tonemap.m_gamma         = 1.0f/m_widgets.m_tonemapWidget.m_invGamma;
+                    m_threadParams.m_tonemap.m_minLum        = m_widgets.m_tonemapWidget.m_minLum;
+                    m_threadParams.m_tonemap.m_lumRange      = m_widgets.m_tonemapWidget.m_lumRange;
+                    m_threadParams.m_tonemap.m_envHandle     = cs::acquire(handle);
+                    m_threadParams.m_tonemap.m_skyboxVersion = env.m_skyboxVersion;
+
+                    // Start background job.
+                    if (!threadStart(tonemapFunc, (void*)&m_threadParams.m_tonemap, m_threadParams.m_tonemap.m_threadStatus, cs::JobPriority::High))
+                    {
+                        cmft::imageUnload(m_threadParams.m_tonemap.m_input);
+                        cs::release(m_threadParams.m_tonemap.m_envHandle);
+                        imguiStatusMessage("Tonemap operator could not be applied at this time!", 3.0f, true);
+                    }
+                }
+                else
+                {
+                    imguiStatusMessage("Tonemap operator is already being applied!", 3.0f, true);
+                }
             }
         }
 
-        // CmftFilter thread result.
-        if (ThreadStatus::Completed & m_threadParams.m_cmftFilter.m_threadStatus)
+        // Tonemap job result.
+        if ((ThreadStatus::Completed & m_threadParams.m_tonemap.m_threadStatus)
+        &&  ThreadStatus::Idle == m_threadParams.m_projectSave.m_threadStatus)
         {
-            if (threadStatus(ThreadStatus::ExitSuccess, m_threadParams.m_cmftFilter.m_threadStatus))
-            {
-                if (cs::Environment::Iem == m_threadParams.m_cmftFilter.m_filterType)
-                {
-                    cs::envLoad(m_threadParams.m_cmftFilter.m_envHandle, cs::Environment::Iem, m_threadParams.m_cmftFilter.m_output);
-                    cs::createGpuBuffers(m_threadParams.m_cmftFilter.m_envHandle);
-                    imguiRemoveStatusMessage(StatusWindowId::FilterIem);
-                    imguiStatusMessage("Irraidance filter completed!", 3.0f, false, "Close");
-                }
-                else //if (cs::Environment::Pmrem == m_threadParams.m_cmftFilter.m_filterType).
-                {
-                    cs::Environment& env = cs::getObj(m_threadParams.m_cmftFilter.m_envHandle);
-                    env.m_edgeFixup = (cmft::EdgeFixup::Enum)m_threadParams.m_cmftFilter.m_edgeFixup;
+            const cs::EnvHandle handle = m_threadParams.m_tonemap.m_envHandle;
+            const bool skyboxChanged = m_threadParams.m_tonemap.m_skyboxVersion != cs::getObj(handle).m_skyboxVersion;
 
-                    cs::envLoad(m_threadParams.m_cmftFilter.m_envHandle, cs::Environment::Pmrem, m_threadParams.m_cmftFilter.m_output);
-                    cs::createGpuBuffers(m_threadParams.m_cmftFilter.m_envHandle);
-                    imguiRemoveStatusMessage(StatusWindowId::FilterPmrem);
-                    imguiStatusMessage("Radiance filter completed!", 3.0f, false, "Close");
-                }
+            if (threadStatus(ThreadStatus::ExitSuccess, m_threadParams.m_tonemap.m_threadStatus)
+            &&  !skyboxChanged)
+            {
+                cs::envTonemap(handle, m_threadParams.m_tonemap.m_output);
+                imguiStatusMessage("Tonemap operator applied!", 3.0f, false);
             }
             else
             {
-                if (cs::Environment::Iem == m_threadParams.m_cmftFilter.m_filterType)
+                // Result is stale if skybox was changed while the job was running.
+                if (skyboxChanged)
                 {
-                    imguiRemoveStatusMessage(StatusWindowId::FilterIem);
-                    imguiStatusMessage("Irraidance filter failed!", 3.0f, true, "Close");
+                    imguiStatusMessage("Skybox changed while tonemapping. Tonemap result discarded.", 3.0f, true);
                 }
-                else //if (cs::Environment::Pmrem == m_threadParams.m_cmftFilter.m_filterType).
+
+                cmft::imageUnload(m_threadParams.m_tonemap.m_output);
+            }
+
+            cmft::imageUnload(m_threadParams.m_tonemap.m_input);
+            cs::release(handle);
+            m_threadParams.m_tonemap.m_envHandle = cs::EnvHandle::invalid();
+            m_threadParams.m_tonemap.m_threadStatus = ThreadStatus::Idle;
+        }
+
+        // Filter calibration result.
+        if (ThreadStatus::Completed & m_threadParams.m_filterTune.m_threadStatus)
+        {
+            if (threadStatus(ThreadStatus::ExitSuccess, m_threadParams.m_filterTune.m_threadStatus))
+            {
+                g_config.m_filterTuned      = true;
+                g_config.m_filterCpuThreads = m_threadParams.m_filterTune.m_numCpuThreads;
+                g_config.m_filterUseOpenCL  = m_threadParams.m_filterTune.m_useOpenCL;
+                configSaveFilterTuning(g_config);
+
+                // Settings the user picked meanwhile are kept.
+                if (m_threadParams.m_filterTune.m_widgetCpuThreads == m_widgets.m_cmftPmrem.m_numCpuThreads
+                &&  m_threadParams.m_filterTune.m_widgetUseOpenCL  == m_widgets.m_cmftPmrem.m_useOpenCL)
                 {
-                    imguiRemoveStatusMessage(StatusWindowId::FilterPmrem);
-                    imguiStatusMessage("Radiance filter failed!", 3.0f, true, "Close");
+                    m_widgets.m_cmftPmrem.m_numCpuThreads = float(g_config.m_filterCpuThreads);
+                    m_widgets.m_cmftPmrem.m_useOpenCL     = g_config.m_filterUseOpenCL;
                 }
             }
 
-            // Cleanup.
-            if (m_backgroundThread.isRunning())
+            m_threadParams.m_filterTune.m_threadStatus = ThreadStatus::Idle;
+        }
+
+        // Status message buttons.
+        for (uint16_t event = imguiGetStatusEvent(); StatusEvent::None != event; event = imguiGetStatusEvent())
+        {
+            if (StatusEvent::CancelFilterPmrem == event
+            &&  ThreadStatus::Idle != m_threadParams.m_cmftPmrem.m_threadStatus)
             {
-                m_backgroundThread.shutdown();
+                cmftFilterCancel(m_threadParams.m_cmftPmrem);
+                outputWindowPrint("Canceling radiance filter...");
+            }
+            else if (StatusEvent::CancelFilterIem == event
+                 &&  ThreadStatus::Idle != m_threadParams.m_cmftIem.m_threadStatus)
+            {
+                cmftFilterCancel(m_threadParams.m_cmftIem);
+                outputWindowPrint("Canceling irradiance filter...");
             }
-            m_threadParams.m_cmftFilter.m_threadStatus = ThreadStatus::Idle;
+        }
+
+        // CmftFilter job progress.
+        cmftFilterStatus(m_threadParams.m_cmftPmrem);
+        cmftFilterStatus(m_threadParams.m_cmftIem);
+
+        // CmftFilter job previews and results.
+        // Notice: both are applied only while project is not being saved, as saving reads environment images.
+        if (ThreadStatus::Idle == m_threadParams.m_projectSave.m_threadStatus)
+        {
+            cmftFilterPreviewUpdate(m_threadParams.m_cmftPmrem);
+            cmftFilterResult(m_threadParams.m_cmftPmrem);
+            cmftFilterResult(m_threadParams.m_cmftIem);
         }
 
         // MeshSaveWidget action.
@@ -1693,7 +2001,7 @@ private:
                 // Obj loading is taking a long time, do it in a background thread.
                 if (0 == strcmp("obj", m_widgets.m_meshBrowser.m_fileExt))
                 {
-                    if (!m_backgroundThread.isRunning() && ThreadStatus::Idle == m_threadParams.m_cmftFilter.m_threadStatus)
+                    if (ThreadStatus::Idle == m_threadParams.m_modelLoad.m_threadStatus)
                     {
                         // Setup parameters.
                         CS_CHECK(sizeof(m_threadParams.m_modelLoad.m_userData) >= sizeof(ObjInData), "Array overflow!");
@@ -1711,12 +2019,18 @@ private:
                         // Acquire stack allocator for this thread.
                         m_threadParams.m_modelLoad.m_stackAlloc = dm::allocSplitStack(DM_MEGABYTES(200), DM_MEGABYTES(400));
 
-                        // Start thread.
-                        m_backgroundThread.init(modelLoadFunc, (void*)&m_threadParams.m_modelLoad);
+                        // Start background job.
+                        if (!threadStart(modelLoadFunc, (void*)&m_threadParams.m_modelLoad, m_threadParams.m_modelLoad.m_threadStatus))
+                        {
+                            dm::allocFreeStack(m_threadParams.m_modelLoad.m_stackAlloc);
+
+                            const char* msg = "Mesh could not be converted right now. Too many background jobs are running!";
+                            imguiStatusMessage(msg, 6.0f, true, "Close");
+                        }
                     }
                     else
                     {
-                        const char* msg = "Mesh could not be converted right now. Background thread is in use!";
+                        const char* msg = "Mesh could not be converted right now. Another mesh is being converted!";
                         imguiStatusMessage(msg, 6.0f, true, "Close");
                     }
                 }
@@ -1801,10 +2115,6 @@ private:
             imguiRemoveStatusMessage(StatusWindowId::MeshConversion);
 
             // Cleanup.
-            if (m_backgroundThread.isRunning())
-            {
-                m_backgroundThread.shutdown();
-            }
             m_threadParams.m_modelLoad.m_threadStatus = ThreadStatus::Idle;
             dm::allocFreeStack(m_threadParams.m_modelLoad.m_stackAlloc);
         }
@@ -1814,8 +2124,8 @@ private:
         {
             if (ProjectWindowState::Load == m_widgets.m_projectWindow.m_action)
             {
-                if (!m_backgroundThread.isRunning()
-                &&  ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus)
+                if (ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus
+                &&  !backgroundJobsInProgress())
                 {
                     // Copy params.
                     dm::strscpya(m_threadParams.m_projectLoad.m_path, m_widgets.m_projectWindow.m_load.m_filePath);
@@ -1824,19 +2134,25 @@ private:
                     // Acquire stack allocator for this thread.
                     m_threadParams.m_projectLoad.m_stackAlloc = dm::allocSplitStack(DM_MEGABYTES(800), DM_MEGABYTES(400));
 
-                    // Start background thread.
-                    m_backgroundThread.init(projectLoadFunc, (void*)&m_threadParams.m_projectLoad);
+                    // Start background job.
+                    if (!threadStart(projectLoadFunc, (void*)&m_threadParams.m_projectLoad, m_threadParams.m_projectLoad.m_threadStatus, cs::JobPriority::High))
+                    {
+                        dm::allocFreeStack(m_threadParams.m_projectLoad.m_stackAlloc);
+
+                        const char* msg = "cmftStudio project could not be loaded at this time. Wait for background jobs to finish!";
+                        imguiStatusMessage(msg, 6.0f, true, "Close");
+                    }
                 }
                 else
                 {
-                    const char* msg = "cmftStudio project could not be loaded at this time. Background thread is in use!";
+                    const char* msg = "cmftStudio project could not be loaded at this time. Wait for background jobs to finish!";
                     imguiStatusMessage(msg, 6.0f, true, "Close");
                 }
             }
             else //if (m_widgets.m_projectWindow::Save == m_widgets.m_projectWindow.m_action).
             {
-                if (!m_backgroundThread.isRunning()
-                &&  ThreadStatus::Idle == m_threadParams.m_projectSave.m_threadStatus)
+                if (ThreadStatus::Idle == m_threadParams.m_projectSave.m_threadStatus
+                &&  ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus)
                 {
                     // Copy resource handles and settings parameters.
                     for (uint16_t ii = 0, end = m_materialList.count(); ii < end; ++ii)
@@ -1864,12 +2180,19 @@ private:
                     // Acquire stack allocator for this thread.
                     m_threadParams.m_projectSave.m_stackAlloc = dm::allocSplitStack(DM_MEGABYTES(200), DM_MEGABYTES(400));
 
-                    // Start background thread.
-                    m_backgroundThread.init(projectSaveFunc, (void*)&m_threadParams.m_projectSave);
+                    // Start background job.
+                    if (!threadStart(projectSaveFunc, (void*)&m_threadParams.m_projectSave, m_threadParams.m_projectSave.m_threadStatus, cs::JobPriority::High))
+                    {
+                        m_threadParams.m_projectSave.releaseAll();
+                        dm::allocFreeStack(m_threadParams.m_projectSave.m_stackAlloc);
+
+                        const char* msg = "cmftStudio project could not be saved at this time. Wait for background jobs to finish!";
+                        imguiStatusMessage(msg, 6.0f, true, "Close");
+                    }
                 }
                 else
                 {
-                    const char* msg = "cmftStudio project could not be saved at this time. Background thread is in use!";
+                    const char* msg = "cmftStudio project could not be saved at this time. Project saving or loading is in progress!";
                     imguiStatusMessage(msg, 6.0f, true, "Close");
                 }
             }
@@ -1893,10 +2216,6 @@ private:
             imguiRemoveStatusMessage(StatusWindowId::ProjectSave);
 
             // Cleanup.
-            if (m_backgroundThread.isRunning())
-            {
-                m_backgroundThread.shutdown();
-            }
             m_threadParams.m_projectSave.m_threadStatus = ThreadStatus::Idle;
             m_threadParams.m_projectSave.releaseAll();
             dm::allocFreeStack(m_threadParams.m_projectSave.m_stackAlloc);
@@ -1918,12 +2237,6 @@ private:
 
             // Update status message.
             imguiRemoveStatusMessage(StatusWindowId::ProjectLoad);
-
-            // Cleanup.
-            if (m_backgroundThread.isRunning())
-            {
-                m_backgroundThread.shutdown();
-            }
         }
     }
 
@@ -2024,14 +2337,14 @@ private:
     }
 
 public:
-    void run(int _argc, const char* const* _argv)
+    int32_t run(int _argc, const char* const* _argv)
     {
         // Action for --help.
         bx::CommandLine cmdLine(_argc, _argv);
         if (cmdLine.hasArg('h', "help"))
         {
             printCliHelp();
-            return;
+            return EXIT_SUCCESS;
         }
 
         configFromDefaultPaths(g_config);
@@ -2040,6 +2353,25 @@ public:
         dm::allocInit();
         cmft::setAllocator(dm::mainAlloc);
 
+        // Start job system workers.
+        cs::jobsInit();
+
+        // Get parameters from cli.
+        configFromCli(g_config, _argc, _argv);
+        filterCacheInit(g_config.m_filterCacheDir, g_config.m_filterCacheSize);
+
+        // Action for --batch. Runs headless, bgfx is never initialized.
+        if ('\0' != g_config.m_batchInputDir[0])
+        {
+            const int32_t result = batchRun(g_config);
+
+            cs::jobsShutdown();
+            clPoolShutdown();
+            cs::allocDestroy();
+
+            return result;
+        }
+
         const double splashScreenDuration = 1.5;
         const float modalWindowAnimDuration = 0.06f;
         float posUd    = 0.20f;
@@ -2053,9 +2385,6 @@ public:
         initStaticResources();
         m_threadParams.init();
 
-        // Get parameters from cli.
-        configFromCli(g_config, _argc, _argv);
-
         // Init bgfx.
         bgfx::init(g_config.m_renderer, BGFX_PCI_ID_NONE, 0, NULL, cs::bgfxAlloc);
 
@@ -2108,6 +2437,17 @@ public:
         int64_t timeSplash = timerCurrentTick();
         stateEnter(State::SplashScreen);
 
+        // Filter hardware settings, calibrated once per machine.
+        if (g_config.m_filterTuned)
+        {
+            m_widgets.m_cmftPmrem.m_numCpuThreads = float(g_config.m_filterCpuThreads);
+            m_widgets.m_cmftPmrem.m_useOpenCL     = g_config.m_filterUseOpenCL;
+        }
+        else
+        {
+            m_threadParams.m_filterTune.m_pending = true;
+        }
+
         // Init resource lists.
         initLists();
 
@@ -2124,20 +2464,10 @@ public:
             Assets::releaseResources();
         }
 
-        for (uint16_t ii = 0, end = m_textureList.count(); ii < end; ++ii)
-        {
-            const cs::TextureHandle handle = m_textureList[ii];
-            cs::createGpuBuffers(handle); // this has to be executed here on the main thread.
-        }
-        for (uint16_t ii = 0, end = m_meshInstList.count(); ii < end; ++ii)
-        {
-            cs::createGpuBuffers(m_meshInstList[ii].m_mesh); // this has to be executed here on the main thread.
-        }
-        for (uint16_t ii = 0, end = m_envList.count(); ii < end; ++ii)
-        {
-            const cs::EnvHandle handle = m_envList[ii];
-            cs::createGpuBuffers(handle); // this has to be executed here on the main thread.
-        }
+        // Gpu uploads are spread over the splash screen duration, see below.
+        cs::gpuUploadSetBudget(g_config.m_uploadBudget, double(g_config.m_uploadBudgetMs));
+        cs::residencySetBudget(g_config.m_hostBudget);
+        queueGpuUploads(m_textureList, m_meshInstList, m_envList);
 
         // Make sure there is at least one material.
         if (m_materialList.count() == 0)
@@ -2200,7 +2530,7 @@ public:
         dm::strscpya(m_widgets.m_cmftSaveIem   .m_directory, savePath);
         dm::strscpya(m_widgets.m_meshSave      .m_directory, savePath);
 
-        // Initialization is done, wait for splash screen to finish.
+        // Initialization is done, upload resources while waiting for splash screen to finish.
         for (;;)
         {
             const int64_t timeNow = timerCurrentTick();
@@ -2209,12 +2539,16 @@ public:
             {
                 break;
             }
-            else
+            else if (0 == cs::gpuUploadUpdate())
             {
                 bx::sleep(100);
             }
         }
 
+        // Everything has to be on the gpu before the first frame.
+        cs::gpuUploadFlush();
+        printGpuUploadStats("Startup");
+
         // Splash screen texture is not needed any more.
         cs::release(splashTex);
 
@@ -2354,33 +2688,20 @@ public:
             {
                 if (onStateEnter(State::SendResourcesToGpu))
                 {
-                    m_projTransition.m_texIdx = m_threadParams.m_projectLoad.m_textureList.count();
-                    m_projTransition.m_mshIdx = m_threadParams.m_projectLoad.m_meshInstList.count();
-                    m_projTransition.m_envIdx = m_threadParams.m_projectLoad.m_envList.count();
+                    queueGpuUploads(m_threadParams.m_projectLoad.m_textureList
+                                  , m_threadParams.m_projectLoad.m_meshInstList
+                                  , m_threadParams.m_projectLoad.m_envList
+                                  );
                 }
 
-                // Create gpu buffers, one pre frame.
-
-                if (m_projTransition.m_texIdx)
-                {
-                    m_projTransition.m_texIdx--;
-                    const cs::TextureHandle tex = m_threadParams.m_projectLoad.m_textureList[m_projTransition.m_texIdx];
-                    cs::createGpuBuffers(tex);
-                }
-                else if (m_projTransition.m_mshIdx)
-                {
-                    m_projTransition.m_mshIdx--;
-                    const cs::MeshInstance& inst = m_threadParams.m_projectLoad.m_meshInstList[m_projTransition.m_mshIdx];
-                    cs::createGpuBuffers(inst.m_mesh);
-                }
-                else if (m_projTransition.m_envIdx)
-                {
-                    m_projTransition.m_envIdx--;
-                    const cs::EnvHandle env = m_threadParams.m_projectLoad.m_envList[m_projTransition.m_envIdx];
-                    cs::createGpuBuffers(env);
-                }
-                else
+                // Create gpu buffers, within per frame budget.
+                if (0 == cs::gpuUploadUpdate())
                 {
+                    printGpuUploadStats("Project load");
+                    for (uint16_t ii = 0, end = m_threadParams.m_projectLoad.m_envList.count(); ii < end; ++ii)
+                    {
+                        printEnvGpuFormats(m_threadParams.m_projectLoad.m_envList[ii]);
+                    }
                     eventTrigger(Event::BeginLoadTransition);
                 }
             }
@@ -2493,6 +2814,14 @@ public:
             const cs::Environment::Enum envType = (cs::Environment::Enum)m_settings.m_backgroundType;
             m_environment.update(currentEnv, envType, m_settings.m_backgroundMipLevel, envUd);
 
+            // Stream skybox detail level matching the current fov.
+            const bool skyboxVisible = !m_environment.m_skybox.m_doTransition
+                                    && cs::Environment::Skybox == m_environment.m_skybox.m_currWhich;
+            cs::envUpdateSkyboxDetail(skyboxVisible ? m_environment.m_skybox.m_currEnv : cs::EnvHandle::invalid()
+                                    , m_settings.m_fov
+                                    , g_heightf
+                                    );
+
             if (m_environment.m_skybox.m_doTransition)
             {
 
@@ -2595,9 +2924,53 @@ public:
             // Render.
             renderPipelineFlush();
 
+            // Dispatch completion callbacks of finished background jobs.
+            cs::jobsUpdate();
+
+            // Create gpu textures of files decoded in the background.
+            textureUploadHandler();
+
             // Handle gui response that will take effect in the next frame.
             guiActionHandler();
 
+            // Selected environment is the one cmft widgets work on, keep its images in memory.
+            if (0 != m_envList.count())
+            {
+                cs::envPrefetch(m_envList[m_settings.m_selectedEnvMap]);
+            }
+
+            // Move cpu copies of resources that are on the gpu out of memory, background jobs read them directly.
+            if (ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus
+            &&  !backgroundJobsInProgress())
+            {
+                cs::residencyUpdate();
+            }
+
+            // Calibration is restarted later if other work starts meanwhile, it would skew the measurements.
+            if (ThreadStatus::Started == m_threadParams.m_filterTune.m_threadStatus
+            &&  (ThreadStatus::Idle != m_threadParams.m_projectLoad.m_threadStatus || backgroundJobsInProgress())
+            &&  !m_threadParams.m_filterTune.m_pending)
+            {
+                filterTuneCancel(m_threadParams.m_filterTune);
+                m_threadParams.m_filterTune.m_pending = true;
+            }
+
+            // Calibrate filter settings once startup is done, other work in progress would skew the measurements.
+            if (m_threadParams.m_filterTune.m_pending
+            &&  ThreadStatus::Idle == m_threadParams.m_filterTune.m_threadStatus
+            &&  onState(State::MainState)
+            &&  ThreadStatus::Idle == m_threadParams.m_projectLoad.m_threadStatus
+            &&  !backgroundJobsInProgress()
+            &&  0 == cs::gpuUploadStats().m_numPending)
+            {
+                m_threadParams.m_filterTune.m_cancel           = 0;
+                m_threadParams.m_filterTune.m_widgetCpuThreads = m_widgets.m_cmftPmrem.m_numCpuThreads;
+                m_threadParams.m_filterTune.m_widgetUseOpenCL  = m_widgets.m_cmftPmrem.m_useOpenCL;
+
+                // Stays pending when the job queue is full, it is retried on the next frame.
+                m_threadParams.m_filterTune.m_pending = !threadStart(filterTuneFunc, (void*)&m_threadParams.m_filterTune, m_threadParams.m_filterTune.m_threadStatus, cs::JobPriority::Low);
+            }
+
             // Run resource garbage collector.
             cs::resourceGC(1);
 
@@ -2605,7 +2978,10 @@ public:
             cs::allocGc();
         }
 
-        // Cleanup.
+        // Cleanup. Calibration takes minutes, it is stopped at its next measurement instead of being waited for.
+        filterTuneCancel(m_threadParams.m_filterTune);
+        cs::jobsShutdown();
+        clPoolShutdown();
         destroyLists();
         m_threadParams.destroy();
 
@@ -2623,6 +2999,8 @@ public:
 
         dm::allocPrintStats();
         cs::allocDestroy();
+
+        return EXIT_SUCCESS;
     }
 
 private:
@@ -2682,13 +3060,10 @@ private:
         cs::EnvHandle     m_currEnv;
         cs::MeshInstance* m_currInst;
 
-        uint16_t m_texIdx;
-        uint16_t m_mshIdx;
-        uint16_t m_envIdx;
     };
     ProjectTransition m_projTransition;
 
-    // Background thread.
+    // Background jobs.
     struct ThreadParams
     {
         void init()
@@ -2705,19 +3080,19 @@ private:
 
         ProjectSaveThreadParams m_projectSave;
         ProjectLoadThreadParams m_projectLoad;
-        CmftFilterThreadParams  m_cmftFilter;
+        CmftFilterThreadParams  m_cmftPmrem;
+        CmftFilterThreadParams  m_cmftIem;
         ModelLoadThreadParams   m_modelLoad;
+        TonemapThreadParams     m_tonemap;
+        FilterTuneThreadParams  m_filterTune;
     };
     ThreadParams m_threadParams;
-    bx::Thread m_backgroundThread;
 };
 static CmftStudioApp s_cmftStudio;
 
 int _main_(int _argc, char** _argv)
 {
-    s_cmftStudio.run(_argc, _argv);
-
-    return 0;
+    return s_cmftStudio.run(_argc, _argv);
 }
 
 /* vim: set sw=4 ts=4 expandtab: */
@@ -6,6 +6,8 @@
 #include "appconfig.h"
 
 #include <stdio.h>                   // fprintf
+#include <stdlib.h>                  // malloc, free
+#include <dm/misc.h>                 // dm::max
 #include "globals.h"                 // g_frameNum
 #include "tinystl.h"                 // cs::TinyStlAllocator
 #include <dm/datastructures/list.h>  // dm::ListT
@@ -242,6 +244,93 @@ namespace cs
     }
 } // namespace cs
 
+// Job allocator.
+//-----
+
+namespace cs
+{
+    struct JobAllocHeader
+    {
+        void*  m_base;
+        size_t m_size;
+        bool   m_crt;
+    };
+
+    JobAllocator::JobAllocator(bx::AllocatorI* _backing)
+    {
+        m_backing = _backing;
+        m_current = 0;
+        m_peak    = 0;
+    }
+
+    JobAllocator::~JobAllocator()
+    {
+    }
+
+    void* JobAllocator::alloc(size_t _size, size_t _align, const char* _file, uint32_t _line)
+    {
+        BX_UNUSED(_file, _line);
+
+        // Header is stored right in front of the returned pointer.
+        const size_t align = dm::max(_align, size_t(16));
+        const size_t total = _size + align + sizeof(JobAllocHeader);
+
+        bool crt = false;
+        void* base = DM_ALLOC(m_backing, total);
+        if (NULL == base)
+        {
+            base = ::malloc(total);
+            crt  = true;
+
+            if (NULL == base)
+            {
+                return NULL;
+            }
+        }
+
+        const uintptr_t addr = (uintptr_t(base) + sizeof(JobAllocHeader) + align-1) & ~uintptr_t(align-1);
+        JobAllocHeader* header = (JobAllocHeader*)addr - 1;
+        header->m_base = base;
+        header->m_size = _size;
+        header->m_crt  = crt;
+
+        {
+            bx::MutexScope lock(m_mutex);
+            m_current += _size;
+            m_peak = dm::max(m_peak, m_current);
+        }
+
+        return (void*)addr;
+    }
+
+    void JobAllocator::free(void* _ptr, size_t _align, const char* _file, uint32_t _line)
+    {
+        BX_UNUSED(_align, _file, _line);
+
+        if (NULL == _ptr)
+        {
+            return;
+        }
+
+        const JobAllocHeader* header = (const JobAllocHeader*)_ptr - 1;
+
+        {
+            bx::MutexScope lock(m_mutex);
+            m_current -= header->m_size;
+        }
+
+        if (header->m_crt)
+        {
+            ::free(header->m_base);
+        }
+        else
+        {
+            DM_FREE(m_backing, header->m_base);
+        }
+    }
+
+} // namespace cs
+
 // Alloc redirection.
 //-----
 
@@ -7,6 +7,7 @@
 #define CMFTSTUDIO_ALLOCATOR_H_HEADER_GUARD
 
 #include <dm/allocator/allocator.h>
+#include <bx/thread.h> // bx::Mutex
 
 namespace cs
 {
@@ -14,6 +15,28 @@ namespace cs
     extern bx::ReallocatorI* bgfxAlloc;   // Bgfx allocator.
     void allocGc();
     void allocDestroy();
+
+    /// Allocator context of a single job. Allocations are served from '_backing' and fall back to crt heap when backing
+    /// allocator runs out of memory. Current and peak usage are tracked, so memory of a job can be measured.
+    /// Thread safe. Memory allocated here has to be freed here, results leaving the job have to be copied out.
+    struct JobAllocator : public bx::AllocatorI
+    {
+        JobAllocator(bx::AllocatorI* _backing);
+        virtual ~JobAllocator();
+
+        virtual void* alloc(size_t _size, size_t _align, const char* _file, uint32_t _line) BX_OVERRIDE;
+        virtual void free(void* _ptr, size_t _align, const char* _file, uint32_t _line) BX_OVERRIDE;
+
+        size_t current() const { return m_current; }
+        size_t peak() const    { return m_peak;    }
+
+    private:
+        bx::AllocatorI* m_backing;
+        size_t m_current;
+        size_t m_peak;
+        bx::Mutex m_mutex;
+    };
+
 } //namespace cs
 
 #endif // CMFTSTUDIO_ALLOCATOR_H_HEADER_GUARD
@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h> // strcmp
 
 #include <bx/string.h>
 #include <bx/commandline.h>
@@ -40,17 +41,44 @@ void configWriteDefault(const char* _path)
         "#    WindowSize     = [width x height]                         # Window size at startup.\n"
         "#    Memory         = [1.0-7.0]GB                              # Recommended 2.0GB or more on a 64bit system.\n"
         "#    StartupProject = [\"path_to_csp_file\"]                     # *.csp - cmftStudio project file.\n"
+        "#    FilterCacheDir = [\"path_to_directory\"]                    # Filter results cache, default ~/.cmftStudio/cache.\n"
+        "#    FilterCacheSize = [0.0-64.0]GB                             # Filter results cache size, 0 disables the cache.\n"
+        "#    FilterCpuThreads = [0-255]                                 # Radiance filter cpu threads, written by calibration.\n"
+        "#    FilterOpenCL = [true,false]                                # Radiance filter OpenCL usage, written by calibration.\n"
+        "#                                                               # Remove both to calibrate again.\n"
+        "#    GpuUploadBudget = [0.1-1024.0]MB                           # Data uploaded to the GPU per frame while loading.\n"
+        "#    GpuUploadTime = [0.5-100.0]ms                              # Time spent uploading to the GPU per frame while loading.\n"
+        "#    CompressTextures = [true,false]                            # Block compress material textures picked from the browser.\n"
+        "#    MipFilter = [box,kaiser]                                   # Filter used to build mip chains of decoded textures.\n"
+        "#    HostBudget = [0.0-64.0]GB                                  # Cpu copies of uploaded textures and environments kept in memory,\n"
+        "#                                                               # the rest is moved to temporary files. 0 keeps everything.\n"
         "\n"
         "Renderer       = ogl\n"
         "WindowSize     = 1920x1027\n"
         "Memory         = 1.5GB\n"
         "StartupProject = \"SampleProject0.csp\"\n"
+        "FilterCacheSize = 1.0GB\n"
     };
 
     fwrite(sc_defaultConfig, BX_COUNTOF(sc_defaultConfig)-1, 1, file);
     fclose(file);
 }
 
+// Returns true when the value token starting at '_begin' is "true" or "1". Token ends at whitespace or '_end'.
+static bool configParseBool(const char* _begin, const char* _end)
+{
+    const char* end = _begin;
+    while (end < _end && ' ' != *end && '\t' != *end && '\r' != *end)
+    {
+        ++end;
+    }
+
+    const size_t len = end-_begin;
+    return (4 == len && NULL != bx::stristr(_begin, "true", len))
+        || (1 == len && '1' == _begin[0])
+        ;
+}
+
 void configFromFile(Config& _config, const char* _path)
 {
     FILE* file = fopen(_path, "r");
@@ -73,9 +101,16 @@ void configFromFile(Config& _config, const char* _path)
         CONFIG_STARTUPPROJECT_SET  = 0x08,
         CONFIG_DEFAULTLOADPATH_SET = 0x20,
         CONFIG_DEFAULTSAVEPATH_SET = 0x10,
+        CONFIG_FILTERCACHEDIR_SET  = 0x40,
+        CONFIG_FILTERCACHESIZE_SET = 0x80,
+        CONFIG_UPLOADBUDGET_SET    = 0x100,
+        CONFIG_UPLOADTIME_SET      = 0x200,
+        CONFIG_COMPRESSTEX_SET     = 0x400,
+        CONFIG_MIPFILTER_SET       = 0x800,
+        CONFIG_HOSTBUDGET_SET      = 0x1000,
     };
 
-    uint8_t parametersSet = 0;
+    uint16_t parametersSet = 0;
 
     const char* ptr = data;
     while ('\0' != *ptr)
@@ -86,6 +121,7 @@ void configFromFile(Config& _config, const char* _path)
         const char* comment = bx::stristr(str, "#", eol-str);
 
         const size_t toEnd = (NULL != comment) ? comment-str : eol-str;
+        const char* valueEnd = str+toEnd; // Values end where the comment begins.
 
 #if BX_PLATFORM_WINDOWS
         // Renderer.
@@ -241,6 +277,199 @@ void configFromFile(Config& _config, const char* _path)
             }
         }
 
+        // Filter cache directory.
+        const char* filterCacheDir = bx::stristr(str, "FilterCacheDir", toEnd);
+        if (NULL != filterCacheDir)
+        {
+            enum { FilterCacheDirLen = 14 }; // "FilterCacheDir"
+            const char* cursor = filterCacheDir+FilterCacheDirLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                if (begin[0] == '\"')
+                {
+                    ++begin;
+                }
+                const char* closingQuotes = bx::stristr(begin, "\"", eol-begin);
+                const char* endValue = (NULL != closingQuotes) ? closingQuotes : eol;
+                const size_t valueLen = endValue - begin;
+
+                if (valueLen < DM_PATH_LEN)
+                {
+                    memcpy(_config.m_filterCacheDir, begin, valueLen);
+                    _config.m_filterCacheDir[valueLen] = '\0';
+                    parametersSet |= CONFIG_FILTERCACHEDIR_SET;
+                }
+            }
+        }
+
+        // Filter cache size.
+        const char* filterCacheSize = bx::stristr(str, "FilterCacheSize", toEnd);
+        if (NULL != filterCacheSize)
+        {
+            enum { FilterCacheSizeLen = 15 }; // "FilterCacheSize"
+            const char* cursor = filterCacheSize+FilterCacheSizeLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                if (begin[0] == '\"')
+                {
+                    ++begin;
+                }
+
+                float sizeGB = 0.0f;
+                sscanf(begin, "%f", &sizeGB);
+
+                const uint64_t size = uint64_t(double(DM_CLAMP(sizeGB, 0.0f, 64.0f))*double(DM_GIGABYTES_ULL(1)));
+                _config.m_filterCacheSize = size;
+                parametersSet |= CONFIG_FILTERCACHESIZE_SET;
+            }
+        }
+
+        // Filter cpu threads.
+        const char* filterCpuThreads = bx::stristr(str, "FilterCpuThreads", toEnd);
+        if (NULL != filterCpuThreads)
+        {
+            enum { FilterCpuThreadsLen = 16 }; // "FilterCpuThreads"
+            const char* cursor = filterCpuThreads+FilterCpuThreadsLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+
+                int32_t numThreads = 0;
+                sscanf(begin, "%d", &numThreads);
+
+                _config.m_filterCpuThreads = uint8_t(DM_CLAMP(numThreads, 0, 255));
+                _config.m_filterTuned = true;
+            }
+        }
+
+        // Filter OpenCL.
+        const char* filterOpenCL = bx::stristr(str, "FilterOpenCL", toEnd);
+        if (NULL != filterOpenCL)
+        {
+            enum { FilterOpenCLLen = 12 }; // "FilterOpenCL"
+            const char* cursor = filterOpenCL+FilterOpenCLLen;
+
+            const char* equals = bx::stristr(cursor, "=", valueEnd-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                _config.m_filterUseOpenCL = configParseBool(begin, valueEnd);
+            }
+        }
+
+        // Gpu upload budget.
+        const char* uploadBudget = bx::stristr(str, "GpuUploadBudget", toEnd);
+        if (NULL != uploadBudget)
+        {
+            enum { GpuUploadBudgetLen = 15 }; // "GpuUploadBudget"
+            const char* cursor = uploadBudget+GpuUploadBudgetLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+
+                float sizeMB = 0.0f;
+                sscanf(begin, "%f", &sizeMB);
+
+                _config.m_uploadBudget = uint32_t(DM_CLAMP(sizeMB, 0.1f, 1024.0f)*float(DM_MEGABYTES(1)));
+                parametersSet |= CONFIG_UPLOADBUDGET_SET;
+            }
+        }
+
+        // Gpu upload time.
+        const char* uploadTime = bx::stristr(str, "GpuUploadTime", toEnd);
+        if (NULL != uploadTime)
+        {
+            enum { GpuUploadTimeLen = 13 }; // "GpuUploadTime"
+            const char* cursor = uploadTime+GpuUploadTimeLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+
+                float timeMs = 0.0f;
+                sscanf(begin, "%f", &timeMs);
+
+                _config.m_uploadBudgetMs = DM_CLAMP(timeMs, 0.5f, 100.0f);
+                parametersSet |= CONFIG_UPLOADTIME_SET;
+            }
+        }
+
+        // Compress textures.
+        const char* compressTextures = bx::stristr(str, "CompressTextures", toEnd);
+        if (NULL != compressTextures)
+        {
+            enum { CompressTexturesLen = 16 }; // "CompressTextures"
+            const char* cursor = compressTextures+CompressTexturesLen;
+
+            const char* equals = bx::stristr(cursor, "=", valueEnd-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                _config.m_compressTextures = configParseBool(begin, valueEnd);
+                parametersSet |= CONFIG_COMPRESSTEX_SET;
+            }
+        }
+
+        // Mip filter.
+        const char* mipFilter = bx::stristr(str, "MipFilter", toEnd);
+        if (NULL != mipFilter)
+        {
+            enum { MipFilterLen = 9 }; // "MipFilter"
+            const char* cursor = mipFilter+MipFilterLen;
+
+            const char* equals = bx::stristr(cursor, "=", valueEnd-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                const size_t len = (begin < valueEnd) ? valueEnd-begin : 0;
+                if (NULL != bx::stristr(begin, "box", len))
+                {
+                    _config.m_mipFilter = cs::MipFilter::Box;
+                    parametersSet |= CONFIG_MIPFILTER_SET;
+                }
+                else if (NULL != bx::stristr(begin, "kaiser", len))
+                {
+                    _config.m_mipFilter = cs::MipFilter::Kaiser;
+                    parametersSet |= CONFIG_MIPFILTER_SET;
+                }
+            }
+        }
+
+        // Host budget.
+        const char* hostBudget = bx::stristr(str, "HostBudget", toEnd);
+        if (NULL != hostBudget)
+        {
+            enum { HostBudgetLen = 10 }; // "HostBudget"
+            const char* cursor = hostBudget+HostBudgetLen;
+
+            const char* equals = bx::stristr(cursor, "=", eol-cursor);
+            if (NULL != equals)
+            {
+                const char* begin = bx::strws(equals+1);
+                if (begin[0] == '\"')
+                {
+                    ++begin;
+                }
+
+                float sizeGB = 0.0f;
+                sscanf(begin, "%f", &sizeGB);
+
+                _config.m_hostBudget = uint64_t(double(DM_CLAMP(sizeGB, 0.0f, 64.0f))*double(DM_GIGABYTES_ULL(1)));
+                parametersSet |= CONFIG_HOSTBUDGET_SET;
+            }
+        }
+
         // Memory.
         const char* memoryParam  = bx::stristr(str, "Memory", toEnd);
         if (NULL != memoryParam)
@@ -305,6 +534,37 @@ void configFromFile(Config& _config, const char* _path)
         _config.m_defaultSavePath[1] = '\0';
     }
 
+    if (0 == (parametersSet&CONFIG_FILTERCACHEDIR_SET))
+    {
+        _config.m_filterCacheDir[0] = '\0';
+    }
+    if (0 == (parametersSet&CONFIG_FILTERCACHESIZE_SET))
+    {
+        _config.m_filterCacheSize = DM_GIGABYTES_ULL(1);
+    }
+    if (0 == (parametersSet&CONFIG_UPLOADBUDGET_SET))
+    {
+        _config.m_uploadBudget = DM_MEGABYTES(16);
+    }
+    if (0 == (parametersSet&CONFIG_UPLOADTIME_SET))
+    {
+        _config.m_uploadBudgetMs = 4.0f;
+    }
+    if (0 == (parametersSet&CONFIG_COMPRESSTEX_SET))
+    {
+        _config.m_compressTextures = false;
+    }
+    if (0 == (parametersSet&CONFIG_MIPFILTER_SET))
+    {
+        _config.m_mipFilter = cs::MipFilter::Kaiser;
+    }
+    if (0 == (parametersSet&CONFIG_HOSTBUDGET_SET))
+    {
+        _config.m_hostBudget = DM_MEGABYTES(512);
+    }
+
+    // Notice: filter calibration values are not reset, they describe the machine and are stored only in the user config.
+
     _config.m_loaded = true;
 
     free(data);
@@ -346,6 +606,103 @@ void configFromDefaultPaths(Config& _config)
     configFromFile(_config, "cmftStudio.conf");
 }
 
+static void configUserPath(char _path[DM_PATH_LEN])
+{
+    dm::homeDir(_path);
+    bx::strlcat(_path, "/.cmftStudio.conf", DM_PATH_LEN);
+}
+
+// Replaces value of '_name' in config file at '_path', or appends it if it is not there.
+static void configFileSetValue(const char* _path, const char* _name, const char* _value)
+{
+    char* data = NULL;
+    uint32_t size = 0;
+
+    FILE* file = fopen(_path, "rb");
+    if (NULL != file)
+    {
+        size = (uint32_t)dm::fsize(file);
+        data = (char*)malloc(size+1);
+        size = (uint32_t)fread(data, 1, size, file);
+        data[size] = '\0';
+        fclose(file);
+    }
+
+    file = fopen(_path, "wb");
+    if (NULL == file)
+    {
+        free(data);
+        return;
+    }
+
+    const size_t nameLen = strlen(_name);
+
+    bool written = false;
+    const char* ptr = (NULL != data) ? data : "";
+    while ('\0' != *ptr)
+    {
+        const char* str = bx::strws(ptr);
+        const char* eol = bx::streol(str);
+        const char* nl  = bx::strnl(eol);
+
+        // Matching line is replaced, comments are kept.
+        if (!written
+        &&  size_t(eol-str) >= nameLen
+        &&  NULL != bx::stristr(str, _name, nameLen))
+        {
+            fprintf(file, "%s = %s\n", _name, _value);
+            written = true;
+        }
+        else
+        {
+            fwrite(ptr, nl-ptr, 1, file);
+        }
+
+        ptr = nl;
+    }
+
+    if (!written)
+    {
+        if (0 != size && '\n' != data[size-1])
+        {
+            fputc('\n', file);
+        }
+        fprintf(file, "%s = %s\n", _name, _value);
+    }
+
+    fclose(file);
+    free(data);
+}
+
+void configSaveFilterTuning(const Config& _config)
+{
+    char path[DM_PATH_LEN];
+    configUserPath(path);
+
+    char numThreads[8];
+    bx::snprintf(numThreads, sizeof(numThreads), "%u", uint32_t(_config.m_filterCpuThreads));
+
+    configFileSetValue(path, "FilterCpuThreads", numThreads);
+    configFileSetValue(path, "FilterOpenCL", _config.m_filterUseOpenCL ? "true" : "false");
+}
+
+static void cliFindInt(const bx::CommandLine& _cmdLine, const char* _option, int32_t _min, int32_t _max, uint32_t& _value)
+{
+    const char* str = _cmdLine.findOption(_option);
+    if (NULL != str)
+    {
+        int32_t value = 0;
+        sscanf(str, "%d", &value);
+        _value = uint32_t(DM_CLAMP(value, _min, _max));
+    }
+}
+
+static void cliFindInt(const bx::CommandLine& _cmdLine, const char* _option, int32_t _min, int32_t _max, uint8_t& _value)
+{
+    uint32_t value = _value;
+    cliFindInt(_cmdLine, _option, _min, _max, value);
+    _value = uint8_t(value);
+}
 
 void configFromCli(Config& _config, int _argc, const char* const* _argv)
 {
@@ -378,6 +735,84 @@ void configFromCli(Config& _config, int _argc, const char* const* _argv)
     {
         dm::strscpya(_config.m_startupProject, project);
     }
+
+    // Notice: bx::CommandLine returns only the first parameter of an option, '--batch' takes two.
+    for (int ii = 1; ii < _argc-2; ++ii)
+    {
+        if (0 == strcmp(_argv[ii], "--batch"))
+        {
+            dm::strscpya(_config.m_batchInputDir,  _argv[ii+1]);
+            dm::strscpya(_config.m_batchOutputDir, _argv[ii+2]);
+            break;
+        }
+    }
+
+    // Ranges match cmft widgets in the gui.
+    cliFindInt(cmdLine, "batch-jobs",        0,  255, _config.m_batchNumFiles);
+    cliFindInt(cmdLine, "batch-src-size",    0, 4096, _config.m_batchSrcSize);
+    cliFindInt(cmdLine, "batch-dst-size",   32, 1024, _config.m_batchDstSize);
+    cliFindInt(cmdLine, "batch-mip-count",   1,   11, _config.m_batchMipCount);
+    cliFindInt(cmdLine, "batch-gloss-scale", 1,   12, _config.m_batchGlossScale);
+    cliFindInt(cmdLine, "batch-gloss-bias",  0,    6, _config.m_batchGlossBias);
+
+    const char* lighting = cmdLine.findOption("batch-lighting");
+    if (NULL != lighting)
+    {
+        static const char* sc_lightingModels[] = { "phong", "phongbrdf", "blinn", "blinnbrdf" };
+
+        uint8_t ii = 0;
+        for ( ; ii < BX_COUNTOF(sc_lightingModels); ++ii)
+        {
+            if (0 == bx::stricmp(lighting, sc_lightingModels[ii]))
+            {
+                _config.m_batchLightingModel = cmft::LightingModel::Enum(ii);
+                break;
+            }
+        }
+
+        if (BX_COUNTOF(sc_lightingModels) == ii)
+        {
+            fprintf(stderr, "Unknown lighting model '%s', using default.\n", lighting);
+        }
+    }
+
+    const char* fileType = cmdLine.findOption("batch-file-type");
+    if (NULL != fileType)
+    {
+        uint8_t ii = 0;
+        for ( ; ii < cmft::ImageFileType::Count; ++ii)
+        {
+            if (0 == bx::stricmp(fileType, cmft::getFilenameExtensionStr(cmft::ImageFileType::Enum(ii))))
+            {
+                _config.m_batchFileType = cmft::ImageFileType::Enum(ii);
+                break;
+            }
+        }
+
+        if (cmft::ImageFileType::Count == ii)
+        {
+            fprintf(stderr, "Unknown file type '%s', using default.\n", fileType);
+        }
+    }
+
+    const char* format = cmdLine.findOption("batch-format");
+    if (NULL != format)
+    {
+        uint8_t ii = 0;
+        for ( ; ii < cmft::TextureFormat::Count; ++ii)
+        {
+            if (0 == bx::stricmp(format, cmft::getTextureFormatStr(cmft::TextureFormat::Enum(ii))))
+            {
+                _config.m_batchFormat = cmft::TextureFormat::Enum(ii);
+                break;
+            }
+        }
+
+        if (cmft::TextureFormat::Count == ii)
+        {
+            fprintf(stderr, "Unknown texture format '%s', using default.\n", format);
+        }
+    }
 }
 
 void printCliHelp()
@@ -390,6 +825,7 @@ void printCliHelp()
 
     fprintf(stderr
         , "Usage: cmftstudio -r <renderer>\n"
+          "       cmftstudio --batch <in_dir> <out_dir>\n"
           "\n"
           "Options:\n"
           "  -r [--renderer] <renderer> Select renderer backend.\n"
@@ -397,9 +833,27 @@ void printCliHelp()
           "      dx11 [directx11]\n"
           "      ogl  [opengl]\n"
           "  -p [--project] \"<path_to_csp_file>\" Specify startup project.\n"
+          "  --batch \"<in_dir>\" \"<out_dir>\" Headless mode. Filter all environment maps from <in_dir>\n"
+          "      and save radiance and irradiance cubemaps to <out_dir>. No window or renderer is used.\n"
+          "  --batch-jobs <num> Number of files processed concurrently in batch mode (default: auto).\n"
+          "  --batch-src-size <num> Radiance filter input face size, 0 keeps the input size (default: 256).\n"
+          "  --batch-dst-size <num> Radiance output face size [32-1024] (default: 256).\n"
+          "  --batch-mip-count <num> Number of radiance mip levels to filter (default: 7).\n"
+          "  --batch-gloss-scale <num> Gloss scale [1-12] (default: 10).\n"
+          "  --batch-gloss-bias <num> Gloss bias [0-6] (default: 3).\n"
+          "  --batch-lighting <model> Lighting model (default: blinnbrdf).\n"
+          "      phong\n"
+          "      phongbrdf\n"
+          "      blinn\n"
+          "      blinnbrdf\n"
+          "  --batch-file-type <type> Output file type [dds,ktx,tga,hdr] (default: dds).\n"
+          "  --batch-format <format> Output texture format, must be valid for the file type (default: rgba16f).\n"
+          "      e.g. bgra8, rgba16, rgba16f, rgba32f, rgbe\n"
           "\n"
           "Example usage:\n"
           "    cmftstudio -r dx9 -p \"MyProject.csp\"\n"
+          "    cmftstudio --batch \"skyboxes\" \"ibl\" --batch-jobs 4\n"
+          "    cmftstudio --batch \"skyboxes\" \"ibl\" --batch-dst-size 512 --batch-mip-count 9 --batch-file-type ktx\n"
           "\n"
           "For additional information, see https://github.com/dariomanesku/cmftstudio\n"
         );
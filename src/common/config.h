@@ -8,6 +8,8 @@
 
 #include <bgfx/bgfx.h>    // bgfx::RendererType
 #include <dm/misc.h> // DM_GIGABYTES, DM_PATH_LEN
+#include "mipmap.h"  // cs::MipFilter
+#include "cmft.h"    // cmft::LightingModel, cmft::ImageFileType, cmft::TextureFormat
 
 struct Config
 {
@@ -25,6 +27,27 @@ struct Config
         m_startupProject[0]  = '\0';
         m_defaultLoadPath[0] = '\0';
         m_defaultSavePath[0] = '\0';
+        m_batchInputDir[0]   = '\0';
+        m_batchOutputDir[0]  = '\0';
+        m_batchNumFiles      = 0;
+        m_batchSrcSize       = 256;
+        m_batchDstSize       = 256;
+        m_batchMipCount      = 7;
+        m_batchGlossScale    = 10;
+        m_batchGlossBias     = 3;
+        m_batchLightingModel = cmft::LightingModel::BlinnBrdf;
+        m_batchFileType      = cmft::ImageFileType::DDS;
+        m_batchFormat        = cmft::TextureFormat::RGBA16F;
+        m_filterCacheDir[0]  = '\0';
+        m_filterCacheSize    = DM_GIGABYTES_ULL(1);
+        m_filterTuned        = false;
+        m_filterCpuThreads   = 4;
+        m_filterUseOpenCL    = true;
+        m_uploadBudget       = DM_MEGABYTES(16);
+        m_uploadBudgetMs     = 4.0f;
+        m_compressTextures   = false;
+        m_mipFilter          = cs::MipFilter::Kaiser;
+        m_hostBudget         = DM_MEGABYTES(512);
     }
 
     uint64_t m_memorySize;
@@ -35,12 +58,34 @@ struct Config
     char m_startupProject[DM_PATH_LEN];
     char m_defaultLoadPath[DM_PATH_LEN];
     char m_defaultSavePath[DM_PATH_LEN];
+    char m_batchInputDir[DM_PATH_LEN];
+    char m_batchOutputDir[DM_PATH_LEN];
+    uint8_t m_batchNumFiles; // Files processed concurrently in batch mode, 0 for auto.
+    uint32_t m_batchSrcSize; // Radiance filter input face size in batch mode, 0 keeps the input size.
+    uint32_t m_batchDstSize; // Radiance output face size in batch mode.
+    uint8_t m_batchMipCount;
+    uint8_t m_batchGlossScale;
+    uint8_t m_batchGlossBias;
+    cmft::LightingModel::Enum m_batchLightingModel;
+    cmft::ImageFileType::Enum m_batchFileType;
+    cmft::TextureFormat::Enum m_batchFormat;
+    char m_filterCacheDir[DM_PATH_LEN]; // Empty for default location.
+    uint64_t m_filterCacheSize;         // Zero disables the cache.
+    bool m_filterTuned;                 // Set when filter hardware settings below come from calibration.
+    uint8_t m_filterCpuThreads;
+    bool m_filterUseOpenCL;
+    uint32_t m_uploadBudget;            // Bytes uploaded to the GPU per frame while loading.
+    float m_uploadBudgetMs;             // Time spent uploading to the GPU per frame while loading.
+    bool m_compressTextures;            // Block compress material textures picked from the texture browser.
+    cs::MipFilter::Enum m_mipFilter;    // Filter used to build mip chains of decoded textures.
+    uint64_t m_hostBudget;              // Cpu copies of uploaded resources kept in memory, zero keeps everything.
 };
 
 void configWriteDefault(const char* _path);
 void configFromFile(Config& _config, const char* _path);
 void configFromDefaultPaths(Config& _config);
 void configFromCli(Config& _config, int _argc, const char* const* _argv);
+void configSaveFilterTuning(const Config& _config); // Writes filter calibration result to the user config file.
 void printCliHelp();
 
 extern Config g_config;
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_HASH_H_HEADER_GUARD
+#define CMFTSTUDIO_HASH_H_HEADER_GUARD
+
+#include <stdint.h>
+#include <stddef.h> // size_t
+#include <string.h> // memcpy
+
+namespace cs
+{
+    /// 64bit MurmurHash64A, by Austin Appleby (public domain). Processes input 8 bytes at a time.
+    /// Continue hashing more data by passing previous result as '_seed'.
+    static inline uint64_t hash64(const void* _data, size_t _size, uint64_t _seed = 0)
+    {
+        const uint64_t mm = 0xc6a4a7935bd1e995ULL;
+        const int      rr = 47;
+
+        uint64_t hh = _seed ^ (uint64_t(_size)*mm);
+
+        const uint8_t* ptr = (const uint8_t*)_data;
+        const uint8_t* end = ptr + (_size & ~size_t(7));
+        for (; ptr != end; ptr += 8)
+        {
+            uint64_t kk;
+            memcpy(&kk, ptr, 8);
+
+            kk *= mm;
+            kk ^= kk >> rr;
+            kk *= mm;
+
+            hh ^= kk;
+            hh *= mm;
+        }
+
+        switch (_size & 7)
+        {
+        case 7: hh ^= uint64_t(ptr[6]) << 48;
+        case 6: hh ^= uint64_t(ptr[5]) << 40;
+        case 5: hh ^= uint64_t(ptr[4]) << 32;
+        case 4: hh ^= uint64_t(ptr[3]) << 24;
+        case 3: hh ^= uint64_t(ptr[2]) << 16;
+        case 2: hh ^= uint64_t(ptr[1]) << 8;
+        case 1: hh ^= uint64_t(ptr[0]);
+                hh *= mm;
+        };
+
+        hh ^= hh >> rr;
+        hh *= mm;
+        hh ^= hh >> rr;
+
+        return hh;
+    }
+
+    /// Hashes memory of a plain value, continuing from '_seed'.
+    template <typename Ty>
+    static inline uint64_t hash64Value(const Ty& _value, uint64_t _seed)
+    {
+        return hash64(&_value, sizeof(Ty), _seed);
+    }
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_HASH_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
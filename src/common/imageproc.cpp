@@ -0,0 +1,1262 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common.h"
+#include "imageproc.h"
+
+#include <math.h>          // ldexpf, frexpf, atan2f, sqrtf, floorf
+#include <string.h>        // memset, memcpy
+#include <bx/uint32_t.h>   // bx::halfToFloat, bx::halfFromFloat
+#include <dm/misc.h>       // dm::min, dm::max
+#include <dm/pi.h>         // dm::pi
+
+#include "cmft.h"
+#include "jobs.h"          // cs::jobParallelFor
+#include "simd.h"
+#include "utils.h"         // latLongFromVec()
+
+namespace cs
+{
+    // Texel decode.
+    //-----
+
+    struct DecodeRgba32f
+    {
+        enum { BytesPerPixel = 16 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            return simdLoad((const float*)_ptr);
+        }
+    };
+
+    struct DecodeRgba16f
+    {
+        enum { BytesPerPixel = 8 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            const uint16_t* hh = (const uint16_t*)_ptr;
+            return simdSet(bx::halfToFloat(hh[0]), bx::halfToFloat(hh[1]), bx::halfToFloat(hh[2]), bx::halfToFloat(hh[3]));
+        }
+    };
+
+    struct DecodeRgbe
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            if (0 == _ptr[3])
+            {
+                return simdSet(0.0f, 0.0f, 0.0f, 1.0f);
+            }
+
+            const float exp = ldexpf(1.0f, int32_t(_ptr[3]) - (128+8));
+            return simdSet(float(_ptr[0])*exp, float(_ptr[1])*exp, float(_ptr[2])*exp, 1.0f);
+        }
+    };
+
+    struct DecodeRgb9e5
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            uint32_t packed;
+            memcpy(&packed, _ptr, 4);
+
+            const float exp = ldexpf(1.0f, int32_t(packed>>27) - (15+9));
+            return simdSet(float(packed&0x1ff)*exp, float((packed>>9)&0x1ff)*exp, float((packed>>18)&0x1ff)*exp, 1.0f);
+        }
+    };
+
+    struct DecodeRgba8
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            return simdMul(simdSet(float(_ptr[0]), float(_ptr[1]), float(_ptr[2]), float(_ptr[3])), simdSplat(1.0f/255.0f));
+        }
+    };
+
+    struct DecodeBgra8
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline Simd4f decode(const uint8_t* _ptr)
+        {
+            return simdMul(simdSet(float(_ptr[2]), float(_ptr[1]), float(_ptr[0]), float(_ptr[3])), simdSplat(1.0f/255.0f));
+        }
+    };
+
+    // Texel encode.
+    //-----
+
+    struct EncodeRgba32f
+    {
+        enum { BytesPerPixel = 16 };
+
+        static inline void encode(uint8_t* _ptr, Simd4f _color)
+        {
+            simdStore((float*)_ptr, _color);
+        }
+    };
+
+    struct EncodeRgba16f
+    {
+        enum { BytesPerPixel = 8 };
+
+        static inline void encode(uint8_t* _ptr, Simd4f _color)
+        {
+            float color[4];
+            simdStore(color, _color);
+
+            uint16_t* hh = (uint16_t*)_ptr;
+            hh[0] = bx::halfFromFloat(color[0]);
+            hh[1] = bx::halfFromFloat(color[1]);
+            hh[2] = bx::halfFromFloat(color[2]);
+            hh[3] = bx::halfFromFloat(color[3]);
+        }
+    };
+
+    static inline void encodeUnorm8(float _color[4], Simd4f _value)
+    {
+        const Simd4f clamped = simdMin(simdMax(_value, simdZero()), simdSplat(1.0f));
+        simdStore(_color, simdMadd(clamped, simdSplat(255.0f), simdSplat(0.5f)));
+    }
+
+    struct EncodeRgba8
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline void encode(uint8_t* _ptr, Simd4f _color)
+        {
+            float color[4];
+            encodeUnorm8(color, _color);
+
+            _ptr[0] = uint8_t(color[0]);
+            _ptr[1] = uint8_t(color[1]);
+            _ptr[2] = uint8_t(color[2]);
+            _ptr[3] = uint8_t(color[3]);
+        }
+    };
+
+    struct EncodeBgra8
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline void encode(uint8_t* _ptr, Simd4f _color)
+        {
+            float color[4];
+            encodeUnorm8(color, _color);
+
+            _ptr[0] = uint8_t(color[2]);
+            _ptr[1] = uint8_t(color[1]);
+            _ptr[2] = uint8_t(color[0]);
+            _ptr[3] = uint8_t(color[3]);
+        }
+    };
+
+    // Shared exponent, same as EXT_texture_shared_exponent. Negative values are clamped to zero, alpha is dropped.
+    struct EncodeRgb9e5
+    {
+        enum { BytesPerPixel = 4 };
+
+        static inline void encode(uint8_t* _ptr, Simd4f _color)
+        {
+            float color[4];
+            simdStore(color, simdMin(simdMax(_color, simdZero()), simdSplat(65408.0f)));
+
+            const float maxc = dm::max(color[0], dm::max(color[1], color[2]));
+
+            uint32_t packed = 0;
+            if (0.0f < maxc)
+            {
+                // maxc = f*2^exp, f in [0.5, 1).
+                int32_t exp;
+                frexpf(maxc, &exp);
+
+                int32_t shared = dm::max(exp + 15, int32_t(0));
+                float denom = ldexpf(1.0f, shared - (15+9));
+                if (512.0f <= floorf(maxc/denom + 0.5f))
+                {
+                    denom *= 2.0f;
+                    shared++;
+                }
+
+                const uint32_t rr = uint32_t(floorf(color[0]/denom + 0.5f));
+                const uint32_t gg = uint32_t(floorf(color[1]/denom + 0.5f));
+                const uint32_t bb = uint32_t(floorf(color[2]/denom + 0.5f));
+                packed = rr | (gg<<9) | (bb<<18) | (uint32_t(shared)<<27);
+            }
+
+            memcpy(_ptr, &packed, 4);
+        }
+    };
+
+    // Cubemap pre-pass.
+    //-----
+
+    struct PrepassData
+    {
+        const uint8_t* m_src;
+        uint32_t m_srcFaceOffset[6];
+        uint32_t m_srcSize;
+        float*   m_dst; // RGBA32F faces, starting with 'm_face'.
+        uint32_t m_dstSize;
+        float    m_gamma;
+        uint8_t  m_face;
+    };
+
+    template <typename DecodeT>
+    static void prepassRows(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const PrepassData& data = *(const PrepassData*)_userData;
+
+        const uint32_t srcSize  = data.m_srcSize;
+        const uint32_t dstSize  = data.m_dstSize;
+        const uint32_t srcPitch = srcSize*DecodeT::BytesPerPixel;
+        const bool     gamma    = (1.0f != data.m_gamma);
+        const Simd4f   gammaVec = simdSplat(data.m_gamma);
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint32_t face = data.m_face + row/dstSize;
+            const uint32_t yy   = row%dstSize;
+
+            const uint8_t* srcFace = data.m_src + data.m_srcFaceOffset[face];
+            float* dst = data.m_dst + size_t(row)*dstSize*4;
+
+            if (srcSize > dstSize)
+            {
+                // Downsample, box filter over the texel footprint.
+                const uint32_t y0 = yy*srcSize/dstSize;
+                const uint32_t y1 = dm::max((yy+1)*srcSize/dstSize, y0+1);
+
+                for (uint32_t xx = 0; xx < dstSize; ++xx)
+                {
+                    const uint32_t x0 = xx*srcSize/dstSize;
+                    const uint32_t x1 = dm::max((xx+1)*srcSize/dstSize, x0+1);
+
+                    Simd4f sum = simdZero();
+                    for (uint32_t sy = y0; sy < y1; ++sy)
+                    {
+                        const uint8_t* srcRow = srcFace + sy*srcPitch;
+                        for (uint32_t sx = x0; sx < x1; ++sx)
+                        {
+                            sum = simdAdd(sum, DecodeT::decode(srcRow + sx*DecodeT::BytesPerPixel));
+                        }
+                    }
+
+                    Simd4f color = simdMul(sum, simdSplat(1.0f/float((y1-y0)*(x1-x0))));
+                    if (gamma)
+                    {
+                        color = simdSelectRgb(simdPow(color, gammaVec), color);
+                    }
+                    simdStore(&dst[xx*4], color);
+                }
+            }
+            else
+            {
+                // Upsample or copy, bilinear filter clamped to face edges.
+                const float scale = float(srcSize)/float(dstSize);
+                const float max   = float(srcSize-1);
+
+                const float    fy = DM_CLAMP((float(yy)+0.5f)*scale - 0.5f, 0.0f, max);
+                const uint32_t y0 = uint32_t(fy);
+                const uint32_t y1 = dm::min(y0+1, srcSize-1);
+                const Simd4f   ty = simdSplat(fy - float(y0));
+
+                const uint8_t* row0 = srcFace + y0*srcPitch;
+                const uint8_t* row1 = srcFace + y1*srcPitch;
+
+                for (uint32_t xx = 0; xx < dstSize; ++xx)
+                {
+                    const float    fx = DM_CLAMP((float(xx)+0.5f)*scale - 0.5f, 0.0f, max);
+                    const uint32_t x0 = uint32_t(fx);
+                    const uint32_t x1 = dm::min(x0+1, srcSize-1);
+                    const Simd4f   tx = simdSplat(fx - float(x0));
+
+                    const Simd4f c00 = DecodeT::decode(row0 + x0*DecodeT::BytesPerPixel);
+                    const Simd4f c01 = DecodeT::decode(row0 + x1*DecodeT::BytesPerPixel);
+                    const Simd4f c10 = DecodeT::decode(row1 + x0*DecodeT::BytesPerPixel);
+                    const Simd4f c11 = DecodeT::decode(row1 + x1*DecodeT::BytesPerPixel);
+
+                    const Simd4f top    = simdMadd(simdSub(c01, c00), tx, c00);
+                    const Simd4f bottom = simdMadd(simdSub(c11, c10), tx, c10);
+
+                    Simd4f color = simdMadd(simdSub(bottom, top), ty, top);
+                    if (gamma)
+                    {
+                        color = simdSelectRgb(simdPow(color, gammaVec), color);
+                    }
+                    simdStore(&dst[xx*4], color);
+                }
+            }
+        }
+    }
+
+    static uint32_t faceDataSize(uint32_t _faceSize, uint8_t _numMips, uint32_t _bytesPerPixel)
+    {
+        uint32_t size = 0;
+        for (uint8_t mip = 0; mip < _numMips; ++mip)
+        {
+            const uint32_t mipSize = dm::max(_faceSize>>mip, uint32_t(1));
+            size += mipSize*mipSize*_bytesPerPixel;
+        }
+
+        return size;
+    }
+
+    void imageCubemapPrepass(cmft::Image& _dst, const cmft::Image& _src, uint32_t _faceSize, float _gamma, bx::AllocatorI* _allocator)
+    {
+        CS_CHECK(6 == _src.m_numFaces, "Cubemap image expected!");
+
+        JobRangeFn fn;
+        uint32_t bytesPerPixel;
+        switch (_src.m_format)
+        {
+        case cmft::TextureFormat::RGBA32F: fn = prepassRows<DecodeRgba32f>; bytesPerPixel = DecodeRgba32f::BytesPerPixel; break;
+        case cmft::TextureFormat::RGBA16F: fn = prepassRows<DecodeRgba16f>; bytesPerPixel = DecodeRgba16f::BytesPerPixel; break;
+        case cmft::TextureFormat::RGBE:    fn = prepassRows<DecodeRgbe>;    bytesPerPixel = DecodeRgbe::BytesPerPixel;    break;
+        case cmft::TextureFormat::RGBA8:   fn = prepassRows<DecodeRgba8>;   bytesPerPixel = DecodeRgba8::BytesPerPixel;   break;
+        case cmft::TextureFormat::BGRA8:   fn = prepassRows<DecodeBgra8>;   bytesPerPixel = DecodeBgra8::BytesPerPixel;   break;
+        default:
+            {
+                // No fast decode path, let cmft do the conversion.
+                cmft::Image rgba32f;
+                cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src, _allocator);
+                imageCubemapPrepass(_dst, rgba32f, _faceSize, _gamma, _allocator);
+                cmft::imageUnload(rgba32f, _allocator);
+            }
+            return;
+        }
+
+        cmft::imageCreate(_dst, _faceSize, _faceSize, 0x0, 1, 6, cmft::TextureFormat::RGBA32F, _allocator);
+
+        PrepassData data;
+        data.m_src     = (const uint8_t*)_src.m_data;
+        data.m_srcSize = _src.m_width;
+        data.m_dst     = (float*)_dst.m_data;
+        data.m_dstSize = _faceSize;
+        data.m_gamma   = _gamma;
+        data.m_face    = 0;
+
+        const uint32_t srcFaceSize = faceDataSize(_src.m_width, _src.m_numMips, bytesPerPixel);
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            data.m_srcFaceOffset[face] = face*srcFaceSize;
+        }
+
+        // Rows of all faces, a few rows per range to keep ranges reasonably big.
+        const uint32_t numRows = _faceSize*6;
+        const uint32_t grain   = dm::max(uint32_t(4096)/_faceSize, uint32_t(1));
+        jobParallelFor(fn, (void*)&data, numRows, grain);
+    }
+
+    // Resamples faces one at a time into a single RGBA32F face buffer, converts each to '_format' and hands it to '_faceFn'.
+    // '_rowsFn' fills rows of face '_data.m_face' into '_data.m_dst'. Stops at the first face '_faceFn' fails on.
+    template <typename DataT>
+    static bool resampleFaces(JobRangeFn _rowsFn
+                            , DataT& _data
+                            , uint32_t _faceSize
+                            , cmft::TextureFormat::Enum _format
+                            , ImageFaceFn _faceFn
+                            , void* _userData
+                            , bx::AllocatorI* _allocator
+                            )
+    {
+        // Rows are split between job system workers, a few rows per range to keep ranges reasonably big.
+        const uint32_t grain     = dm::max(uint32_t(4096)/_faceSize, uint32_t(1));
+        const uint32_t faceBytes = _faceSize*_faceSize*4*sizeof(float);
+        float* face = (float*)DM_ALLOC(_allocator, faceBytes);
+
+        bool result = true;
+        for (uint8_t ii = 0; ii < 6 && result; ++ii)
+        {
+            _data.m_dst  = face;
+            _data.m_face = ii;
+            jobParallelFor(_rowsFn, (void*)&_data, _faceSize, grain);
+
+            if (cmft::TextureFormat::RGBA32F == _format)
+            {
+                result = _faceFn(face, faceBytes, ii, _userData);
+                continue;
+            }
+
+            cmft::Image faceImage;
+            faceImage.m_data     = (void*)face;
+            faceImage.m_width    = _faceSize;
+            faceImage.m_height   = _faceSize;
+            faceImage.m_dataSize = faceBytes;
+            faceImage.m_format   = cmft::TextureFormat::RGBA32F;
+            faceImage.m_numMips  = 1;
+            faceImage.m_numFaces = 1;
+
+            cmft::Image converted;
+            cmft::imageConvert(converted, _format, faceImage, _allocator);
+            result = _faceFn(converted.m_data, converted.m_dataSize, ii, _userData);
+            cmft::imageUnload(converted, _allocator);
+        }
+
+        DM_FREE(_allocator, face);
+
+        return result;
+    }
+
+    struct FaceCopy
+    {
+        uint8_t* m_dst;
+        uint32_t m_faceBytes;
+    };
+
+    static bool copyFace(const void* _data, uint32_t /*_size*/, uint8_t _face, void* _faceCopy)
+    {
+        const FaceCopy& copy = *(const FaceCopy*)_faceCopy;
+        memcpy(copy.m_dst + _face*copy.m_faceBytes, _data, copy.m_faceBytes);
+        return true;
+    }
+
+    // Returns NULL for source formats without a fast decode path.
+    static JobRangeFn prepassRowsFn(cmft::TextureFormat::Enum _format, uint32_t& _bytesPerPixel)
+    {
+        switch (_format)
+        {
+        case cmft::TextureFormat::RGBA32F: _bytesPerPixel = DecodeRgba32f::BytesPerPixel; return prepassRows<DecodeRgba32f>;
+        case cmft::TextureFormat::RGBA16F: _bytesPerPixel = DecodeRgba16f::BytesPerPixel; return prepassRows<DecodeRgba16f>;
+        case cmft::TextureFormat::RGBE:    _bytesPerPixel = DecodeRgbe::BytesPerPixel;    return prepassRows<DecodeRgbe>;
+        case cmft::TextureFormat::RGBA8:   _bytesPerPixel = DecodeRgba8::BytesPerPixel;   return prepassRows<DecodeRgba8>;
+        case cmft::TextureFormat::BGRA8:   _bytesPerPixel = DecodeBgra8::BytesPerPixel;   return prepassRows<DecodeBgra8>;
+        default: return NULL;
+        }
+    }
+
+    static void cubemapResizeSetup(PrepassData& _data, const cmft::Image& _src, uint32_t _faceSize, uint32_t _bytesPerPixel)
+    {
+        _data.m_src     = (const uint8_t*)_src.m_data;
+        _data.m_srcSize = _src.m_width;
+        _data.m_dstSize = _faceSize;
+        _data.m_gamma   = 1.0f;
+
+        const uint32_t srcFaceSize = faceDataSize(_src.m_width, _src.m_numMips, _bytesPerPixel);
+        for (uint8_t face = 0; face < 6; ++face)
+        {
+            _data.m_srcFaceOffset[face] = face*srcFaceSize;
+        }
+    }
+
+    bool imageCubemapResize(ImageFaceFn _faceFn
+                          , void* _userData
+                          , const cmft::Image& _src
+                          , uint32_t _faceSize
+                          , cmft::TextureFormat::Enum _format
+                          , bx::AllocatorI* _allocator
+                          )
+    {
+        CS_CHECK(6 == _src.m_numFaces, "Cubemap image expected!");
+
+        uint32_t bytesPerPixel = 0;
+        const JobRangeFn fn = prepassRowsFn(_src.m_format, bytesPerPixel);
+        if (NULL == fn)
+        {
+            // No fast decode path, let cmft do the conversion.
+            cmft::Image rgba32f;
+            cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src, _allocator);
+            const bool result = imageCubemapResize(_faceFn, _userData, rgba32f, _faceSize, _format, _allocator);
+            cmft::imageUnload(rgba32f, _allocator);
+
+            return result;
+        }
+
+        PrepassData data;
+        cubemapResizeSetup(data, _src, _faceSize, bytesPerPixel);
+
+        return resampleFaces(fn, data, _faceSize, _format, _faceFn, _userData, _allocator);
+    }
+
+    void imageCubemapResize(cmft::Image& _dst
+                          , const cmft::Image& _src
+                          , uint32_t _faceSize
+                          , cmft::TextureFormat::Enum _format
+                          , bx::AllocatorI* _allocator
+                          )
+    {
+        CS_CHECK(6 == _src.m_numFaces, "Cubemap image expected!");
+
+        uint32_t bytesPerPixel = 0;
+        const JobRangeFn fn = prepassRowsFn(_src.m_format, bytesPerPixel);
+        if (NULL == fn)
+        {
+            // No fast decode path, let cmft do the conversion.
+            cmft::Image rgba32f;
+            cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src, _allocator);
+            imageCubemapResize(_dst, rgba32f, _faceSize, _format, _allocator);
+            cmft::imageUnload(rgba32f, _allocator);
+
+            return;
+        }
+
+        cmft::Image result;
+        cmft::imageCreate(result, _faceSize, _faceSize, 0x0, 1, 6, _format, _allocator);
+        const uint32_t dstFaceBytes = result.m_dataSize/6;
+
+        PrepassData data;
+        cubemapResizeSetup(data, _src, _faceSize, bytesPerPixel);
+
+        if (cmft::TextureFormat::RGBA32F == _format)
+        {
+            // All faces at once, written in place. Rows are split between job system workers, a few rows per range.
+            const uint32_t grain = dm::max(uint32_t(4096)/_faceSize, uint32_t(1));
+            data.m_dst  = (float*)result.m_data;
+            data.m_face = 0;
+            jobParallelFor(fn, (void*)&data, _faceSize*6, grain);
+        }
+        else
+        {
+            // Faces are resampled one at a time into a single face buffer and converted from there.
+            FaceCopy copy = { (uint8_t*)result.m_data, dstFaceBytes };
+            resampleFaces(fn, data, _faceSize, _format, copyFace, (void*)&copy, _allocator);
+        }
+
+        cmft::imageMove(_dst, result, _allocator);
+    }
+
+    // Gamma.
+    //-----
+
+    struct GammaData
+    {
+        float* m_data;
+        float  m_gamma;
+    };
+
+    static void gammaTexels(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const GammaData& data = *(const GammaData*)_userData;
+        const Simd4f gammaVec = simdSplat(data.m_gamma);
+
+        for (uint32_t ii = _begin; ii < _end; ++ii)
+        {
+            float* texel = &data.m_data[ii*4];
+            const Simd4f color = simdLoad(texel);
+            simdStore(texel, simdSelectRgb(simdPow(color, gammaVec), color));
+        }
+    }
+
+    void imageApplyGammaRgba32f(cmft::Image& _image, float _gamma)
+    {
+        CS_CHECK(cmft::TextureFormat::RGBA32F == _image.m_format, "RGBA32F image expected!");
+
+        if (1.0f == _gamma)
+        {
+            return;
+        }
+
+        GammaData data;
+        data.m_data  = (float*)_image.m_data;
+        data.m_gamma = _gamma;
+
+        const uint32_t numTexels = _image.m_dataSize/16;
+        jobParallelFor(gammaTexels, (void*)&data, numTexels, 16*1024);
+    }
+
+    // Irradiance.
+    //-----
+
+    // Face basis vectors, same orientation as cmft: u, v and face direction.
+    static const float s_faceUvVectors[6][3][3] =
+    {
+        { {  0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f } }, // +x
+        { {  0.0f,  0.0f,  1.0f }, {  0.0f, -1.0f,  0.0f }, { -1.0f,  0.0f,  0.0f } }, // -x
+        { {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f,  1.0f }, {  0.0f,  1.0f,  0.0f } }, // +y
+        { {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f } }, // -y
+        { {  1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } }, // +z
+        { { -1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } }, // -z
+    };
+
+    // '_u' and '_v' in [-1,1] range.
+    static inline void texelVec(float _vec[3], uint8_t _face, float _u, float _v)
+    {
+        const float (&uv)[3][3] = s_faceUvVectors[_face];
+        const float xx = uv[0][0]*_u + uv[1][0]*_v + uv[2][0];
+        const float yy = uv[0][1]*_u + uv[1][1]*_v + uv[2][1];
+        const float zz = uv[0][2]*_u + uv[1][2]*_v + uv[2][2];
+        const float invLen = 1.0f/sqrtf(xx*xx + yy*yy + zz*zz);
+        _vec[0] = xx*invLen;
+        _vec[1] = yy*invLen;
+        _vec[2] = zz*invLen;
+    }
+
+    static inline float areaElement(float _x, float _y)
+    {
+        return atan2f(_x*_y, sqrtf(_x*_x + _y*_y + 1.0f));
+    }
+
+    static inline float texelSolidAngle(float _u, float _v, float _invFaceSize)
+    {
+        const float x0 = _u - _invFaceSize;
+        const float y0 = _v - _invFaceSize;
+        const float x1 = _u + _invFaceSize;
+        const float y1 = _v + _invFaceSize;
+
+        return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+    }
+
+    // Bands 0, 1, 2 and 4. Band 3 is left out as it doesn't contribute to irradiance.
+    enum { ShCoeffNum = 18 };
+
+    static inline void shBasis(float _basis[ShCoeffNum], const float _vec[3])
+    {
+        const float xx = _vec[0], yy = _vec[1], zz = _vec[2];
+        const float x2 = xx*xx,   y2 = yy*yy,   z2 = zz*zz;
+
+        // Band 0.
+        _basis[ 0] = 0.282094792f;
+
+        // Band 1.
+        _basis[ 1] = 0.488602512f*yy;
+        _basis[ 2] = 0.488602512f*zz;
+        _basis[ 3] = 0.488602512f*xx;
+
+        // Band 2.
+        _basis[ 4] = 1.092548431f*xx*yy;
+        _basis[ 5] = 1.092548431f*yy*zz;
+        _basis[ 6] = 0.315391565f*(3.0f*z2 - 1.0f);
+        _basis[ 7] = 1.092548431f*xx*zz;
+        _basis[ 8] = 0.546274215f*(x2 - y2);
+
+        // Band 4.
+        _basis[ 9] = 2.503342942f*xx*yy*(x2 - y2);
+        _basis[10] = 1.770130769f*yy*zz*(3.0f*x2 - y2);
+        _basis[11] = 0.946174696f*xx*yy*(7.0f*z2 - 1.0f);
+        _basis[12] = 0.669046544f*yy*zz*(7.0f*z2 - 3.0f);
+        _basis[13] = 0.105785547f*(35.0f*z2*z2 - 30.0f*z2 + 3.0f);
+        _basis[14] = 0.669046544f*xx*zz*(7.0f*z2 - 3.0f);
+        _basis[15] = 0.473087348f*(x2 - y2)*(7.0f*z2 - 1.0f);
+        _basis[16] = 1.770130769f*xx*zz*(x2 - 3.0f*y2);
+        _basis[17] = 0.625835735f*(x2*(x2 - 3.0f*y2) - y2*(3.0f*x2 - y2));
+    }
+
+    // Cosine lobe convolution divided by pi, per coefficient.
+    static const float s_shBandFactor[ShCoeffNum] =
+    {
+        1.0f,
+        2.0f/3.0f, 2.0f/3.0f, 2.0f/3.0f,
+        1.0f/4.0f, 1.0f/4.0f, 1.0f/4.0f, 1.0f/4.0f, 1.0f/4.0f,
+        -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f, -1.0f/24.0f,
+    };
+
+    struct ShAccumulator
+    {
+        double m_coeffs[ShCoeffNum][3];
+        double m_weight;
+    };
+
+    struct ShProjectData
+    {
+        enum { MaxRanges = 64 };
+
+        const float* m_src;
+        uint32_t m_faceSize;
+        uint32_t m_rowsPerRange;
+        ShAccumulator m_accum[MaxRanges];
+    };
+
+    static void shProjectRange(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        ShProjectData& data = *(ShProjectData*)_userData;
+
+        const uint32_t faceSize    = data.m_faceSize;
+        const uint32_t numRows     = faceSize*6;
+        const float    invFaceSize = 1.0f/float(faceSize);
+
+        for (uint32_t range = _begin; range < _end; ++range)
+        {
+            // Each range has its own accumulator, result doesn't depend on how ranges get scheduled.
+            ShAccumulator& accum = data.m_accum[range];
+            memset(&accum, 0, sizeof(accum));
+
+            const uint32_t rowBegin = range*data.m_rowsPerRange;
+            const uint32_t rowEnd   = dm::min(rowBegin + data.m_rowsPerRange, numRows);
+            for (uint32_t row = rowBegin; row < rowEnd; ++row)
+            {
+                const uint8_t  face = uint8_t(row/faceSize);
+                const uint32_t yy   = row%faceSize;
+                const float    vv   = (float(yy)+0.5f)*invFaceSize*2.0f - 1.0f;
+                const float*   src  = data.m_src + (size_t(face)*faceSize*faceSize + size_t(yy)*faceSize)*4;
+
+                for (uint32_t xx = 0; xx < faceSize; ++xx, src += 4)
+                {
+                    const float uu = (float(xx)+0.5f)*invFaceSize*2.0f - 1.0f;
+
+                    float vec[3];
+                    texelVec(vec, face, uu, vv);
+
+                    float basis[ShCoeffNum];
+                    shBasis(basis, vec);
+
+                    const float weight = texelSolidAngle(uu, vv, invFaceSize);
+                    const float rr = src[0]*weight;
+                    const float gg = src[1]*weight;
+                    const float bb = src[2]*weight;
+                    for (uint8_t ii = 0; ii < ShCoeffNum; ++ii)
+                    {
+                        accum.m_coeffs[ii][0] += double(rr*basis[ii]);
+                        accum.m_coeffs[ii][1] += double(gg*basis[ii]);
+                        accum.m_coeffs[ii][2] += double(bb*basis[ii]);
+                    }
+                    accum.m_weight += double(weight);
+                }
+            }
+        }
+    }
+
+    struct ShEvalData
+    {
+        float m_coeffs[ShCoeffNum][3];
+        float* m_dst;
+        uint32_t m_faceSize;
+    };
+
+    static void shEvalRows(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const ShEvalData& data = *(const ShEvalData*)_userData;
+
+        const uint32_t faceSize    = data.m_faceSize;
+        const float    invFaceSize = 1.0f/float(faceSize);
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t  face = uint8_t(row/faceSize);
+            const uint32_t yy   = row%faceSize;
+            const float    vv   = (float(yy)+0.5f)*invFaceSize*2.0f - 1.0f;
+            float*         dst  = data.m_dst + (size_t(face)*faceSize*faceSize + size_t(yy)*faceSize)*4;
+
+            for (uint32_t xx = 0; xx < faceSize; ++xx, dst += 4)
+            {
+                const float uu = (float(xx)+0.5f)*invFaceSize*2.0f - 1.0f;
+
+                float vec[3];
+                texelVec(vec, face, uu, vv);
+
+                float basis[ShCoeffNum];
+                shBasis(basis, vec);
+
+                float rgb[3] = { 0.0f, 0.0f, 0.0f };
+                for (uint8_t ii = 0; ii < ShCoeffNum; ++ii)
+                {
+                    rgb[0] += data.m_coeffs[ii][0]*basis[ii];
+                    rgb[1] += data.m_coeffs[ii][1]*basis[ii];
+                    rgb[2] += data.m_coeffs[ii][2]*basis[ii];
+                }
+
+                dst[0] = dm::max(rgb[0], 0.0f);
+                dst[1] = dm::max(rgb[1], 0.0f);
+                dst[2] = dm::max(rgb[2], 0.0f);
+                dst[3] = 1.0f;
+            }
+        }
+    }
+
+    void imageIrradianceFilterSh(cmft::Image& _image, uint32_t _faceSize, bx::AllocatorI* _allocator)
+    {
+        CS_CHECK(cmft::TextureFormat::RGBA32F == _image.m_format, "RGBA32F image expected!");
+        CS_CHECK(6 == _image.m_numFaces && 1 == _image.m_numMips, "Single mip cubemap expected!");
+
+        // Project.
+        ShProjectData* project = (ShProjectData*)DM_ALLOC(_allocator, sizeof(ShProjectData));
+        project->m_src          = (const float*)_image.m_data;
+        project->m_faceSize     = _image.m_width;
+
+        const uint32_t numRows   = _image.m_width*6;
+        const uint32_t numRanges = dm::min(numRows, uint32_t(ShProjectData::MaxRanges));
+        project->m_rowsPerRange  = (numRows + numRanges - 1)/numRanges;
+
+        const uint32_t usedRanges = (numRows + project->m_rowsPerRange - 1)/project->m_rowsPerRange;
+        jobParallelFor(shProjectRange, (void*)project, usedRanges, 1);
+
+        // Reduce.
+        double coeffs[ShCoeffNum][3];
+        double weight = 0.0;
+        memset(coeffs, 0, sizeof(coeffs));
+        for (uint32_t range = 0; range < usedRanges; ++range)
+        {
+            const ShAccumulator& accum = project->m_accum[range];
+            for (uint8_t ii = 0; ii < ShCoeffNum; ++ii)
+            {
+                coeffs[ii][0] += accum.m_coeffs[ii][0];
+                coeffs[ii][1] += accum.m_coeffs[ii][1];
+                coeffs[ii][2] += accum.m_coeffs[ii][2];
+            }
+            weight += accum.m_weight;
+        }
+        DM_FREE(_allocator, project);
+
+        // Total weight should be 4*pi, normalize for the discretization error.
+        ShEvalData eval;
+        const double norm = 4.0*double(dm::pi)/weight;
+        for (uint8_t ii = 0; ii < ShCoeffNum; ++ii)
+        {
+            const double factor = norm*double(s_shBandFactor[ii]);
+            eval.m_coeffs[ii][0] = float(coeffs[ii][0]*factor);
+            eval.m_coeffs[ii][1] = float(coeffs[ii][1]*factor);
+            eval.m_coeffs[ii][2] = float(coeffs[ii][2]*factor);
+        }
+
+        // Evaluate.
+        cmft::Image result;
+        cmft::imageCreate(result, _faceSize, _faceSize, 0x0, 1, 6, cmft::TextureFormat::RGBA32F, _allocator);
+
+        eval.m_dst      = (float*)result.m_data;
+        eval.m_faceSize = _faceSize;
+
+        const uint32_t grain = dm::max(uint32_t(1024)/_faceSize, uint32_t(1));
+        jobParallelFor(shEvalRows, (void*)&eval, _faceSize*6, grain);
+
+        cmft::imageMove(_image, result, _allocator);
+    }
+
+    // Latlong to cubemap.
+    //-----
+
+    struct LatLongData
+    {
+        const uint8_t* m_src;
+        uint32_t m_srcWidth;
+        uint32_t m_srcHeight;
+        float*   m_dst; // RGBA32F faces, starting with 'm_face'.
+        uint32_t m_dstSize;
+        uint8_t  m_face;
+    };
+
+    template <typename DecodeT>
+    static void latLongRows(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const LatLongData& data = *(const LatLongData*)_userData;
+
+        const uint32_t srcWidth   = data.m_srcWidth;
+        const uint32_t srcHeight  = data.m_srcHeight;
+        const uint32_t srcPitch   = srcWidth*DecodeT::BytesPerPixel;
+        const uint32_t dstSize    = data.m_dstSize;
+        const float    invDstSize = 1.0f/float(dstSize);
+
+        // Texel center to [-1,1] for four consecutive texels.
+        const Simd4f uuScale  = simdSplat(2.0f*invDstSize);
+        const Simd4f uuOffset = simdMadd(simdSet(0.5f, 1.5f, 2.5f, 3.5f), uuScale, simdSplat(-1.0f));
+
+        // Direction to latlong texel coordinates, u = (pi + phi)/(2*pi), v = theta/pi.
+        const Simd4f pi     = simdSplat(dm::pi);
+        const Simd4f xScale = simdSplat(dm::invPiHalf*float(srcWidth));
+        const Simd4f yScale = simdSplat(dm::invPi*float(srcHeight));
+        const Simd4f half   = simdSplat(0.5f);
+        const Simd4f maxY   = simdSplat(float(srcHeight-1));
+
+        for (uint32_t row = _begin; row < _end; ++row)
+        {
+            const uint8_t  face = uint8_t(data.m_face + row/dstSize);
+            const uint32_t yy   = row%dstSize;
+            const float    vv   = (float(yy)+0.5f)*2.0f*invDstSize - 1.0f;
+
+            // Texel direction is u*U + v*V + N, v and N terms are constant along the row.
+            const float (&uv)[3][3] = s_faceUvVectors[face];
+            const Simd4f ux = simdSplat(uv[0][0]);
+            const Simd4f uy = simdSplat(uv[0][1]);
+            const Simd4f uz = simdSplat(uv[0][2]);
+            const Simd4f baseX = simdSplat(uv[1][0]*vv + uv[2][0]);
+            const Simd4f baseY = simdSplat(uv[1][1]*vv + uv[2][1]);
+            const Simd4f baseZ = simdSplat(uv[1][2]*vv + uv[2][2]);
+
+            float* dst = data.m_dst + size_t(row)*dstSize*4;
+
+            for (uint32_t xx = 0; xx < dstSize; xx += 4)
+            {
+                const Simd4f uu = simdMadd(simdSplat(float(xx)), uuScale, uuOffset);
+                const Simd4f dx = simdMadd(uu, ux, baseX);
+                const Simd4f dy = simdMadd(uu, uy, baseY);
+                const Simd4f dz = simdMadd(uu, uz, baseZ);
+
+                // Direction doesn't have to be normalized, atan2() is scale invariant.
+                const Simd4f phi   = simdAtan2(dx, dz);
+                const Simd4f theta = simdAtan2(simdSqrt(simdMadd(dx, dx, simdMul(dz, dz))), dy);
+
+                float fx[4];
+                float fy[4];
+                simdStore(fx, simdSub(simdMul(simdAdd(pi, phi), xScale), half));
+                simdStore(fy, simdMin(simdMax(simdSub(simdMul(theta, yScale), half), simdZero()), maxY));
+
+                // Bilinear, wraps around horizontally and clamps vertically.
+                const uint32_t count = dm::min(dstSize-xx, uint32_t(4));
+                for (uint32_t ii = 0; ii < count; ++ii)
+                {
+                    const float    fx0 = floorf(fx[ii]);
+                    const uint32_t x0  = uint32_t(int32_t(fx0) + int32_t(srcWidth))%srcWidth;
+                    const uint32_t x1  = (x0+1)%srcWidth;
+                    const uint32_t y0  = uint32_t(fy[ii]);
+                    const uint32_t y1  = dm::min(y0+1, srcHeight-1);
+                    const Simd4f   tx  = simdSplat(fx[ii] - fx0);
+                    const Simd4f   ty  = simdSplat(fy[ii] - float(y0));
+
+                    const uint8_t* row0 = data.m_src + size_t(y0)*srcPitch;
+                    const uint8_t* row1 = data.m_src + size_t(y1)*srcPitch;
+
+                    const Simd4f c00 = DecodeT::decode(row0 + x0*DecodeT::BytesPerPixel);
+                    const Simd4f c01 = DecodeT::decode(row0 + x1*DecodeT::BytesPerPixel);
+                    const Simd4f c10 = DecodeT::decode(row1 + x0*DecodeT::BytesPerPixel);
+                    const Simd4f c11 = DecodeT::decode(row1 + x1*DecodeT::BytesPerPixel);
+
+                    const Simd4f top    = simdMadd(simdSub(c01, c00), tx, c00);
+                    const Simd4f bottom = simdMadd(simdSub(c11, c10), tx, c10);
+
+                    simdStore(&dst[(xx+ii)*4], simdMadd(simdSub(bottom, top), ty, top));
+                }
+            }
+        }
+    }
+
+    // Returns NULL for source formats without a fast decode path.
+    static JobRangeFn latLongRowsFn(cmft::TextureFormat::Enum _format)
+    {
+        switch (_format)
+        {
+        case cmft::TextureFormat::RGBA32F: return latLongRows<DecodeRgba32f>;
+        case cmft::TextureFormat::RGBA16F: return latLongRows<DecodeRgba16f>;
+        case cmft::TextureFormat::RGBE:    return latLongRows<DecodeRgbe>;
+        case cmft::TextureFormat::RGBA8:   return latLongRows<DecodeRgba8>;
+        case cmft::TextureFormat::BGRA8:   return latLongRows<DecodeBgra8>;
+        default: return NULL;
+        }
+    }
+
+    static void cubemapFromLatLongSetup(LatLongData& _data, const cmft::Image& _src, uint32_t _faceSize)
+    {
+        _data.m_src       = (const uint8_t*)_src.m_data;
+        _data.m_srcWidth  = _src.m_width;
+        _data.m_srcHeight = _src.m_height;
+        _data.m_dstSize   = _faceSize;
+    }
+
+    bool imageCubemapFromLatLong(ImageFaceFn _faceFn
+                               , void* _userData
+                               , const cmft::Image& _src
+                               , uint32_t _faceSize
+                               , cmft::TextureFormat::Enum _format
+                               , bx::AllocatorI* _allocator
+                               )
+    {
+        CS_CHECK(cmft::imageIsLatLong(_src), "Latlong image expected!");
+
+        const JobRangeFn fn = latLongRowsFn(_src.m_format);
+        if (NULL == fn)
+        {
+            // No fast decode path, let cmft do the conversion.
+            cmft::Image rgba32f;
+            cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src, _allocator);
+            const bool result = imageCubemapFromLatLong(_faceFn, _userData, rgba32f, _faceSize, _format, _allocator);
+            cmft::imageUnload(rgba32f, _allocator);
+
+            return result;
+        }
+
+        LatLongData data;
+        cubemapFromLatLongSetup(data, _src, _faceSize);
+
+        return resampleFaces(fn, data, _faceSize, _format, _faceFn, _userData, _allocator);
+    }
+
+    void imageCubemapFromLatLong(cmft::Image& _dst
+                               , const cmft::Image& _src
+                               , uint32_t _faceSize
+                               , cmft::TextureFormat::Enum _format
+                               , bx::AllocatorI* _allocator
+                               )
+    {
+        CS_CHECK(cmft::imageIsLatLong(_src), "Latlong image expected!");
+
+        const JobRangeFn fn = latLongRowsFn(_src.m_format);
+        if (NULL == fn)
+        {
+            // No fast decode path, let cmft do the conversion.
+            cmft::Image rgba32f;
+            cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src, _allocator);
+            imageCubemapFromLatLong(_dst, rgba32f, _faceSize, _format, _allocator);
+            cmft::imageUnload(rgba32f, _allocator);
+
+            return;
+        }
+
+        cmft::Image result;
+        cmft::imageCreate(result, _faceSize, _faceSize, 0x0, 1, 6, _format, _allocator);
+        const uint32_t dstFaceBytes = result.m_dataSize/6;
+
+        LatLongData data;
+        cubemapFromLatLongSetup(data, _src, _faceSize);
+
+        if (cmft::TextureFormat::RGBA32F == _format)
+        {
+            // All faces at once, written in place. Rows are split between job system workers, a few rows per range.
+            const uint32_t grain = dm::max(uint32_t(4096)/_faceSize, uint32_t(1));
+            data.m_dst  = (float*)result.m_data;
+            data.m_face = 0;
+            jobParallelFor(fn, (void*)&data, _faceSize*6, grain);
+        }
+        else
+        {
+            // Faces are resampled one at a time into a single face buffer and converted from there.
+            FaceCopy copy = { (uint8_t*)result.m_data, dstFaceBytes };
+            resampleFaces(fn, data, _faceSize, _format, copyFace, (void*)&copy, _allocator);
+        }
+
+        cmft::imageMove(_dst, result, _allocator);
+    }
+
+    // Tonemap.
+    //-----
+
+    struct TonemapData
+    {
+        const uint8_t* m_src;
+        uint8_t* m_dst;
+        float m_gamma;
+        float m_minLum;
+        float m_invLumRange;
+    };
+
+    template <typename DecodeT, typename EncodeT>
+    static void tonemapTexels(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const TonemapData& data = *(const TonemapData*)_userData;
+        const Simd4f gamma       = simdSplat(data.m_gamma);
+        const Simd4f minLum      = simdSplat(data.m_minLum);
+        const Simd4f invLumRange = simdSplat(data.m_invLumRange);
+
+        const uint8_t* src = data.m_src + size_t(_begin)*DecodeT::BytesPerPixel;
+        uint8_t*       dst = data.m_dst + size_t(_begin)*DecodeT::BytesPerPixel;
+        for (uint32_t ii = _begin; ii < _end; ++ii, src += DecodeT::BytesPerPixel, dst += DecodeT::BytesPerPixel)
+        {
+            const Simd4f color  = DecodeT::decode(src);
+            const Simd4f mapped = simdMul(simdSub(simdPow(color, gamma), minLum), invLumRange);
+            EncodeT::encode(dst, simdSelectRgb(mapped, color));
+        }
+    }
+
+    void imageTonemap(cmft::Image& _dst, const cmft::Image& _src, float _gamma, float _minLum, float _lumRange)
+    {
+        JobRangeFn fn;
+        uint32_t bytesPerPixel;
+        switch (_src.m_format)
+        {
+        case cmft::TextureFormat::RGBA32F: fn = tonemapTexels<DecodeRgba32f, EncodeRgba32f>; bytesPerPixel = DecodeRgba32f::BytesPerPixel; break;
+        case cmft::TextureFormat::RGBA16F: fn = tonemapTexels<DecodeRgba16f, EncodeRgba16f>; bytesPerPixel = DecodeRgba16f::BytesPerPixel; break;
+        case cmft::TextureFormat::RGBA8:   fn = tonemapTexels<DecodeRgba8,   EncodeRgba8>;   bytesPerPixel = DecodeRgba8::BytesPerPixel;   break;
+        case cmft::TextureFormat::BGRA8:   fn = tonemapTexels<DecodeBgra8,   EncodeBgra8>;   bytesPerPixel = DecodeBgra8::BytesPerPixel;   break;
+        default:
+            {
+                // No fast path, tonemap in rgba32f and convert back.
+                cmft::Image rgba32f;
+                cmft::imageConvert(rgba32f, cmft::TextureFormat::RGBA32F, _src);
+                cmft::Image tonemapped;
+                imageTonemap(tonemapped, rgba32f, _gamma, _minLum, _lumRange);
+                cmft::imageUnload(rgba32f);
+                cmft::imageConvert(_dst, _src.m_format, tonemapped);
+                cmft::imageUnload(tonemapped);
+            }
+            return;
+        }
+
+        cmft::imageCreate(_dst, _src.m_width, _src.m_height, 0x0, _src.m_numMips, _src.m_numFaces, _src.m_format);
+        CS_CHECK(_dst.m_dataSize == _src.m_dataSize, "Image layout mismatch!");
+
+        TonemapData data;
+        data.m_src         = (const uint8_t*)_src.m_data;
+        data.m_dst         = (uint8_t*)_dst.m_data;
+        data.m_gamma       = _gamma;
+        data.m_minLum      = _minLum;
+        data.m_invLumRange = 1.0f/_lumRange;
+
+        const uint32_t numTexels = _src.m_dataSize/bytesPerPixel;
+        jobParallelFor(fn, (void*)&data, numTexels, 16*1024);
+    }
+
+    // Hdr encoding.
+    //-----
+
+    struct HdrMeasureRange
+    {
+        double m_sum;
+        double m_error[HdrEncoding::Count];
+        float  m_max;
+    };
+
+    struct HdrMeasureData
+    {
+        enum { MaxRanges = 64 };
+
+        const uint8_t* m_src;
+        uint32_t m_numTexels;
+        uint32_t m_texelsPerRange;
+        HdrMeasureRange m_ranges[MaxRanges];
+    };
+
+    static inline Simd4f simdAbsRgb(Simd4f _a)
+    {
+        return simdSelectRgb(simdMax(_a, simdSub(simdZero(), _a)), simdZero());
+    }
+
+    template <typename DecodeT, typename EncodeT>
+    static inline Simd4f roundTripError(Simd4f _color)
+    {
+        uint8_t encoded[EncodeT::BytesPerPixel];
+        EncodeT::encode(encoded, _color);
+        return simdAbsRgb(simdSub(DecodeT::decode(encoded), _color));
+    }
+
+    template <typename DecodeT>
+    static void hdrMeasureRange(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        HdrMeasureData& data = *(HdrMeasureData*)_userData;
+
+        for (uint32_t range = _begin; range < _end; ++range)
+        {
+            // Each range has its own accumulator, result doesn't depend on how ranges get scheduled.
+            HdrMeasureRange& accum = data.m_ranges[range];
+            memset(&accum, 0, sizeof(accum));
+
+            const uint32_t texelBegin = range*data.m_texelsPerRange;
+            const uint32_t texelEnd   = dm::min(texelBegin + data.m_texelsPerRange, data.m_numTexels);
+
+            // Rows are summed in float, ranges in double.
+            Simd4f sum      = simdZero();
+            Simd4f err16f   = simdZero();
+            Simd4f err9e5   = simdZero();
+            Simd4f maxColor = simdZero();
+
+            const uint8_t* src = data.m_src + size_t(texelBegin)*DecodeT::BytesPerPixel;
+            for (uint32_t ii = texelBegin; ii < texelEnd; ++ii, src += DecodeT::BytesPerPixel)
+            {
+                const Simd4f color = DecodeT::decode(src);
+
+                sum      = simdAdd(sum, simdAbsRgb(color));
+                maxColor = simdMax(maxColor, simdSelectRgb(color, simdZero()));
+                err16f   = simdAdd(err16f, roundTripError<DecodeRgba16f, EncodeRgba16f>(color));
+                err9e5   = simdAdd(err9e5, roundTripError<DecodeRgb9e5,  EncodeRgb9e5 >(color));
+
+                if (0 == (ii+1)%1024 || ii+1 == texelEnd)
+                {
+                    float tmp[4];
+                    simdStore(tmp, sum);    accum.m_sum                        += double(tmp[0]) + double(tmp[1]) + double(tmp[2]);
+                    simdStore(tmp, err16f); accum.m_error[HdrEncoding::Rgba16f] += double(tmp[0]) + double(tmp[1]) + double(tmp[2]);
+                    simdStore(tmp, err9e5); accum.m_error[HdrEncoding::Rgb9e5]  += double(tmp[0]) + double(tmp[1]) + double(tmp[2]);
+                    sum    = simdZero();
+                    err16f = simdZero();
+                    err9e5 = simdZero();
+                }
+            }
+
+            float tmp[4];
+            simdStore(tmp, maxColor);
+            accum.m_max = dm::max(tmp[0], dm::max(tmp[1], tmp[2]));
+        }
+    }
+
+    void imageMeasureHdrEncoding(HdrEncodingStats& _stats, const cmft::Image& _image)
+    {
+        JobRangeFn fn;
+        uint32_t bytesPerPixel;
+        switch (_image.m_format)
+        {
+        case cmft::TextureFormat::RGBA32F: fn = hdrMeasureRange<DecodeRgba32f>; bytesPerPixel = DecodeRgba32f::BytesPerPixel; break;
+        case cmft::TextureFormat::RGBA16F: fn = hdrMeasureRange<DecodeRgba16f>; bytesPerPixel = DecodeRgba16f::BytesPerPixel; break;
+        default:
+            CS_CHECK(false, "RGBA32F or RGBA16F image expected!");
+            return;
+        }
+
+        HdrMeasureData* data = (HdrMeasureData*)DM_ALLOC(dm::mainAlloc, sizeof(HdrMeasureData));
+        data->m_src       = (const uint8_t*)_image.m_data;
+        data->m_numTexels = _image.m_dataSize/bytesPerPixel;
+
+        const uint32_t numRanges = dm::max(dm::min(data->m_numTexels/1024, uint32_t(HdrMeasureData::MaxRanges)), uint32_t(1));
+        data->m_texelsPerRange   = (data->m_numTexels + numRanges - 1)/numRanges;
+
+        const uint32_t usedRanges = (data->m_numTexels + data->m_texelsPerRange - 1)/data->m_texelsPerRange;
+        jobParallelFor(fn, (void*)data, usedRanges, 1);
+
+        // Reduce.
+        double sum = 0.0;
+        double error[HdrEncoding::Count] = { 0.0, 0.0 };
+        float  maxValue = 0.0f;
+        for (uint32_t range = 0; range < usedRanges; ++range)
+        {
+            const HdrMeasureRange& accum = data->m_ranges[range];
+            sum += accum.m_sum;
+            error[HdrEncoding::Rgba16f] += accum.m_error[HdrEncoding::Rgba16f];
+            error[HdrEncoding::Rgb9e5]  += accum.m_error[HdrEncoding::Rgb9e5];
+            maxValue = dm::max(maxValue, accum.m_max);
+        }
+        DM_FREE(dm::mainAlloc, data);
+
+        _stats.m_maxValue = maxValue;
+        for (uint8_t ii = 0; ii < HdrEncoding::Count; ++ii)
+        {
+            _stats.m_error[ii] = (0.0 < sum) ? float(error[ii]/sum) : 0.0f;
+        }
+    }
+
+    struct HdrEncodeData
+    {
+        const uint8_t* m_src;
+        uint8_t* m_dst;
+    };
+
+    template <typename DecodeT, typename EncodeT>
+    static void hdrEncodeTexels(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const HdrEncodeData& data = *(const HdrEncodeData*)_userData;
+
+        const uint8_t* src = data.m_src + size_t(_begin)*DecodeT::BytesPerPixel;
+        uint8_t*       dst = data.m_dst + size_t(_begin)*EncodeT::BytesPerPixel;
+        for (uint32_t ii = _begin; ii < _end; ++ii, src += DecodeT::BytesPerPixel, dst += EncodeT::BytesPerPixel)
+        {
+            EncodeT::encode(dst, DecodeT::decode(src));
+        }
+    }
+
+    uint32_t imageEncodeHdr(void*& _data, const cmft::Image& _image, HdrEncoding::Enum _encoding, bx::AllocatorI* _allocator)
+    {
+        const bool rgba32f = (cmft::TextureFormat::RGBA32F == _image.m_format);
+        CS_CHECK(rgba32f || cmft::TextureFormat::RGBA16F == _image.m_format, "RGBA32F or RGBA16F image expected!");
+
+        JobRangeFn fn;
+        uint32_t srcBytesPerPixel = rgba32f ? DecodeRgba32f::BytesPerPixel : DecodeRgba16f::BytesPerPixel;
+        uint32_t dstBytesPerPixel;
+        if (HdrEncoding::Rgba16f == _encoding)
+        {
+            fn = rgba32f ? hdrEncodeTexels<DecodeRgba32f, EncodeRgba16f> : hdrEncodeTexels<DecodeRgba16f, EncodeRgba16f>;
+            dstBytesPerPixel = EncodeRgba16f::BytesPerPixel;
+        }
+        else
+        {
+            fn = rgba32f ? hdrEncodeTexels<DecodeRgba32f, EncodeRgb9e5> : hdrEncodeTexels<DecodeRgba16f, EncodeRgb9e5>;
+            dstBytesPerPixel = EncodeRgb9e5::BytesPerPixel;
+        }
+
+        const uint32_t numTexels = _image.m_dataSize/srcBytesPerPixel;
+        const uint32_t size      = numTexels*dstBytesPerPixel;
+
+        HdrEncodeData data;
+        data.m_src = (const uint8_t*)_image.m_data;
+        data.m_dst = (uint8_t*)BX_ALLOC(_allocator, size);
+
+        jobParallelFor(fn, (void*)&data, numTexels, 16*1024);
+
+        _data = data.m_dst;
+        return size;
+    }
+
+} // namespace cs
+
+/* vim: set sw=4 ts=4 expandtab: */
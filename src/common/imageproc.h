@@ -0,0 +1,106 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_IMAGEPROC_H_HEADER_GUARD
+#define CMFTSTUDIO_IMAGEPROC_H_HEADER_GUARD
+
+#include <stdint.h>
+#include "cmft.h" // cmft::Image, cmft::TextureFormat
+
+namespace cs
+{
+    /// Fused cmft filter pre-pass. Decodes '_src' cubemap to RGBA32F, resamples its faces to '_faceSize' and applies '_gamma'
+    /// to rgb channels, all in a single sweep over the source data. Result is a single mip RGBA32F cubemap in '_dst'.
+    /// Work is split between job system workers. Source formats without a fast decode path are converted by cmft first.
+    /// '_dst' and temporaries are allocated from '_allocator'.
+    void imageCubemapPrepass(cmft::Image& _dst, const cmft::Image& _src, uint32_t _faceSize, float _gamma, bx::AllocatorI* _allocator);
+
+    /// Resamples top mip of cubemap '_src' into a single mip cubemap '_dst' with '_faceSize' faces and '_format', using the
+    /// pre-pass filters: box filtered when downsampling, bilinear otherwise. Besides '_src' and '_dst' at most one RGBA32F face
+    /// is held in memory. Source formats without a fast decode path are converted by cmft first. '_dst' is allocated from '_allocator'.
+    void imageCubemapResize(cmft::Image& _dst
+                          , const cmft::Image& _src
+                          , uint32_t _faceSize
+                          , cmft::TextureFormat::Enum _format
+                          , bx::AllocatorI* _allocator
+                          );
+
+    /// Receives one face of '_size' bytes at a time, returning false stops the resampling.
+    typedef bool (*ImageFaceFn)(const void* _data, uint32_t _size, uint8_t _face, void* _userData);
+
+    /// Same as above, but faces are handed to '_faceFn' in order instead of being kept, for writing big cubemaps to files.
+    /// Besides '_src' at most one RGBA32F and one '_format' face are held in memory. Returns false if '_faceFn' failed.
+    bool imageCubemapResize(ImageFaceFn _faceFn
+                          , void* _userData
+                          , const cmft::Image& _src
+                          , uint32_t _faceSize
+                          , cmft::TextureFormat::Enum _format
+                          , bx::AllocatorI* _allocator
+                          );
+
+    /// Resamples latlong '_src' into a single mip cubemap '_dst' with '_faceSize' faces and '_format', bilinearly filtered.
+    /// Besides '_src' and '_dst' at most one RGBA32F face is held in memory. Rows are split between job system workers,
+    /// direction math is done four texels at a time. Source formats without a fast decode path are converted by cmft first.
+    /// '_dst' is allocated from '_allocator'.
+    void imageCubemapFromLatLong(cmft::Image& _dst
+                               , const cmft::Image& _src
+                               , uint32_t _faceSize
+                               , cmft::TextureFormat::Enum _format
+                               , bx::AllocatorI* _allocator
+                               );
+
+    /// Same as above, faces are handed to '_faceFn' in order. See imageCubemapResize().
+    bool imageCubemapFromLatLong(ImageFaceFn _faceFn
+                               , void* _userData
+                               , const cmft::Image& _src
+                               , uint32_t _faceSize
+                               , cmft::TextureFormat::Enum _format
+                               , bx::AllocatorI* _allocator
+                               );
+
+    /// Applies '_gamma' to rgb channels of RGBA32F image, in place. All faces and mips are processed.
+    void imageApplyGammaRgba32f(cmft::Image& _image, float _gamma);
+
+    /// Irradiance filter. Projects RGBA32F cubemap '_image' to spherical harmonics, convolves it with the cosine lobe and
+    /// evaluates the result into '_image' as a single mip RGBA32F cubemap with '_faceSize' faces. Rgb is irradiance divided by pi.
+    /// Projection and evaluation are split between job system workers, projection uses separate accumulators per range.
+    /// '_image' has to be allocated from '_allocator', result and temporaries are allocated from it too.
+    void imageIrradianceFilterSh(cmft::Image& _image, uint32_t _faceSize, bx::AllocatorI* _allocator);
+
+    /// Tonemaps rgb channels of '_src' into '_dst' as (pow(rgb, _gamma) - _minLum)/_lumRange. Alpha is left as is.
+    /// '_dst' gets the same format, size, faces and mips as '_src'. RGBA32F, RGBA16F, RGBA8 and BGRA8 are processed directly,
+    /// without intermediate conversion. Work is split between job system workers.
+    void imageTonemap(cmft::Image& _dst, const cmft::Image& _src, float _gamma, float _minLum, float _lumRange);
+
+    struct HdrEncoding
+    {
+        enum Enum
+        {
+            Rgba16f, // 8 bytes per texel, ~11 bit mantissa per channel, up to 65504.
+            Rgb9e5,  // 4 bytes per texel, 9 bit mantissa per channel with a shared exponent, up to 65408. No alpha.
+
+            Count
+        };
+    };
+
+    struct HdrEncodingStats
+    {
+        float m_maxValue;                    // Biggest rgb channel value.
+        float m_error[HdrEncoding::Count];   // Sum of absolute rgb errors after encoding round trip, over sum of rgb values.
+    };
+
+    /// Measures how well rgb channels of RGBA32F or RGBA16F '_image' are kept by each HdrEncoding. All faces and mips are
+    /// measured, texel ranges are split between job system workers, each range with its own accumulator.
+    void imageMeasureHdrEncoding(HdrEncodingStats& _stats, const cmft::Image& _image);
+
+    /// Encodes all faces and mips of RGBA32F or RGBA16F '_image' with '_encoding', keeping cmft layout. Result is allocated
+    /// from '_allocator' and written to '_data', returns its size. Work is split between job system workers.
+    uint32_t imageEncodeHdr(void*& _data, const cmft::Image& _image, HdrEncoding::Enum _encoding, bx::AllocatorI* _allocator);
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_IMAGEPROC_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
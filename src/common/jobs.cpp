@@ -0,0 +1,515 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common.h"
+#include "jobs.h"
+
+#include <bx/thread.h> // bx::Thread, bx::Mutex
+#include <bx/sem.h>    // bx::Semaphore
+#include <bx/os.h>     // bx::sleep, bx::yield
+#include <dm/misc.h>   // dm::min, dm::max
+
+#if BX_PLATFORM_WINDOWS
+#   include <windows.h> // GetSystemInfo
+#else
+#   include <unistd.h>  // sysconf
+#endif // BX_PLATFORM_WINDOWS
+
+namespace cs
+{
+    uint8_t cpuNumCores()
+    {
+        #if BX_PLATFORM_WINDOWS
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            const long numCores = long(info.dwNumberOfProcessors);
+        #else
+            const long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+        #endif // BX_PLATFORM_WINDOWS
+
+        return uint8_t(DM_CLAMP(numCores, 1, 255));
+    }
+
+    struct JobSystem
+    {
+        enum
+        {
+            MaxWorkers  = 32,
+            MaxJobs     = 64,
+            MaxParallel = 16,
+        };
+
+        struct JobState
+        {
+            enum Enum
+            {
+                Free,
+                Queued,
+                Running,
+                Finished,
+            };
+        };
+
+        struct Job
+        {
+            JobFn         m_fn;
+            void*         m_userData;
+            JobCompleteFn m_onComplete;
+            void*         m_completeUserData;
+            int32_t       m_result;
+            uint16_t      m_generation; // Guarded by m_mutex.
+            uint8_t       m_state;      // Guarded by m_mutex.
+        };
+
+        struct ParallelFor
+        {
+            JobRangeFn m_fn;
+            void*      m_userData;
+            uint32_t   m_count;
+            uint32_t   m_grain;
+            uint32_t   m_next;       // Guarded by m_mutex.
+            uint32_t   m_numRunners; // Guarded by m_mutex.
+        };
+
+        struct IdxQueue
+        {
+            IdxQueue()
+            {
+                m_read  = 0;
+                m_count = 0;
+            }
+
+            void push(uint16_t _idx)
+            {
+                CS_CHECK(m_count < MaxJobs, "Job queue overflow!");
+                m_idx[(m_read+m_count)%MaxJobs] = _idx;
+                ++m_count;
+            }
+
+            uint16_t pop()
+            {
+                const uint16_t idx = m_idx[m_read];
+                m_read = (m_read+1)%MaxJobs;
+                --m_count;
+                return idx;
+            }
+
+            uint16_t m_idx[MaxJobs];
+            uint16_t m_read;
+            uint16_t m_count;
+        };
+
+        JobSystem()
+        {
+            m_numWorkers  = 0;
+            m_numParallel = 0;
+            m_exit        = false;
+
+            m_numFree = MaxJobs;
+            for (uint16_t ii = 0; ii < MaxJobs; ++ii)
+            {
+                m_free[ii] = uint16_t(MaxJobs-1-ii);
+                m_jobs[ii].m_state      = JobState::Free;
+                m_jobs[ii].m_generation = 0;
+            }
+        }
+
+        void init(uint8_t _numWorkers)
+        {
+            const uint8_t numWorkers = (0 == _numWorkers) ? cpuNumCores() : _numWorkers;
+            m_numWorkers = uint8_t(DM_CLAMP(numWorkers, 2, MaxWorkers));
+            m_exit = false;
+
+            for (uint8_t ii = 0; ii < m_numWorkers; ++ii)
+            {
+                m_workers[ii].init(workerFunc, (void*)this);
+            }
+        }
+
+        void shutdown()
+        {
+            if (0 == m_numWorkers)
+            {
+                return;
+            }
+
+            {
+                bx::MutexScope lock(m_mutex);
+                m_exit = true;
+            }
+            m_sem.post(m_numWorkers);
+
+            for (uint8_t ii = 0; ii < m_numWorkers; ++ii)
+            {
+                m_workers[ii].shutdown();
+            }
+            m_numWorkers = 0;
+
+            // Dispatch whatever got finished in the meantime.
+            update();
+        }
+
+        JobHandle submit(JobFn _fn, void* _userData, JobPriority::Enum _priority, JobCompleteFn _onComplete, void* _completeUserData)
+        {
+            JobHandle handle;
+            {
+                bx::MutexScope lock(m_mutex);
+
+                if (0 == m_numFree)
+                {
+                    return JobHandle::invalid();
+                }
+
+                const uint16_t idx = m_free[--m_numFree];
+
+                Job& job = m_jobs[idx];
+                job.m_fn               = _fn;
+                job.m_userData         = _userData;
+                job.m_onComplete       = _onComplete;
+                job.m_completeUserData = _completeUserData;
+                job.m_result           = 0;
+                job.m_state            = JobState::Queued;
+                job.m_generation++;
+
+                m_queue[_priority].push(idx);
+
+                handle.m_idx        = idx;
+                handle.m_generation = job.m_generation;
+            }
+
+            // Without workers (jobsInit() not called), execute in place.
+            if (0 == m_numWorkers)
+            {
+                uint16_t idx;
+                {
+                    bx::MutexScope lock(m_mutex);
+                    idx = dequeue();
+                }
+                execute(idx);
+            }
+            else
+            {
+                m_sem.post();
+            }
+
+            return handle;
+        }
+
+        uint16_t update()
+        {
+            uint16_t done[MaxJobs];
+            uint16_t numDone = 0;
+            {
+                bx::MutexScope lock(m_mutex);
+                while (0 != m_done.m_count)
+                {
+                    done[numDone++] = m_done.pop();
+                }
+            }
+
+            for (uint16_t ii = 0; ii < numDone; ++ii)
+            {
+                const Job& job = m_jobs[done[ii]];
+                if (NULL != job.m_onComplete)
+                {
+                    job.m_onComplete(job.m_result, job.m_completeUserData);
+                }
+            }
+
+            {
+                bx::MutexScope lock(m_mutex);
+                for (uint16_t ii = 0; ii < numDone; ++ii)
+                {
+                    m_jobs[done[ii]].m_state = JobState::Free;
+                    m_free[m_numFree++] = done[ii];
+                }
+            }
+
+            return numDone;
+        }
+
+        bool isDone(JobHandle _handle)
+        {
+            if (!isValid(_handle))
+            {
+                return true;
+            }
+
+            bx::MutexScope lock(m_mutex);
+
+            // Slot got reused, the job was finished and dispatched before.
+            const Job& job = m_jobs[_handle.m_idx];
+            if (_handle.m_generation != job.m_generation)
+            {
+                return true;
+            }
+
+            return (JobState::Finished == job.m_state || JobState::Free == job.m_state);
+        }
+
+        void wait(JobHandle _handle)
+        {
+            while (!isDone(_handle))
+            {
+                // Without workers (after shutdown()), queued jobs never run on their own, execute them in place.
+                if (0 == m_numWorkers)
+                {
+                    uint16_t idx;
+                    {
+                        bx::MutexScope lock(m_mutex);
+                        idx = dequeue();
+                    }
+
+                    if (UINT16_MAX != idx)
+                    {
+                        execute(idx);
+                        continue;
+                    }
+                }
+
+                bx::sleep(1);
+            }
+        }
+
+        uint16_t numPending()
+        {
+            bx::MutexScope lock(m_mutex);
+            return uint16_t(MaxJobs - m_numFree);
+        }
+
+        void parallelFor(JobRangeFn _fn, void* _userData, uint32_t _count, uint32_t _grain)
+        {
+            ParallelFor pf;
+            pf.m_fn         = _fn;
+            pf.m_userData   = _userData;
+            pf.m_count      = _count;
+            pf.m_grain      = dm::max(_grain, uint32_t(1));
+            pf.m_next       = 0;
+            pf.m_numRunners = 0;
+
+            const uint32_t numRanges = (_count + pf.m_grain - 1)/pf.m_grain;
+
+            // Publish to idle workers.
+            bool published = false;
+            if (numRanges > 1 && 0 != m_numWorkers)
+            {
+                bx::MutexScope lock(m_mutex);
+                if (m_numParallel < MaxParallel)
+                {
+                    m_parallel[m_numParallel++] = &pf;
+                    published = true;
+                }
+            }
+
+            if (published)
+            {
+                m_sem.post(dm::min(numRanges-1, uint32_t(m_numWorkers)));
+            }
+
+            // Calling thread takes part as well, so all ranges get processed even if no worker is idle.
+            runParallel(&pf);
+
+            if (published)
+            {
+                {
+                    bx::MutexScope lock(m_mutex);
+                    for (uint16_t ii = 0; ii < m_numParallel; ++ii)
+                    {
+                        if (&pf == m_parallel[ii])
+                        {
+                            m_parallel[ii] = m_parallel[--m_numParallel];
+                            break;
+                        }
+                    }
+                }
+
+                // Wait for workers still processing their ranges. After this, nobody references 'pf'.
+                for (;;)
+                {
+                    {
+                        bx::MutexScope lock(m_mutex);
+                        if (0 == pf.m_numRunners)
+                        {
+                            break;
+                        }
+                    }
+                    bx::yield();
+                }
+            }
+        }
+
+        uint8_t m_numWorkers;
+
+    private:
+        void runParallel(ParallelFor* _pf)
+        {
+            for (;;)
+            {
+                uint32_t begin;
+                {
+                    bx::MutexScope lock(m_mutex);
+                    begin = _pf->m_next;
+                    _pf->m_next = dm::min(begin + _pf->m_grain, _pf->m_count);
+                }
+
+                if (begin >= _pf->m_count)
+                {
+                    break;
+                }
+
+                const uint32_t end = dm::min(begin + _pf->m_grain, _pf->m_count);
+                _pf->m_fn(begin, end, _pf->m_userData);
+            }
+        }
+
+        // Notice: mutex has to be acquired by the caller.
+        ParallelFor* acquireParallel()
+        {
+            for (uint16_t ii = 0; ii < m_numParallel; ++ii)
+            {
+                ParallelFor* pf = m_parallel[ii];
+                if (pf->m_next < pf->m_count)
+                {
+                    pf->m_numRunners++;
+                    return pf;
+                }
+            }
+
+            return NULL;
+        }
+
+        // Notice: mutex has to be acquired by the caller.
+        uint16_t dequeue()
+        {
+            for (uint8_t prio = 0; prio < JobPriority::Count; ++prio)
+            {
+                if (0 != m_queue[prio].m_count)
+                {
+                    const uint16_t idx = m_queue[prio].pop();
+                    m_jobs[idx].m_state = JobState::Running;
+                    return idx;
+                }
+            }
+
+            return UINT16_MAX;
+        }
+
+        void execute(uint16_t _idx)
+        {
+            Job& job = m_jobs[_idx];
+            const int32_t result = job.m_fn(job.m_userData);
+
+            bx::MutexScope lock(m_mutex);
+            job.m_result = result;
+            job.m_state  = JobState::Finished;
+            m_done.push(_idx);
+        }
+
+        static int32_t workerFunc(void* _jobSystem)
+        {
+            JobSystem* js = (JobSystem*)_jobSystem;
+
+            for (;;)
+            {
+                js->m_sem.wait();
+
+                // Process everything available, parallel ranges first as somebody is waiting on them.
+                for (;;)
+                {
+                    uint16_t idx;
+                    ParallelFor* pf;
+                    {
+                        bx::MutexScope lock(js->m_mutex);
+
+                        if (js->m_exit)
+                        {
+                            return EXIT_SUCCESS;
+                        }
+
+                        pf  = js->acquireParallel();
+                        idx = (NULL == pf) ? js->dequeue() : UINT16_MAX;
+                    }
+
+                    if (NULL != pf)
+                    {
+                        js->runParallel(pf);
+
+                        bx::MutexScope lock(js->m_mutex);
+                        pf->m_numRunners--;
+                    }
+                    else if (UINT16_MAX != idx)
+                    {
+                        js->execute(idx);
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        bool          m_exit;
+        uint16_t      m_numParallel;
+        ParallelFor*  m_parallel[MaxParallel];
+        uint16_t      m_numFree;
+        uint16_t      m_free[MaxJobs];
+        Job           m_jobs[MaxJobs];
+        IdxQueue      m_queue[JobPriority::Count];
+        IdxQueue      m_done;
+        bx::Mutex     m_mutex;
+        bx::Semaphore m_sem;
+        bx::Thread    m_workers[MaxWorkers];
+    };
+    static JobSystem s_jobSystem;
+
+    void jobsInit(uint8_t _numWorkers)
+    {
+        s_jobSystem.init(_numWorkers);
+    }
+
+    void jobsShutdown()
+    {
+        s_jobSystem.shutdown();
+    }
+
+    uint16_t jobsUpdate()
+    {
+        return s_jobSystem.update();
+    }
+
+    JobHandle jobSubmit(JobFn _fn, void* _userData, JobPriority::Enum _priority, JobCompleteFn _onComplete, void* _completeUserData)
+    {
+        return s_jobSystem.submit(_fn, _userData, _priority, _onComplete, _completeUserData);
+    }
+
+    bool jobIsDone(JobHandle _handle)
+    {
+        return s_jobSystem.isDone(_handle);
+    }
+
+    void jobWait(JobHandle _handle)
+    {
+        s_jobSystem.wait(_handle);
+    }
+
+    void jobParallelFor(JobRangeFn _fn, void* _userData, uint32_t _count, uint32_t _grain)
+    {
+        s_jobSystem.parallelFor(_fn, _userData, _count, _grain);
+    }
+
+    uint8_t jobsNumWorkers()
+    {
+        return s_jobSystem.m_numWorkers;
+    }
+
+    uint16_t jobsNumPending()
+    {
+        return s_jobSystem.numPending();
+    }
+
+} // namespace cs
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_JOBS_H_HEADER_GUARD
+#define CMFTSTUDIO_JOBS_H_HEADER_GUARD
+
+#include <stdint.h>
+
+namespace cs
+{
+    /// Job slots are reused, generation tells apart jobs that ran in the same slot.
+    struct JobHandle
+    {
+        enum Enum { Invalid = UINT16_MAX };
+        static inline JobHandle invalid()
+        {
+            JobHandle handle = { JobHandle::Invalid, 0 };
+            return handle;
+        }
+        uint16_t m_idx;
+        uint16_t m_generation;
+    };
+    inline bool isValid(JobHandle _handle)
+    {
+        return JobHandle::Invalid != _handle.m_idx;
+    }
+
+    struct JobPriority
+    {
+        enum Enum
+        {
+            High,
+            Normal,
+            Low,
+
+            Count
+        };
+    };
+
+    typedef int32_t (*JobFn)(void* _userData);                             // Executed on a worker thread.
+    typedef void    (*JobCompleteFn)(int32_t _result, void* _userData);    // Executed on the main thread, from jobsUpdate().
+    typedef void    (*JobRangeFn)(uint32_t _begin, uint32_t _end, void* _userData);
+
+    /// Starts worker threads. Passing 0 uses one worker per available cpu core.
+    void      jobsInit(uint8_t _numWorkers = 0);
+    void      jobsShutdown();
+
+    /// Call this once per frame from the main thread. Dispatches completion callbacks of finished jobs.
+    uint16_t  jobsUpdate();
+
+    JobHandle jobSubmit(JobFn _fn
+                      , void* _userData
+                      , JobPriority::Enum _priority = JobPriority::Normal
+                      , JobCompleteFn _onComplete   = NULL
+                      , void* _completeUserData     = NULL
+                      );
+
+    /// Invalid handles and handles of jobs whose slot got reused report done.
+    bool      jobIsDone(JobHandle _handle);
+    void      jobWait(JobHandle _handle);
+
+    /// Splits [0, _count) into ranges of '_grain' elements and runs '_fn' on them using idle workers and the calling thread.
+    /// Returns when all ranges are processed. Safe to call from within a job, does not use job slots.
+    void      jobParallelFor(JobRangeFn _fn, void* _userData, uint32_t _count, uint32_t _grain = 1);
+
+    uint8_t   jobsNumWorkers();
+    uint16_t  jobsNumPending();
+    uint8_t   cpuNumCores();
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_JOBS_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common.h"
+#include "mappedfile.h"
+
+#include <stdlib.h>      // malloc, free
+#include <bx/cpu.h>      // bx::atomicInc, bx::atomicDec
+
+#if BX_PLATFORM_WINDOWS
+#   include <windows.h>  // CreateFileMappingA, MapViewOfFile
+#else
+#   include <fcntl.h>    // open
+#   include <unistd.h>   // close
+#   include <sys/mman.h> // mmap, munmap
+#   include <sys/stat.h> // fstat
+#endif // BX_PLATFORM_WINDOWS
+
+namespace cs
+{
+    struct MappedFile
+    {
+        void* m_data;
+        uint32_t m_size;
+        volatile int32_t m_refs;
+    };
+
+    MappedFile* mappedFileOpen(const char* _path)
+    {
+        void* data = NULL;
+        uint64_t size = 0;
+
+        #if BX_PLATFORM_WINDOWS
+        HANDLE file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (INVALID_HANDLE_VALUE == file)
+        {
+            return NULL;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize))
+        {
+            size = uint64_t(fileSize.QuadPart);
+        }
+
+        if (0 != size && size <= UINT32_MAX)
+        {
+            // Notice: view keeps the mapping alive, both handles can be closed right away.
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (NULL != mapping)
+            {
+                data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        #else
+        const int fd = open(_path, O_RDONLY);
+        if (-1 == fd)
+        {
+            return NULL;
+        }
+
+        struct stat st;
+        if (0 == fstat(fd, &st))
+        {
+            size = uint64_t(st.st_size);
+        }
+
+        if (0 != size && size <= UINT32_MAX)
+        {
+            data = mmap(NULL, size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED == data)
+            {
+                data = NULL;
+            }
+        }
+        close(fd);
+        #endif // BX_PLATFORM_WINDOWS
+
+        if (NULL == data)
+        {
+            return NULL;
+        }
+
+        // Notice: released from bgfx render thread too, not tied to any of the app allocators.
+        MappedFile* mapped = (MappedFile*)malloc(sizeof(MappedFile));
+        mapped->m_data = data;
+        mapped->m_size = uint32_t(size);
+        mapped->m_refs = 1;
+
+        return mapped;
+    }
+
+    const void* mappedFileData(const MappedFile* _file)
+    {
+        return _file->m_data;
+    }
+
+    uint32_t mappedFileSize(const MappedFile* _file)
+    {
+        return _file->m_size;
+    }
+
+    void mappedFileAcquire(MappedFile* _file)
+    {
+        bx::atomicInc(&_file->m_refs);
+    }
+
+    void mappedFileRelease(MappedFile* _file)
+    {
+        if (0 != bx::atomicDec(&_file->m_refs))
+        {
+            return;
+        }
+
+        #if BX_PLATFORM_WINDOWS
+        UnmapViewOfFile(_file->m_data);
+        #else
+        munmap(_file->m_data, _file->m_size);
+        #endif // BX_PLATFORM_WINDOWS
+
+        free(_file);
+    }
+
+    void mappedFileReleaseFn(void* _ptr, void* _userData)
+    {
+        BX_UNUSED(_ptr);
+        mappedFileRelease((MappedFile*)_userData);
+    }
+
+} // namespace cs
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_MAPPEDFILE_H_HEADER_GUARD
+#define CMFTSTUDIO_MAPPEDFILE_H_HEADER_GUARD
+
+#include <stdint.h>
+
+namespace cs
+{
+    /// Read-only memory mapped file. Reference counted, mapping is closed when the last reference is released.
+    struct MappedFile;
+
+    /// Maps the whole file at '_path'. Returns NULL if the file cannot be opened, is empty or bigger than 4GB.
+    /// Returned file holds one reference.
+    MappedFile* mappedFileOpen(const char* _path);
+
+    const void* mappedFileData(const MappedFile* _file);
+    uint32_t    mappedFileSize(const MappedFile* _file);
+
+    /// Thread safe.
+    void mappedFileAcquire(MappedFile* _file);
+    void mappedFileRelease(MappedFile* _file);
+
+    /// Matches bgfx::ReleaseFn, releases reference passed as '_userData'. Used with bgfx::makeRef().
+    void mappedFileReleaseFn(void* _ptr, void* _userData);
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_MAPPEDFILE_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
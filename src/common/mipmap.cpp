@@ -0,0 +1,287 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common.h"
+#include "mipmap.h"
+
+#include <math.h>          // powf, sinf, sqrtf
+#include <string.h>        // memcpy
+#include <dm/misc.h>       // dm::min, dm::max, DM_CLAMP
+
+#include "jobs.h"          // cs::jobParallelFor
+#include "simd.h"
+
+namespace cs
+{
+    struct MipTables
+    {
+        enum
+        {
+            BoxTaps    = 2,
+            KaiserTaps = 8,
+        };
+
+        MipTables()
+        {
+            for (uint32_t ii = 0; ii < 256; ++ii)
+            {
+                m_toLinear[ii] = powf(float(ii)/255.0f, 2.2f);
+            }
+
+            m_box[0] = 0.5f;
+            m_box[1] = 0.5f;
+
+            // Taps are at source texel centers, -3.5 to 3.5 source texels from the destination texel center.
+            // Filter is evaluated in destination texel units, window half width is 2 destination texels.
+            const float beta = 4.0f;
+            float sum = 0.0f;
+            for (uint32_t ii = 0; ii < KaiserTaps; ++ii)
+            {
+                const float tt = (float(ii) - 3.5f)*0.5f;
+                const float pt = tt*3.14159265f;
+                const float sinc = sinf(pt)/pt;
+                const float ww = tt*0.5f;
+                const float window = besselI0(beta*sqrtf(1.0f - ww*ww))/besselI0(beta);
+
+                m_kaiser[ii] = sinc*window;
+                sum += m_kaiser[ii];
+            }
+
+            for (uint32_t ii = 0; ii < KaiserTaps; ++ii)
+            {
+                m_kaiser[ii] /= sum;
+            }
+        }
+
+        static float besselI0(float _x)
+        {
+            float sum  = 1.0f;
+            float term = 1.0f;
+            for (uint32_t kk = 1; kk < 32; ++kk)
+            {
+                const float half = _x/(2.0f*float(kk));
+                term *= half*half;
+                sum  += term;
+            }
+
+            return sum;
+        }
+
+        float m_toLinear[256];
+        float m_box[BoxTaps];
+        float m_kaiser[KaiserTaps];
+    };
+    static const MipTables s_mipTables;
+
+    struct MipLevelData
+    {
+        uint8_t*       m_dst;
+        const uint8_t* m_src;
+        uint32_t       m_srcWidth;
+        uint32_t       m_srcHeight;
+        uint32_t       m_dstWidth;
+        const float*   m_weights;
+        uint32_t       m_numTaps;
+        MipContent::Enum m_content;
+        bx::AllocatorI*  m_allocator;
+    };
+
+    static void mipDecodeRow(float* _dst, const uint8_t* _src, uint32_t _width, MipContent::Enum _content)
+    {
+        const float* toLinear = s_mipTables.m_toLinear;
+
+        for (uint32_t xx = 0; xx < _width; ++xx, _dst += 4, _src += 4)
+        {
+            switch (_content)
+            {
+            case MipContent::Srgb:
+                _dst[0] = toLinear[_src[0]];
+                _dst[1] = toLinear[_src[1]];
+                _dst[2] = toLinear[_src[2]];
+            break;
+            case MipContent::Normal:
+                _dst[0] = float(_src[0])*(2.0f/255.0f) - 1.0f;
+                _dst[1] = float(_src[1])*(2.0f/255.0f) - 1.0f;
+                _dst[2] = float(_src[2])*(2.0f/255.0f) - 1.0f;
+            break;
+            default:
+                _dst[0] = float(_src[0])*(1.0f/255.0f);
+                _dst[1] = float(_src[1])*(1.0f/255.0f);
+                _dst[2] = float(_src[2])*(1.0f/255.0f);
+            break;
+            }
+
+            _dst[3] = float(_src[3])*(1.0f/255.0f);
+        }
+    }
+
+    static inline void mipEncodeTexel(uint8_t* _dst, Simd4f _value, MipContent::Enum _content)
+    {
+        float rgba[4];
+
+        if (MipContent::Srgb == _content)
+        {
+            _value = simdSelectRgb(simdPow(_value, simdSplat(1.0f/2.2f)), _value);
+            simdStore(rgba, _value);
+        }
+        else if (MipContent::Normal == _content)
+        {
+            simdStore(rgba, _value);
+
+            const float lenSq = rgba[0]*rgba[0] + rgba[1]*rgba[1] + rgba[2]*rgba[2];
+            if (lenSq > 1e-12f)
+            {
+                const float invLen = 1.0f/sqrtf(lenSq);
+                rgba[0] *= invLen;
+                rgba[1] *= invLen;
+                rgba[2] *= invLen;
+            }
+            else
+            {
+                rgba[0] = 0.0f;
+                rgba[1] = 0.0f;
+                rgba[2] = 1.0f;
+            }
+
+            rgba[0] = rgba[0]*0.5f + 0.5f;
+            rgba[1] = rgba[1]*0.5f + 0.5f;
+            rgba[2] = rgba[2]*0.5f + 0.5f;
+        }
+        else
+        {
+            simdStore(rgba, _value);
+        }
+
+        for (uint8_t ch = 0; ch < 4; ++ch)
+        {
+            _dst[ch] = uint8_t(DM_CLAMP(rgba[ch], 0.0f, 1.0f)*255.0f + 0.5f);
+        }
+    }
+
+    static void mipDownsampleRows(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const MipLevelData& data = *(const MipLevelData*)_userData;
+
+        const uint32_t numTaps  = data.m_numTaps;
+        const int32_t  firstTap = 1 - int32_t(numTaps/2);
+        const int32_t  lastCol  = int32_t(data.m_srcWidth)  - 1;
+        const int32_t  lastRow  = int32_t(data.m_srcHeight) - 1;
+        const uint32_t dstWidth = data.m_dstWidth;
+
+        // Horizontally filtered source rows are kept in a ring, slot is the unclamped row index modulo numTaps.
+        // Consecutive destination rows share numTaps-2 source rows, only two new ones are filtered per row.
+        float* decoded = (float*)BX_ALLOC(data.m_allocator, (data.m_srcWidth + numTaps*dstWidth)*4*sizeof(float));
+        float* ring    = decoded + data.m_srcWidth*4;
+
+        int32_t nextRow = INT32_MIN;
+        for (uint32_t yy = _begin; yy < _end; ++yy)
+        {
+            const int32_t first = int32_t(yy*2) + firstTap;
+            for (int32_t row = dm::max(first, nextRow); row < first + int32_t(numTaps); ++row)
+            {
+                // Edges are clamped.
+                const int32_t srcRow = DM_CLAMP(row, 0, lastRow);
+                mipDecodeRow(decoded, data.m_src + srcRow*data.m_srcWidth*4, data.m_srcWidth, data.m_content);
+
+                float* filtered = ring + ((row + int32_t(numTaps))%numTaps)*dstWidth*4;
+                for (uint32_t xx = 0; xx < dstWidth; ++xx)
+                {
+                    const int32_t firstCol = int32_t(xx*2) + firstTap;
+
+                    Simd4f acc = simdZero();
+                    for (uint32_t tt = 0; tt < numTaps; ++tt)
+                    {
+                        const int32_t col = DM_CLAMP(firstCol + int32_t(tt), 0, lastCol);
+                        acc = simdMadd(simdLoad(&decoded[col*4]), simdSplat(data.m_weights[tt]), acc);
+                    }
+                    simdStore(&filtered[xx*4], acc);
+                }
+            }
+            nextRow = first + int32_t(numTaps);
+
+            uint8_t* dst = data.m_dst + yy*dstWidth*4;
+            for (uint32_t xx = 0; xx < dstWidth; ++xx)
+            {
+                Simd4f acc = simdZero();
+                for (uint32_t tt = 0; tt < numTaps; ++tt)
+                {
+                    const float* filtered = ring + ((first + int32_t(tt) + int32_t(numTaps))%numTaps)*dstWidth*4;
+                    acc = simdMadd(simdLoad(&filtered[xx*4]), simdSplat(data.m_weights[tt]), acc);
+                }
+
+                mipEncodeTexel(&dst[xx*4], acc, data.m_content);
+            }
+        }
+
+        BX_FREE(data.m_allocator, decoded);
+    }
+
+    uint8_t mipNumLevels(uint32_t _width, uint32_t _height)
+    {
+        uint8_t numMips = 1;
+        for (uint32_t size = dm::max(_width, _height); size > 1; size /= 2)
+        {
+            ++numMips;
+        }
+
+        return numMips;
+    }
+
+    uint32_t mipChainRgba8(void*& _mips
+                         , const uint8_t* _src
+                         , uint32_t _width
+                         , uint32_t _height
+                         , MipFilter::Enum _filter
+                         , MipContent::Enum _content
+                         , bx::AllocatorI* _allocator
+                         )
+    {
+        const uint8_t numMips = mipNumLevels(_width, _height);
+
+        uint32_t size = 0;
+        for (uint32_t mip = 0, ww = _width, hh = _height; mip < numMips; ++mip)
+        {
+            size += ww*hh*4;
+            ww = dm::max(ww/2, uint32_t(1));
+            hh = dm::max(hh/2, uint32_t(1));
+        }
+
+        uint8_t* mips = (uint8_t*)BX_ALLOC(_allocator, size);
+        memcpy(mips, _src, _width*_height*4);
+
+        MipLevelData data;
+        data.m_weights   = (MipFilter::Kaiser == _filter) ? s_mipTables.m_kaiser : s_mipTables.m_box;
+        data.m_numTaps   = (MipFilter::Kaiser == _filter) ? uint32_t(MipTables::KaiserTaps) : uint32_t(MipTables::BoxTaps);
+        data.m_content   = _content;
+        data.m_allocator = _allocator;
+
+        uint8_t* level = mips;
+        for (uint32_t mip = 1, ww = _width, hh = _height; mip < numMips; ++mip)
+        {
+            const uint32_t dstWidth  = dm::max(ww/2, uint32_t(1));
+            const uint32_t dstHeight = dm::max(hh/2, uint32_t(1));
+
+            // Notice: odd sizes drop the last source row/column for the box filter, kernel centers stay at 2x+1.
+            data.m_src       = level;
+            data.m_dst       = level + ww*hh*4;
+            data.m_srcWidth  = ww;
+            data.m_srcHeight = hh;
+            data.m_dstWidth  = dstWidth;
+
+            // Each range filters numTaps extra source rows to fill the ring, keep ranges long enough.
+            jobParallelFor(mipDownsampleRows, (void*)&data, dstHeight, dm::max(uint32_t(32768)/dstWidth, uint32_t(8)));
+
+            level = data.m_dst;
+            ww = dstWidth;
+            hh = dstHeight;
+        }
+
+        _mips = mips;
+        return size;
+    }
+
+} // namespace cs
+
+/* vim: set sw=4 ts=4 expandtab: */
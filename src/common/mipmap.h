@@ -0,0 +1,57 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_MIPMAP_H_HEADER_GUARD
+#define CMFTSTUDIO_MIPMAP_H_HEADER_GUARD
+
+#include <stdint.h>
+
+namespace bx { struct AllocatorI; }
+
+namespace cs
+{
+    struct MipFilter
+    {
+        enum Enum
+        {
+            Box,    // 2x2 average.
+            Kaiser, // Kaiser windowed sinc, 8x8 taps. Keeps more detail, slight ringing on hard edges.
+
+            Count
+        };
+    };
+
+    struct MipContent
+    {
+        enum Enum
+        {
+            Linear, // Data, filtered as is.
+            Srgb,   // Color, rgb filtered in linear space (gamma 2.2, same as toLinear() in shaders).
+            Normal, // Tangent space normal, xyz renormalized after filtering.
+
+            Count
+        };
+    };
+
+    /// Number of mip levels of a full chain, down to 1x1.
+    uint8_t mipNumLevels(uint32_t _width, uint32_t _height);
+
+    /// Builds full mip chain of RGBA8 '_src'. Levels are stored one after another starting with a copy of '_src', as expected by
+    /// bgfx::createTexture2D(). Each level is filtered from the previous one, destination rows are split between job system workers
+    /// and texels are processed as four channel vectors. Chain is allocated from '_allocator' and written to '_mips', returns its size.
+    uint32_t mipChainRgba8(void*& _mips
+                         , const uint8_t* _src
+                         , uint32_t _width
+                         , uint32_t _height
+                         , MipFilter::Enum _filter
+                         , MipContent::Enum _content
+                         , bx::AllocatorI* _allocator
+                         );
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_MIPMAP_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
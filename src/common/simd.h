@@ -0,0 +1,178 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_SIMD_H_HEADER_GUARD
+#define CMFTSTUDIO_SIMD_H_HEADER_GUARD
+
+#include <stdint.h>
+#include <math.h>           // powf, sqrtf, atan2f
+#include <bx/platform.h>    // BX_CPU_X86, BX_ARCH_64BIT
+
+#ifndef CS_SIMD_SSE
+#   if BX_CPU_X86 && (BX_ARCH_64BIT || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#       define CS_SIMD_SSE 1
+#   else
+#       define CS_SIMD_SSE 0
+#   endif
+#endif // CS_SIMD_SSE
+
+#if CS_SIMD_SSE
+#   include <emmintrin.h>
+#endif // CS_SIMD_SSE
+
+namespace cs
+{
+    // Four float lanes, rgba order. Falls back to scalar code where sse2 is not available.
+    //-----
+
+#if CS_SIMD_SSE
+    typedef __m128 Simd4f;
+
+    static inline Simd4f simdLoad(const float* _ptr)               { return _mm_loadu_ps(_ptr);                 }
+    static inline void   simdStore(float* _ptr, Simd4f _a)         { _mm_storeu_ps(_ptr, _a);                   }
+    static inline Simd4f simdSet(float _x, float _y, float _z, float _w) { return _mm_setr_ps(_x, _y, _z, _w);  }
+    static inline Simd4f simdSplat(float _a)                       { return _mm_set1_ps(_a);                    }
+    static inline Simd4f simdZero()                                { return _mm_setzero_ps();                   }
+    static inline Simd4f simdAdd(Simd4f _a, Simd4f _b)             { return _mm_add_ps(_a, _b);                 }
+    static inline Simd4f simdSub(Simd4f _a, Simd4f _b)             { return _mm_sub_ps(_a, _b);                 }
+    static inline Simd4f simdMul(Simd4f _a, Simd4f _b)             { return _mm_mul_ps(_a, _b);                 }
+    static inline Simd4f simdDiv(Simd4f _a, Simd4f _b)             { return _mm_div_ps(_a, _b);                 }
+    static inline Simd4f simdMin(Simd4f _a, Simd4f _b)             { return _mm_min_ps(_a, _b);                 }
+    static inline Simd4f simdMax(Simd4f _a, Simd4f _b)             { return _mm_max_ps(_a, _b);                 }
+    static inline Simd4f simdMadd(Simd4f _a, Simd4f _b, Simd4f _c) { return _mm_add_ps(_mm_mul_ps(_a, _b), _c); }
+
+    /// Returns rgb from '_rgb' and alpha from '_a'.
+    static inline Simd4f simdSelectRgb(Simd4f _rgb, Simd4f _a)
+    {
+        const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        return _mm_or_ps(_mm_and_ps(mask, _rgb), _mm_andnot_ps(mask, _a));
+    }
+
+    static inline float simdX(Simd4f _a) { return _mm_cvtss_f32(_a); }
+    static inline Simd4f simdSqrt(Simd4f _a) { return _mm_sqrt_ps(_a); }
+
+    /// Approximation of atan2(), absolute error ~2e-6 radians.
+    static inline Simd4f simdAtan2(Simd4f _y, Simd4f _x)
+    {
+        const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(int32_t(0x80000000)));
+        const __m128 ax   = _mm_andnot_ps(sign, _x);
+        const __m128 ay   = _mm_andnot_ps(sign, _y);
+        const __m128 aa   = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1.0e-30f)));
+        const __m128 ss   = _mm_mul_ps(aa, aa);
+
+        // Polynomial fit of atan(a) on [0,1].
+        __m128 rr = _mm_set1_ps(-0.01172120f);
+        rr = _mm_add_ps(_mm_mul_ps(rr, ss), _mm_set1_ps( 0.05265332f));
+        rr = _mm_add_ps(_mm_mul_ps(rr, ss), _mm_set1_ps(-0.11643287f));
+        rr = _mm_add_ps(_mm_mul_ps(rr, ss), _mm_set1_ps( 0.19354346f));
+        rr = _mm_add_ps(_mm_mul_ps(rr, ss), _mm_set1_ps(-0.33262347f));
+        rr = _mm_add_ps(_mm_mul_ps(rr, ss), _mm_set1_ps( 0.99997726f));
+        rr = _mm_mul_ps(rr, aa);
+
+        // Map back to the full circle.
+        const __m128 swap = _mm_cmpgt_ps(ay, ax);
+        rr = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(1.57079633f), rr)), _mm_andnot_ps(swap, rr));
+        const __m128 negx = _mm_cmplt_ps(_x, _mm_setzero_ps());
+        rr = _mm_or_ps(_mm_and_ps(negx, _mm_sub_ps(_mm_set1_ps(3.14159265f), rr)), _mm_andnot_ps(negx, rr));
+
+        return _mm_xor_ps(rr, _mm_and_ps(sign, _y));
+    }
+
+    /// Approximation of log2(), relative error ~1e-4. Valid for positive normalized input.
+    static inline Simd4f simdLog2(Simd4f _a)
+    {
+        const __m128i exp      = _mm_set1_epi32(0x7f800000);
+        const __m128i mant     = _mm_set1_epi32(0x007fffff);
+        const __m128  one      = _mm_set1_ps(1.0f);
+        const __m128i ai       = _mm_castps_si128(_a);
+        const __m128  ee       = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_and_si128(ai, exp), 23), _mm_set1_epi32(127)));
+        const __m128  mm       = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(ai, mant)), one);
+
+        // Polynomial fit of log2(m)/(m-1) on [1,2).
+        __m128 pp = _mm_set1_ps(-3.4436006e-2f);
+        pp = _mm_add_ps(_mm_mul_ps(pp, mm), _mm_set1_ps( 3.1821337e-1f));
+        pp = _mm_add_ps(_mm_mul_ps(pp, mm), _mm_set1_ps(-1.2315303f   ));
+        pp = _mm_add_ps(_mm_mul_ps(pp, mm), _mm_set1_ps( 2.5988452f   ));
+        pp = _mm_add_ps(_mm_mul_ps(pp, mm), _mm_set1_ps(-3.3241990f   ));
+        pp = _mm_add_ps(_mm_mul_ps(pp, mm), _mm_set1_ps( 3.1157899f   ));
+
+        return _mm_add_ps(_mm_mul_ps(pp, _mm_sub_ps(mm, one)), ee);
+    }
+
+    /// Approximation of exp2(), relative error ~2e-5. Input is clamped to [-126, 127].
+    static inline Simd4f simdExp2(Simd4f _a)
+    {
+        const __m128  xx = _mm_min_ps(_mm_max_ps(_a, _mm_set1_ps(-126.99999f)), _mm_set1_ps(127.0f));
+        const __m128i ii = _mm_cvtps_epi32(_mm_sub_ps(xx, _mm_set1_ps(0.5f)));
+        const __m128  ff = _mm_sub_ps(xx, _mm_cvtepi32_ps(ii));
+        const __m128  ei = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(ii, _mm_set1_epi32(127)), 23));
+
+        // Polynomial fit of exp2(f) on [0,1).
+        __m128 pp = _mm_set1_ps(1.8775767e-3f);
+        pp = _mm_add_ps(_mm_mul_ps(pp, ff), _mm_set1_ps(8.9893397e-3f));
+        pp = _mm_add_ps(_mm_mul_ps(pp, ff), _mm_set1_ps(5.5826318e-2f));
+        pp = _mm_add_ps(_mm_mul_ps(pp, ff), _mm_set1_ps(2.4015361e-1f));
+        pp = _mm_add_ps(_mm_mul_ps(pp, ff), _mm_set1_ps(6.9315308e-1f));
+        pp = _mm_add_ps(_mm_mul_ps(pp, ff), _mm_set1_ps(9.9999994e-1f));
+
+        return _mm_mul_ps(pp, ei);
+    }
+
+    /// pow() for non-negative input. Zero and negative input returns zero.
+    static inline Simd4f simdPow(Simd4f _a, Simd4f _exp)
+    {
+        const __m128 positive = _mm_cmpgt_ps(_a, _mm_set1_ps(1.0e-30f));
+        const __m128 result   = simdExp2(_mm_mul_ps(simdLog2(_mm_max_ps(_a, _mm_set1_ps(1.0e-30f))), _exp));
+        return _mm_and_ps(positive, result);
+    }
+#else
+    struct Simd4f { float x, y, z, w; };
+
+    static inline Simd4f simdSet(float _x, float _y, float _z, float _w) { const Simd4f result = { _x, _y, _z, _w }; return result; }
+    static inline Simd4f simdLoad(const float* _ptr)               { return simdSet(_ptr[0], _ptr[1], _ptr[2], _ptr[3]); }
+    static inline void   simdStore(float* _ptr, Simd4f _a)         { _ptr[0] = _a.x; _ptr[1] = _a.y; _ptr[2] = _a.z; _ptr[3] = _a.w; }
+    static inline Simd4f simdSplat(float _a)                       { return simdSet(_a, _a, _a, _a); }
+    static inline Simd4f simdZero()                                { return simdSplat(0.0f); }
+    static inline Simd4f simdAdd(Simd4f _a, Simd4f _b)             { return simdSet(_a.x+_b.x, _a.y+_b.y, _a.z+_b.z, _a.w+_b.w); }
+    static inline Simd4f simdSub(Simd4f _a, Simd4f _b)             { return simdSet(_a.x-_b.x, _a.y-_b.y, _a.z-_b.z, _a.w-_b.w); }
+    static inline Simd4f simdMul(Simd4f _a, Simd4f _b)             { return simdSet(_a.x*_b.x, _a.y*_b.y, _a.z*_b.z, _a.w*_b.w); }
+    static inline Simd4f simdDiv(Simd4f _a, Simd4f _b)             { return simdSet(_a.x/_b.x, _a.y/_b.y, _a.z/_b.z, _a.w/_b.w); }
+    static inline Simd4f simdMadd(Simd4f _a, Simd4f _b, Simd4f _c) { return simdAdd(simdMul(_a, _b), _c); }
+    static inline float  simdX(Simd4f _a)                          { return _a.x; }
+    static inline Simd4f simdSqrt(Simd4f _a)                       { return simdSet(sqrtf(_a.x), sqrtf(_a.y), sqrtf(_a.z), sqrtf(_a.w)); }
+
+    static inline Simd4f simdAtan2(Simd4f _y, Simd4f _x)
+    {
+        return simdSet(atan2f(_y.x, _x.x), atan2f(_y.y, _x.y), atan2f(_y.z, _x.z), atan2f(_y.w, _x.w));
+    }
+
+    static inline Simd4f simdMin(Simd4f _a, Simd4f _b)
+    {
+        return simdSet(_a.x < _b.x ? _a.x : _b.x, _a.y < _b.y ? _a.y : _b.y, _a.z < _b.z ? _a.z : _b.z, _a.w < _b.w ? _a.w : _b.w);
+    }
+
+    static inline Simd4f simdMax(Simd4f _a, Simd4f _b)
+    {
+        return simdSet(_a.x > _b.x ? _a.x : _b.x, _a.y > _b.y ? _a.y : _b.y, _a.z > _b.z ? _a.z : _b.z, _a.w > _b.w ? _a.w : _b.w);
+    }
+
+    static inline Simd4f simdSelectRgb(Simd4f _rgb, Simd4f _a)
+    {
+        return simdSet(_rgb.x, _rgb.y, _rgb.z, _a.w);
+    }
+
+    static inline Simd4f simdPow(Simd4f _a, Simd4f _exp)
+    {
+        #define CS_POW(_x, _y) ((_x) > 0.0f ? powf(_x, _y) : 0.0f)
+        return simdSet(CS_POW(_a.x, _exp.x), CS_POW(_a.y, _exp.y), CS_POW(_a.z, _exp.z), CS_POW(_a.w, _exp.w));
+        #undef CS_POW
+    }
+#endif // CS_SIMD_SSE
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_SIMD_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
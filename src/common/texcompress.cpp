@@ -0,0 +1,374 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common.h"
+#include "texcompress.h"
+
+#include <string.h>        // memset, memcpy
+#include <dm/misc.h>       // dm::min, dm::max
+
+#include "jobs.h"          // cs::jobParallelFor
+#include "simd.h"
+
+namespace cs
+{
+    // Block encoders.
+    //-----
+
+    // Fetches 4x4 RGBA8 block at block coordinates, edge texels are repeated for sizes not divisible by 4.
+    static inline void fetchBlock(uint8_t _block[64], const uint8_t* _src, uint32_t _width, uint32_t _height, uint32_t _bx, uint32_t _by)
+    {
+        for (uint32_t yy = 0; yy < 4; ++yy)
+        {
+            const uint32_t sy = dm::min(_by*4+yy, _height-1);
+            for (uint32_t xx = 0; xx < 4; ++xx)
+            {
+                const uint32_t sx = dm::min(_bx*4+xx, _width-1);
+                memcpy(&_block[(yy*4+xx)*4], &_src[(sy*_width+sx)*4], 4);
+            }
+        }
+    }
+
+    static inline uint16_t to565(float _r, float _g, float _b)
+    {
+        const uint32_t rr = uint32_t(DM_CLAMP(_r*(31.0f/255.0f) + 0.5f, 0.0f, 31.0f));
+        const uint32_t gg = uint32_t(DM_CLAMP(_g*(63.0f/255.0f) + 0.5f, 0.0f, 63.0f));
+        const uint32_t bb = uint32_t(DM_CLAMP(_b*(31.0f/255.0f) + 0.5f, 0.0f, 31.0f));
+        return uint16_t((rr<<11) | (gg<<5) | bb);
+    }
+
+    static inline void from565(float _rgb[3], uint16_t _color)
+    {
+        const uint32_t rr = (_color>>11)&0x1f;
+        const uint32_t gg = (_color>>5) &0x3f;
+        const uint32_t bb = (_color)    &0x1f;
+        _rgb[0] = float((rr<<3) | (rr>>2));
+        _rgb[1] = float((gg<<2) | (gg>>4));
+        _rgb[2] = float((bb<<3) | (bb>>2));
+    }
+
+    // Selects palette position along [_min, _max] for 16 values, four at a time. Results are in [0, _numSteps].
+    static inline void blockPositions(uint32_t _pos[16]
+                                    , const float* _rr, const float* _gg, const float* _bb
+                                    , const float _min[3], const float _dir[3], float _scale
+                                    )
+    {
+        const Simd4f minR = simdSplat(_min[0]);
+        const Simd4f minG = simdSplat(_min[1]);
+        const Simd4f minB = simdSplat(_min[2]);
+        const Simd4f dirR = simdSplat(_dir[0]*_scale);
+        const Simd4f dirG = simdSplat(_dir[1]*_scale);
+        const Simd4f dirB = simdSplat(_dir[2]*_scale);
+        const Simd4f half = simdSplat(0.5f);
+        const Simd4f zero = simdZero();
+
+        for (uint32_t ii = 0; ii < 16; ii += 4)
+        {
+            Simd4f tt = simdMadd(simdSub(simdLoad(&_rr[ii]), minR), dirR, half);
+            tt = simdMadd(simdSub(simdLoad(&_gg[ii]), minG), dirG, tt);
+            tt = simdMadd(simdSub(simdLoad(&_bb[ii]), minB), dirB, tt);
+            tt = simdMax(tt, zero);
+
+            float pos[4];
+            simdStore(pos, tt);
+            _pos[ii+0] = uint32_t(pos[0]);
+            _pos[ii+1] = uint32_t(pos[1]);
+            _pos[ii+2] = uint32_t(pos[2]);
+            _pos[ii+3] = uint32_t(pos[3]);
+        }
+    }
+
+    // Color block, always in four color mode.
+    static void encodeBc1(uint8_t _dst[8], const uint8_t _block[64])
+    {
+        float rr[16], gg[16], bb[16];
+        float min[3] = { 255.0f, 255.0f, 255.0f };
+        float max[3] = {   0.0f,   0.0f,   0.0f };
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint32_t ii = 0; ii < 16; ++ii)
+        {
+            rr[ii] = float(_block[ii*4+0]);
+            gg[ii] = float(_block[ii*4+1]);
+            bb[ii] = float(_block[ii*4+2]);
+
+            min[0] = dm::min(min[0], rr[ii]); max[0] = dm::max(max[0], rr[ii]); mean[0] += rr[ii];
+            min[1] = dm::min(min[1], gg[ii]); max[1] = dm::max(max[1], gg[ii]); mean[1] += gg[ii];
+            min[2] = dm::min(min[2], bb[ii]); max[2] = dm::max(max[2], bb[ii]); mean[2] += bb[ii];
+        }
+
+        // Pick the bounding box diagonal which follows red/green and blue/green correlation.
+        float covRg = 0.0f;
+        float covBg = 0.0f;
+        for (uint32_t ii = 0; ii < 16; ++ii)
+        {
+            const float dg = gg[ii] - mean[1]*(1.0f/16.0f);
+            covRg += (rr[ii] - mean[0]*(1.0f/16.0f))*dg;
+            covBg += (bb[ii] - mean[2]*(1.0f/16.0f))*dg;
+        }
+        if (covRg < 0.0f) { const float tmp = min[0]; min[0] = max[0]; max[0] = tmp; }
+        if (covBg < 0.0f) { const float tmp = min[2]; min[2] = max[2]; max[2] = tmp; }
+
+        // Inset endpoints by 1/16 of the range, extremes are reached by the interpolated colors anyway.
+        for (uint32_t ch = 0; ch < 3; ++ch)
+        {
+            const float inset = (max[ch] - min[ch])*(1.0f/16.0f);
+            max[ch] -= inset;
+            min[ch] += inset;
+        }
+
+        uint16_t c0 = to565(max[0], max[1], max[2]);
+        uint16_t c1 = to565(min[0], min[1], min[2]);
+        if (c0 < c1)
+        {
+            const uint16_t tmp = c0; c0 = c1; c1 = tmp;
+        }
+
+        _dst[0] = uint8_t(c0);
+        _dst[1] = uint8_t(c0>>8);
+        _dst[2] = uint8_t(c1);
+        _dst[3] = uint8_t(c1>>8);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            float e0[3];
+            float e1[3];
+            from565(e0, c0);
+            from565(e1, c1);
+
+            const float dir[3] = { e0[0]-e1[0], e0[1]-e1[1], e0[2]-e1[2] };
+            const float lenSq  = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+
+            uint32_t pos[16];
+            blockPositions(pos, rr, gg, bb, e1, dir, 3.0f/lenSq);
+
+            // Position 0 is c1, 3 is c0, in between are 1/3 and 2/3 blends.
+            static const uint32_t s_code[4] = { 1, 3, 2, 0 };
+            for (uint32_t ii = 0; ii < 16; ++ii)
+            {
+                indices |= s_code[dm::min(pos[ii], uint32_t(3))] << (ii*2);
+            }
+        }
+
+        _dst[4] = uint8_t(indices);
+        _dst[5] = uint8_t(indices>>8);
+        _dst[6] = uint8_t(indices>>16);
+        _dst[7] = uint8_t(indices>>24);
+    }
+
+    // Single channel block, '_channel' selects rgba component. Always in eight value mode.
+    static void encodeBc4(uint8_t _dst[8], const uint8_t _block[64], uint32_t _channel)
+    {
+        float vv[16];
+        uint8_t min = 255;
+        uint8_t max = 0;
+        for (uint32_t ii = 0; ii < 16; ++ii)
+        {
+            const uint8_t value = _block[ii*4+_channel];
+            vv[ii] = float(value);
+            min = dm::min(min, value);
+            max = dm::max(max, value);
+        }
+
+        _dst[0] = max;
+        _dst[1] = min;
+
+        uint64_t indices = 0;
+        if (min != max)
+        {
+            const float zero[3] = { float(min), 0.0f, 0.0f };
+            const float dir[3]  = { 1.0f,       0.0f, 0.0f };
+
+            uint32_t pos[16];
+            blockPositions(pos, vv, vv, vv, zero, dir, 7.0f/float(max-min));
+
+            // Position 0 is min (code 1), 7 is max (code 0), codes 2-7 go from max towards min.
+            for (uint32_t ii = 0; ii < 16; ++ii)
+            {
+                const uint32_t pp = dm::min(pos[ii], uint32_t(7));
+                const uint64_t code = (7 == pp) ? 0 : (0 == pp) ? 1 : 8-pp;
+                indices |= code << (ii*3);
+            }
+        }
+
+        for (uint32_t ii = 0; ii < 6; ++ii)
+        {
+            _dst[2+ii] = uint8_t(indices>>(ii*8));
+        }
+    }
+
+    struct BlockFormat
+    {
+        enum Enum
+        {
+            BC1,
+            BC3,
+            BC4,
+            BC5,
+        };
+    };
+
+    struct EncodeData
+    {
+        uint8_t*       m_dst;
+        const uint8_t* m_src;
+        uint32_t       m_width;
+        uint32_t       m_height;
+        uint32_t       m_blocksX;
+        uint32_t       m_blockSize;
+        BlockFormat::Enum m_format;
+    };
+
+    static void encodeBlockRows(uint32_t _begin, uint32_t _end, void* _userData)
+    {
+        const EncodeData& data = *(const EncodeData*)_userData;
+
+        uint8_t block[64];
+        for (uint32_t by = _begin; by < _end; ++by)
+        {
+            uint8_t* dst = data.m_dst + by*data.m_blocksX*data.m_blockSize;
+            for (uint32_t bx = 0; bx < data.m_blocksX; ++bx, dst += data.m_blockSize)
+            {
+                fetchBlock(block, data.m_src, data.m_width, data.m_height, bx, by);
+
+                switch (data.m_format)
+                {
+                case BlockFormat::BC1: encodeBc1(dst, block);                                 break;
+                case BlockFormat::BC3: encodeBc4(dst, block, 3); encodeBc1(dst+8, block);     break;
+                case BlockFormat::BC4: encodeBc4(dst, block, 0);                              break;
+                case BlockFormat::BC5: encodeBc4(dst, block, 0); encodeBc4(dst+8, block, 1);  break;
+                }
+            }
+        }
+    }
+
+    // DDS.
+    //-----
+
+    #define CS_DDS_FOURCC(_a, _b, _c, _d) (uint32_t(_a) | (uint32_t(_b)<<8) | (uint32_t(_c)<<16) | (uint32_t(_d)<<24))
+
+    enum
+    {
+        DdsHeaderSize = 128, // Magic and DDS_HEADER.
+
+        DDSD_CAPS         = 0x00000001,
+        DDSD_HEIGHT       = 0x00000002,
+        DDSD_WIDTH        = 0x00000004,
+        DDSD_PIXELFORMAT  = 0x00001000,
+        DDSD_MIPMAPCOUNT  = 0x00020000,
+        DDSD_LINEARSIZE   = 0x00080000,
+        DDPF_FOURCC       = 0x00000004,
+        DDSCAPS_COMPLEX   = 0x00000008,
+        DDSCAPS_TEXTURE   = 0x00001000,
+        DDSCAPS_MIPMAP    = 0x00400000,
+    };
+
+    static void ddsWriteHeader(uint8_t* _dst, uint32_t _width, uint32_t _height, uint32_t _numMips, uint32_t _topLevelSize, BlockFormat::Enum _format)
+    {
+        static const uint32_t s_fourcc[] =
+        {
+            CS_DDS_FOURCC('D', 'X', 'T', '1'), // BC1
+            CS_DDS_FOURCC('D', 'X', 'T', '5'), // BC3
+            CS_DDS_FOURCC('A', 'T', 'I', '1'), // BC4
+            CS_DDS_FOURCC('A', 'T', 'I', '2'), // BC5
+        };
+
+        uint32_t header[DdsHeaderSize/4];
+        memset(header, 0, sizeof(header));
+
+        header[0]  = CS_DDS_FOURCC('D', 'D', 'S', ' ');
+        header[1]  = 124; // Header size, without magic.
+        header[2]  = DDSD_CAPS|DDSD_HEIGHT|DDSD_WIDTH|DDSD_PIXELFORMAT|DDSD_MIPMAPCOUNT|DDSD_LINEARSIZE;
+        header[3]  = _height;
+        header[4]  = _width;
+        header[5]  = _topLevelSize;
+        header[7]  = _numMips;
+        header[19] = 32;  // Pixel format size.
+        header[20] = DDPF_FOURCC;
+        header[21] = s_fourcc[_format];
+        header[27] = DDSCAPS_COMPLEX|DDSCAPS_TEXTURE|DDSCAPS_MIPMAP;
+
+        memcpy(_dst, header, DdsHeaderSize);
+    }
+
+    #undef CS_DDS_FOURCC
+
+    static BlockFormat::Enum selectBlockFormat(const uint8_t* _src, uint32_t _numTexels, TextureCompression::Enum _compression)
+    {
+        if (TextureCompression::Normal == _compression)
+        {
+            return BlockFormat::BC5;
+        }
+
+        bool opaque    = true;
+        bool grayscale = true;
+        for (uint32_t ii = 0; ii < _numTexels && (opaque || grayscale); ++ii)
+        {
+            const uint8_t* texel = &_src[ii*4];
+            opaque    = opaque    && (255 == texel[3]);
+            grayscale = grayscale && (texel[0] == texel[1] && texel[0] == texel[2]);
+        }
+
+        // Alpha would be lost, BC4 has a single channel.
+        if (TextureCompression::Mask == _compression && grayscale && opaque)
+        {
+            return BlockFormat::BC4;
+        }
+
+        return opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+    }
+
+    uint32_t textureCompressRgba8(void*& _dds
+                                , const uint8_t* _mips
+                                , uint32_t _width
+                                , uint32_t _height
+                                , uint8_t _numMips
+                                , TextureCompression::Enum _compression
+                                , bx::AllocatorI* _allocator
+                                )
+    {
+        const BlockFormat::Enum format = selectBlockFormat(_mips, _width*_height, _compression);
+        const uint32_t blockSize = (BlockFormat::BC1 == format || BlockFormat::BC4 == format) ? 8 : 16;
+
+        uint32_t ddsSize = DdsHeaderSize;
+        for (uint32_t mip = 0, ww = _width, hh = _height; mip < _numMips; ++mip)
+        {
+            ddsSize += ((ww+3)/4)*((hh+3)/4)*blockSize;
+            ww = dm::max(ww/2, uint32_t(1));
+            hh = dm::max(hh/2, uint32_t(1));
+        }
+
+        uint8_t* dds = (uint8_t*)BX_ALLOC(_allocator, ddsSize);
+        ddsWriteHeader(dds, _width, _height, _numMips, ((_width+3)/4)*((_height+3)/4)*blockSize, format);
+
+        const uint8_t* level = _mips;
+        uint8_t* dst = dds + DdsHeaderSize;
+        for (uint32_t mip = 0, ww = _width, hh = _height; mip < _numMips; ++mip)
+        {
+            EncodeData encode;
+            encode.m_dst       = dst;
+            encode.m_src       = level;
+            encode.m_width     = ww;
+            encode.m_height    = hh;
+            encode.m_blocksX   = (ww+3)/4;
+            encode.m_blockSize = blockSize;
+            encode.m_format    = format;
+
+            const uint32_t blocksY = (hh+3)/4;
+            jobParallelFor(encodeBlockRows, (void*)&encode, blocksY, dm::max(uint32_t(256)/encode.m_blocksX, uint32_t(1)));
+            dst += encode.m_blocksX*blocksY*blockSize;
+
+            level += ww*hh*4;
+            ww = dm::max(ww/2, uint32_t(1));
+            hh = dm::max(hh/2, uint32_t(1));
+        }
+
+        _dds = dds;
+        return ddsSize;
+    }
+
+} // namespace cs
+
+/* vim: set sw=4 ts=4 expandtab: */
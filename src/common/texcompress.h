@@ -0,0 +1,44 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_TEXCOMPRESS_H_HEADER_GUARD
+#define CMFTSTUDIO_TEXCOMPRESS_H_HEADER_GUARD
+
+#include <stdint.h>
+
+namespace bx { struct AllocatorI; }
+
+namespace cs
+{
+    struct TextureCompression
+    {
+        enum Enum
+        {
+            None,
+            Color,  // BC1, BC3 when any texel is not fully opaque.
+            Normal, // BC5, tangent space xy only, z is reconstructed in the shader.
+            Mask,   // BC4 for opaque grayscale images, sampled as (r,0,0,1). Only for masks read from red. BC1, BC3 otherwise.
+
+            Count
+        };
+    };
+
+    /// Encodes RGBA8 mip chain '_mips' (levels stored one after another, see mipChainRgba8()) as a DDS file with BC1, BC3, BC4
+    /// or BC5 blocks, depending on '_compression' and image content. Block rows are split between job system workers, texel indices
+    /// are selected four texels at a time. DDS file is allocated from '_allocator' and written to '_dds', returns its size.
+    uint32_t textureCompressRgba8(void*& _dds
+                                , const uint8_t* _mips
+                                , uint32_t _width
+                                , uint32_t _height
+                                , uint8_t _numMips
+                                , TextureCompression::Enum _compression
+                                , bx::AllocatorI* _allocator
+                                );
+
+} // namespace cs
+
+#endif // CMFTSTUDIO_TEXCOMPRESS_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
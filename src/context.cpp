@@ -8,11 +8,18 @@
 
 #include <stdio.h>
 #include <string.h>            // strcpy
+#include <math.h>              // tanf
 
 #define STB_IMAGE_STATIC
 #define STB_IMAGE_IMPLEMENTATION
 #include "common/stb_image.h"
 
+#include "common/hash.h"       // cs::hash64()
+#include "common/imageproc.h"  // cs::imageTonemap(), cs::imageEncodeHdr()
+#include "common/jobs.h"       // cs::jobSubmit()
+#include "common/mappedfile.h" // cs::mappedFileOpen()
+#include "common/mipmap.h"     // cs::mipChainRgba8()
+#include "common/texcompress.h" // cs::textureCompressRgba8()
 #include "common/timer.h"
 #include "geometry/loaders.h"
 #include "geometry/objtobin.h"
@@ -27,6 +34,7 @@
 
 #include <bx/fpumath.h>
 #include <bx/macros.h>         // BX_UNUSED
+#include <bx/thread.h>         // bx::Mutex
 
 #ifndef CS_LOAD_SHADERS_FROM_DATA_SEGMENT
     #define CS_LOAD_SHADERS_FROM_DATA_SEGMENT 0
@@ -206,6 +214,7 @@ namespace cs
 
         TyImpl* createObj()
         {
+            bx::MutexScope lock(m_mutex);
             TyImpl* obj = m_elements.addNew();
             return obj;
         }
@@ -228,12 +237,14 @@ namespace cs
 
         TyHandle acquire(TyHandle _handle)
         {
+            bx::MutexScope lock(m_mutex);
             ++m_refs[_handle.m_idx];
             return _handle;
         }
 
         void release(TyHandle _handle)
         {
+            bx::MutexScope lock(m_mutex);
             if (--m_refs[_handle.m_idx] <= 0)
             {
                 m_refs[_handle.m_idx] = 0;
@@ -258,6 +269,7 @@ namespace cs
 
         void setName(TyHandle _objHandle, const char* _name)
         {
+            bx::MutexScope lock(m_mutex);
             m_names.map(_objHandle, _name);
         }
 
@@ -268,6 +280,7 @@ namespace cs
 
         void gc()
         {
+            bx::MutexScope lock(m_mutex);
             for (uint16_t ii = m_cleanup.count(); ii--; )
             {
                 const uint16_t idx = m_cleanup.getValueAt(ii);
@@ -278,6 +291,8 @@ namespace cs
 
         double gc(double _maxMs)
         {
+            bx::MutexScope lock(m_mutex);
+
             const double beginTime = timerCurrentMs();
             const double endTime = beginTime + _maxMs;
 
@@ -300,6 +315,8 @@ namespace cs
 
         uint16_t gc(uint16_t _maxNum)
         {
+            bx::MutexScope lock(m_mutex);
+
             uint16_t max = _maxNum;
 
             for (uint16_t ii = m_cleanup.count(); ii--; )
@@ -320,6 +337,7 @@ namespace cs
 
         void destroyAll()
         {
+            bx::MutexScope lock(m_mutex);
             m_refs.zero();
             for (uint16_t ii = m_elements.count(); ii--; )
             {
@@ -335,11 +353,27 @@ namespace cs
             return m_elements.count();
         }
 
+        // Copies handles of all elements to '_handles', returns their number.
+        uint16_t getHandles(TyHandle* _handles)
+        {
+            bx::MutexScope lock(m_mutex);
+            const uint16_t num = m_elements.count();
+            for (uint16_t ii = 0; ii < num; ++ii)
+            {
+                _handles[ii].m_idx = m_elements.getHandleAt(ii);
+            }
+
+            return num;
+        }
+
     protected:
         dm::ListT<TyImpl, MaxElementsT>       m_elements;
         dm::ArrayT<int16_t, MaxElementsT>     m_refs;
         dm::SetT<MaxElementsT>                m_cleanup;
         StrHandleMapT<TyHandle, MaxElementsT> m_names;
+
+        // Notice: resources are also created and acquired from background jobs.
+        bx::Mutex m_mutex;
     };
 
     // Resource resolver.
@@ -497,6 +531,205 @@ namespace cs
         }
     };
 
+    // Host memory residency.
+    //-----
+
+    // Cpu copy of data already uploaded to the GPU, moved to a temporary file while not used. See residencyUpdate().
+    struct SpillFile
+    {
+        SpillFile()
+        {
+            m_file    = NULL;
+            m_size    = 0;
+            m_evicted = false;
+        }
+
+        FILE*    m_file;
+        uint32_t m_size;    // Size of data in the file, 0 when the file is out of date.
+        bool     m_evicted; // Set while data is only in the file.
+    };
+
+    // Taken while cpu copies are moved to or from spill files, project save reads them from a worker.
+    static bx::Mutex s_residencyMutex;
+
+    // Files that are still up to date are kept, evicting unchanged data again costs no writes.
+    static bool spillWrite(SpillFile& _spill, const void* _data, uint32_t _size)
+    {
+        if (_size == _spill.m_size)
+        {
+            return true;
+        }
+
+        if (NULL == _spill.m_file)
+        {
+            _spill.m_file = tmpfile();
+            if (NULL == _spill.m_file)
+            {
+                return false;
+            }
+        }
+
+        rewind(_spill.m_file);
+        const bool written = (1 == fwrite(_data, _size, 1, _spill.m_file))
+                          && (0 == fflush(_spill.m_file))
+                          ;
+
+        _spill.m_size = written ? _size : 0;
+        return written;
+    }
+
+    // Notice: m_evicted is left for the caller, reads may run on a job.
+    static void* spillRead(SpillFile& _spill)
+    {
+        void* data = BX_ALLOC(dm::mainAlloc, _spill.m_size);
+
+        rewind(_spill.m_file);
+        const size_t read = fread(data, 1, _spill.m_size, _spill.m_file);
+        CS_CHECK(read == _spill.m_size, "Error reading spill file.");
+        BX_UNUSED(read);
+
+        return data;
+    }
+
+    // Data changed, file is rewritten on the next eviction.
+    static void spillInvalidate(SpillFile& _spill)
+    {
+        _spill.m_size    = 0;
+        _spill.m_evicted = false;
+    }
+
+    static void spillClose(SpillFile& _spill)
+    {
+        if (NULL != _spill.m_file)
+        {
+            fclose(_spill.m_file);
+            _spill.m_file = NULL;
+        }
+        spillInvalidate(_spill);
+    }
+
+    // Spill files are written and read back on a job, a resource has at most one task in flight.
+    // Notice: spill files of the task are owned by the job until it is done.
+    struct SpillTask
+    {
+        enum { MaxItems = 4 };
+
+        struct Type
+        {
+            enum Enum
+            {
+                None,
+                Write,
+                Read,
+            };
+        };
+
+        SpillTask()
+        {
+            m_job  = JobHandle::invalid();
+            m_type = Type::None;
+            m_num  = 0;
+        }
+
+        bool pending() const
+        {
+            return Type::None != m_type;
+        }
+
+        bool done() const
+        {
+            return pending() && jobIsDone(m_job);
+        }
+
+        JobHandle  m_job;
+        uint8_t    m_type;
+        uint8_t    m_num;
+        SpillFile* m_spill[MaxItems];
+        void*      m_data[MaxItems]; // Write: data to store. Read: data read back, allocated by the job.
+        uint32_t   m_size[MaxItems];
+        bool       m_done[MaxItems]; // Item was written or read successfully.
+    };
+
+    static int32_t spillTaskFunc(void* _spillTask)
+    {
+        SpillTask* task = (SpillTask*)_spillTask;
+
+        for (uint8_t ii = 0; ii < task->m_num; ++ii)
+        {
+            if (SpillTask::Type::Write == task->m_type)
+            {
+                task->m_done[ii] = spillWrite(*task->m_spill[ii], task->m_data[ii], task->m_size[ii]);
+            }
+            else //if (SpillTask::Type::Read == task->m_type).
+            {
+                task->m_data[ii] = spillRead(*task->m_spill[ii]);
+                task->m_done[ii] = true;
+            }
+        }
+
+        return 0;
+    }
+
+    static void spillTaskAdd(SpillTask& _task, SpillFile& _spill, void* _data = NULL, uint32_t _size = 0)
+    {
+        CS_CHECK(_task.m_num < SpillTask::MaxItems, "Spill task overflow!");
+
+        _task.m_spill[_task.m_num] = &_spill;
+        _task.m_data[_task.m_num]  = _data;
+        _task.m_size[_task.m_num]  = _size;
+        _task.m_done[_task.m_num]  = false;
+        ++_task.m_num;
+    }
+
+    static void spillTaskReset(SpillTask& _task)
+    {
+        _task.m_job  = JobHandle::invalid();
+        _task.m_type = SpillTask::Type::None;
+        _task.m_num  = 0;
+    }
+
+    static bool spillTaskSubmit(SpillTask& _task, SpillTask::Type::Enum _type)
+    {
+        if (0 == _task.m_num)
+        {
+            return false;
+        }
+
+        _task.m_type = uint8_t(_type);
+        _task.m_job  = jobSubmit(spillTaskFunc, (void*)&_task, JobPriority::Low);
+        if (!isValid(_task.m_job))
+        {
+            spillTaskReset(_task);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Waits for the job and drops its results. Written files stay valid, evicting unchanged data again costs no writes.
+    static void spillTaskCancel(SpillTask& _task)
+    {
+        if (!_task.pending())
+        {
+            return;
+        }
+
+        jobWait(_task.m_job);
+
+        if (SpillTask::Type::Read == _task.m_type)
+        {
+            for (uint8_t ii = 0; ii < _task.m_num; ++ii)
+            {
+                if (_task.m_done[ii])
+                {
+                    BX_FREE(dm::mainAlloc, _task.m_data[ii]);
+                }
+            }
+        }
+
+        spillTaskReset(_task);
+    }
+
     // Texture.
     //-----
 
@@ -573,6 +806,10 @@ namespace cs
             m_format         = bgfx::TextureFormat::BGRA8;
             m_type           = Type::Unknown;
             m_freeData       = true;
+            m_mapped         = NULL;
+            m_lastUse        = g_frameNum;
+            m_contentHash    = 0;
+            m_contentSize    = 0;
         }
 
         ~TextureImpl()
@@ -590,21 +827,43 @@ namespace cs
 
         bool load(const void* _dataOrPath, uint32_t _sizeOrInvalid)
         {
-            const bool isFile = (UINT32_MAX == _sizeOrInvalid);
+            bool isFile = (UINT32_MAX == _sizeOrInvalid);
+
+            const char* path = (const char*)_dataOrPath;
+            const void* data = (const void*)_dataOrPath;
+            uint32_t    size = _sizeOrInvalid;
+
+            // Files are mapped and read once. Decoders below work on mapped pages, containers are passed to bgfx as they are.
+            MappedFile* mapped = isFile ? mappedFileOpen(path) : NULL;
+            if (NULL != mapped)
+            {
+                data   = mappedFileData(mapped);
+                size   = mappedFileSize(mapped);
+                isFile = false;
+            }
+
+            const bool loaded = load(isFile, path, data, size, mapped);
+
+            if (NULL != mapped)
+            {
+                mappedFileRelease(mapped);
+            }
 
-            const char*    path = (const char*)_dataOrPath;
-            const void*    data = (const void*)_dataOrPath;
-            const uint32_t size = _sizeOrInvalid;
+            return loaded;
+        }
 
+        // Notice: raw data from '_mapped' is referenced, texture takes its own reference until the upload. See unmapBegin().
+        bool load(bool _isFile, const char* _path, const void* _data, uint32_t _size, MappedFile* _mapped)
+        {
             // Try loading the image through cmft.
             cmft::Image image;
-            if (isFile)
+            if (_isFile)
             {
-                cmft::imageLoad(image, path);
+                cmft::imageLoad(image, _path);
             }
             else
             {
-                cmft::imageLoad(image, data, size);
+                cmft::imageLoad(image, _data, _size);
             }
 
             if (cmft::imageIsValid(image))
@@ -639,13 +898,13 @@ namespace cs
             // Passing reqNumComponents as 4 forces RGBA8 in m_data.
             // After stbi_load, stbNumComponents will hold the actual # of components from the source image.
             const int reqNumComponents = 4;
-            if (isFile)
+            if (_isFile)
             {
-                m_data = (uint8_t*)stb::stbi_load(path, &stbWidth, &stbHeight, &stbNumComponents, reqNumComponents);
+                m_data = (uint8_t*)stb::stbi_load(_path, &stbWidth, &stbHeight, &stbNumComponents, reqNumComponents);
             }
             else
             {
-                m_data = (uint8_t*)stb::stbi_load_from_memory((stb::stbi_uc*)data, (int)size, &stbWidth, &stbHeight, &stbNumComponents, reqNumComponents);
+                m_data = (uint8_t*)stb::stbi_load_from_memory((stb::stbi_uc*)_data, (int)_size, &stbWidth, &stbHeight, &stbNumComponents, reqNumComponents);
             }
 
             if (m_data)
@@ -663,9 +922,9 @@ namespace cs
 
             // Read/copy raw data.
 
-            if (isFile)
+            if (_isFile)
             {
-                FILE* file = fopen(path, "rb");
+                FILE* file = fopen(_path, "rb");
                 if (NULL != file)
                 {
                     m_size = (uint32_t)dm::fsize(file);
@@ -680,9 +939,20 @@ namespace cs
                     return true;
                 }
             }
+            else if (NULL != _mapped)
+            {
+                mappedFileAcquire(_mapped);
+                m_mapped   = _mapped;
+                m_data     = (uint8_t*)_data;
+                m_size     = _size;
+                m_type     = Type::Unknown;
+                m_freeData = false;
+
+                return true;
+            }
             else
             {
-                loadRaw(data, size);
+                loadRaw(_data, _size);
 
                 return true;
             }
@@ -695,6 +965,49 @@ namespace cs
             return load((void*)_path, UINT32_MAX);
         }
 
+        // Decoded single mip 2D RGBA8 images (stb path) get the full mip chain, other textures are left as they are.
+        void buildMips(MipFilter::Enum _filter, MipContent::Enum _content)
+        {
+            if (Type::Tex2D != m_type
+            ||  bgfx::TextureFormat::RGBA8 != m_format
+            ||  1 != m_numMips
+            ||  NULL != m_mapped)
+            {
+                return;
+            }
+
+            void* mips;
+            const uint32_t mipsSize = mipChainRgba8(mips, (const uint8_t*)m_data, m_width, m_height, _filter, _content, dm::mainAlloc);
+
+            freeMem();
+            m_data     = mips;
+            m_size     = mipsSize;
+            m_numMips  = mipNumLevels(m_width, m_height);
+            m_freeData = true;
+        }
+
+        // Replaces decoded RGBA8 image with a block compressed DDS container, which is what gets uploaded and saved.
+        // Notice: only 2D RGBA8 images are handled, other textures are left as they are.
+        void compress(TextureCompression::Enum _compression)
+        {
+            if (TextureCompression::None == _compression
+            ||  Type::Tex2D != m_type
+            ||  bgfx::TextureFormat::RGBA8 != m_format
+            ||  NULL != m_mapped)
+            {
+                return;
+            }
+
+            void* dds;
+            const uint32_t ddsSize = textureCompressRgba8(dds, (const uint8_t*)m_data, m_width, m_height, m_numMips, _compression, dm::mainAlloc);
+
+            freeMem();
+            m_data     = dds;
+            m_size     = ddsSize;
+            m_type     = Type::Unknown;
+            m_freeData = true;
+        }
+
         void read(dm::ReaderSeekerI* _reader, TextureHandle _handle = TextureHandle::invalid(), dm::StackAllocatorI* _stack = dm::stackAlloc)
         {
             BX_UNUSED(_stack);
@@ -712,7 +1025,19 @@ namespace cs
 
         void createGpuBuffers(uint32_t _flags = BGFX_TEXTURE_NONE)
         {
-            const bgfx::Memory* mem = bgfx::makeRef(m_data, m_size);
+            makeResident();
+
+            // Mapped pages are kept alive until bgfx is done with them.
+            const bgfx::Memory* mem;
+            if (NULL != m_mapped)
+            {
+                mappedFileAcquire(m_mapped);
+                mem = bgfx::makeRef(m_data, m_size, mappedFileReleaseFn, m_mapped);
+            }
+            else
+            {
+                mem = bgfx::makeRef(m_data, m_size);
+            }
             BGFX_SAFE_DESTROY_TEXTURE(m_bgfxHandle);
 
             switch (m_type)
@@ -751,15 +1076,124 @@ namespace cs
 
         void freeMem(bool _delayed = false)
         {
-            if (m_freeData && NULL != m_data)
+            spillTaskCancel(m_spillTask);
+
+            if (NULL != m_mapped)
+            {
+                mappedFileRelease(m_mapped);
+                m_mapped = NULL;
+                m_data   = NULL;
+            }
+            else if (m_freeData && NULL != m_data)
             {
                 BX_FREE(_delayed ? cs::delayedFree : dm::mainAlloc, m_data);
                 m_data = NULL;
             }
 
+            spillClose(m_spill);
             m_size = 0;
         }
 
+        // Bytes that evictBegin() would free. Only owned copies of uploaded 2D textures are evicted,
+        // mapped files are released by unmapBegin() and cubemaps belong to environments, see EnvironmentImpl::evictBegin().
+        uint32_t evictableSize() const
+        {
+            if (NULL == m_data
+            ||  NULL != m_mapped
+            ||  !m_freeData
+            ||  Type::Tex2D != m_type
+            ||  bgfx::invalidHandle == m_bgfxHandle.idx)
+            {
+                return 0;
+            }
+
+            return m_size;
+        }
+
+        // Starts writing cpu copy to a spill file on a job, evictEnd() releases it once the job is done. GPU texture is kept.
+        bool evictBegin()
+        {
+            if (m_spillTask.pending()
+            ||  0 == evictableSize())
+            {
+                return false;
+            }
+
+            spillTaskAdd(m_spillTask, m_spill, m_data, m_size);
+            return spillTaskSubmit(m_spillTask, SpillTask::Type::Write);
+        }
+
+        // Mapping is needed only for the upload, bgfx holds its own reference until it is done with the pages.
+        // Starts writing mapped bytes to a spill file on a job, evictEnd() releases the mapping once the job is done.
+        bool unmapBegin()
+        {
+            if (NULL == m_mapped
+            ||  m_spillTask.pending()
+            ||  bgfx::invalidHandle == m_bgfxHandle.idx)
+            {
+                return false;
+            }
+
+            spillTaskAdd(m_spillTask, m_spill, m_data, m_size);
+            return spillTaskSubmit(m_spillTask, SpillTask::Type::Write);
+        }
+
+        // Notice: m_size stays valid.
+        void evictEnd()
+        {
+            bx::MutexScope lock(s_residencyMutex);
+
+            jobWait(m_spillTask.m_job);
+            if (m_spillTask.m_done[0])
+            {
+                if (NULL != m_mapped)
+                {
+                    // Bytes read back by makeResident() are owned.
+                    mappedFileRelease(m_mapped);
+                    m_mapped   = NULL;
+                    m_freeData = true;
+                }
+                else
+                {
+                    // Memory may still be referenced by bgfx.
+                    BX_FREE(cs::delayedFree, m_data);
+                }
+                m_data = NULL;
+                m_spill.m_evicted = true;
+            }
+            else if (NULL != m_mapped)
+            {
+                // No spill file, bytes are copied to the heap so the file is not held open.
+                void* data = BX_ALLOC(dm::mainAlloc, m_size);
+                memcpy(data, m_data, m_size);
+                mappedFileRelease(m_mapped);
+                m_mapped   = NULL;
+                m_data     = data;
+                m_freeData = true;
+            }
+            spillTaskReset(m_spillTask);
+        }
+
+        void makeResident()
+        {
+            m_lastUse = g_frameNum;
+
+            if (m_spillTask.pending()
+            ||  m_spill.m_evicted)
+            {
+                bx::MutexScope lock(s_residencyMutex);
+
+                // Data is still in memory while it is being written.
+                spillTaskCancel(m_spillTask);
+
+                if (m_spill.m_evicted)
+                {
+                    m_data = spillRead(m_spill);
+                    m_spill.m_evicted = false;
+                }
+            }
+        }
+
         void destroy()
         {
             if (bgfx::invalidHandle != m_bgfxHandle.idx)
@@ -776,10 +1210,97 @@ namespace cs
         bgfx::TextureFormat::Enum m_format;
         Type::Enum m_type;
         bool m_freeData;
+        MappedFile* m_mapped; // Set when m_data points into a mapped file. Released after the upload, see unmapBegin().
+        SpillFile m_spill;
+        SpillTask m_spillTask;
+        uint32_t m_lastUse;   // Frame number of the last cpu side access.
+        uint64_t m_contentHash; // Hash of source bytes and processing, 0 when not shared. See TextureResourceManager::load().
+        uint32_t m_contentSize; // Size of source bytes.
+    };
+
+    // Content hash to texture index of shared textures. Open addressing with linear probing, removal shifts entries back.
+    struct TextureContentMap
+    {
+        enum
+        {
+            NumSlots = CS_MAX_TEXTURES*2, // Power of two, at most half full.
+            Mask     = NumSlots-1,
+            Empty    = UINT16_MAX,
+        };
+
+        TextureContentMap()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            memset(m_idx, 0xff, sizeof(m_idx));
+        }
+
+        uint16_t find(uint64_t _hash) const
+        {
+            for (uint32_t slot = uint32_t(_hash)&Mask; Empty != m_idx[slot]; slot = (slot+1)&Mask)
+            {
+                if (_hash == m_hash[slot])
+                {
+                    return m_idx[slot];
+                }
+            }
+
+            return Empty;
+        }
+
+        // Latest texture with '_hash' is mapped.
+        void insert(uint64_t _hash, uint16_t _idx)
+        {
+            uint32_t slot = uint32_t(_hash)&Mask;
+            while (Empty != m_idx[slot] && _hash != m_hash[slot])
+            {
+                slot = (slot+1)&Mask;
+            }
+
+            m_hash[slot] = _hash;
+            m_idx[slot]  = _idx;
+        }
+
+        void remove(uint64_t _hash, uint16_t _idx)
+        {
+            uint32_t hole = uint32_t(_hash)&Mask;
+            while (Empty != m_idx[hole] && _hash != m_hash[hole])
+            {
+                hole = (hole+1)&Mask;
+            }
+
+            if (Empty == m_idx[hole]
+            ||  _idx  != m_idx[hole])
+            {
+                return;
+            }
+
+            // Entries after the hole move back unless that would take them before their home slot.
+            for (uint32_t next = (hole+1)&Mask; Empty != m_idx[next]; next = (next+1)&Mask)
+            {
+                const uint32_t home = uint32_t(m_hash[next])&Mask;
+                if (((next-home)&Mask) >= ((next-hole)&Mask))
+                {
+                    m_hash[hole] = m_hash[next];
+                    m_idx[hole]  = m_idx[next];
+                    hole = next;
+                }
+            }
+
+            m_idx[hole] = Empty;
+        }
+
+        uint64_t m_hash[NumSlots];
+        uint16_t m_idx[NumSlots];
     };
 
     struct TextureResourceManager : public ResourceManagerT<Texture, TextureImpl, TextureHandle, CS_MAX_TEXTURES>
     {
+        typedef ResourceManagerT<Texture, TextureImpl, TextureHandle, CS_MAX_TEXTURES> BaseType;
+
         TextureHandle create()
         {
             const TextureImpl* texture = this->createObj();
@@ -800,34 +1321,199 @@ namespace cs
 
         TextureHandle load(const void* _data, uint32_t _size)
         {
-            TextureImpl* texture = this->createObj();
-            texture->load(_data, _size);
-            texture->createGpuBuffers();
-
-            const TextureHandle handle = this->getHandle(texture);
+            const TextureHandle handle = this->load(_data, _size, MipFilter::Kaiser, MipContent::Linear, TextureCompression::None);
+            createGpuBuffers(handle);
 
-            return this->acquire(handle);
+            return handle;
         }
 
         TextureHandle load(const char* _path)
         {
-            TextureImpl* texture = this->createObj();
-            texture->load(_path);
-            texture->createGpuBuffers();
+            const TextureHandle handle = this->load(_path, UINT32_MAX, MipFilter::Kaiser, MipContent::Linear, TextureCompression::None);
+            createGpuBuffers(handle);
 
-            const TextureHandle handle = this->getHandle(texture);
-
-            return this->acquire(handle);
+            return handle;
         }
-    };
-    static TextureResourceManager* s_textures;
 
-    TextureHandle loadTextureStripes()
-    {
-        const cs::TextureHandle tex = textureLoadRaw(g_stripesS, g_stripesSSize);
-        setName(tex, "Stripes");
-        return acquire(tex);
-    }
+        // Textures loaded from equal source bytes with equal processing share one resource, repeated loads return the existing
+        // texture acquired. Source is hashed before decoding, files are mapped once for both. Notice: gpu buffers are not created here.
+        TextureHandle load(const void* _dataOrPath
+                         , uint32_t _sizeOrInvalid
+                         , MipFilter::Enum _mipFilter
+                         , MipContent::Enum _mipContent
+                         , TextureCompression::Enum _compression
+                         , bool* _loaded = NULL
+                         , bool* _shared = NULL
+                         )
+        {
+            if (NULL != _shared)
+            {
+                *_shared = false;
+            }
+
+            const bool isFile = (UINT32_MAX == _sizeOrInvalid);
+            const char* path  = (const char*)_dataOrPath;
+
+            MappedFile* mapped = isFile ? mappedFileOpen(path) : NULL;
+            const void* data   = (NULL != mapped) ? mappedFileData(mapped) : _dataOrPath;
+            const uint32_t size = (NULL != mapped) ? mappedFileSize(mapped) : _sizeOrInvalid;
+
+            // Files that can't be mapped are loaded without sharing.
+            uint64_t hash = 0;
+            if (!isFile || NULL != mapped)
+            {
+                hash = hash64(data, size);
+                hash = hash64Value(uint32_t(_mipFilter),   hash);
+                hash = hash64Value(uint32_t(_mipContent),  hash);
+                hash = hash64Value(uint32_t(_compression), hash);
+                hash = (0 == hash) ? 1 : hash;
+
+                const TextureHandle existing = this->find(hash, size);
+                if (isValid(existing))
+                {
+                    if (NULL != mapped)
+                    {
+                        mappedFileRelease(mapped);
+                    }
+
+                    if (NULL != _loaded)
+                    {
+                        *_loaded = true;
+                    }
+
+                    if (NULL != _shared)
+                    {
+                        *_shared = true;
+                    }
+
+                    return existing;
+                }
+            }
+
+            TextureImpl* texture = this->createObj();
+
+            bool loaded;
+            if (0 != hash)
+            {
+                loaded = texture->load(false, path, data, size, mapped);
+                if (NULL != mapped)
+                {
+                    mappedFileRelease(mapped);
+                }
+            }
+            else
+            {
+                loaded = texture->load(_dataOrPath, _sizeOrInvalid);
+            }
+
+            if (loaded)
+            {
+                texture->buildMips(_mipFilter, _mipContent);
+                texture->compress(_compression);
+
+                // Visible to find() only once fully processed. Concurrent loads of the same source may still end up with two textures.
+                bx::MutexScope lock(m_mutex);
+                texture->m_contentHash = hash;
+                texture->m_contentSize = size;
+                if (0 != hash)
+                {
+                    m_contentMap.insert(hash, m_elements.getHandleOf(texture));
+                }
+            }
+
+            if (NULL != _loaded)
+            {
+                *_loaded = loaded;
+            }
+
+            return this->acquire(this->getHandle(texture));
+        }
+
+        // Returns acquired texture with matching content or invalid handle. Released textures waiting for gc are not reused.
+        TextureHandle find(uint64_t _hash, uint32_t _size)
+        {
+            bx::MutexScope lock(m_mutex);
+
+            const uint16_t idx = m_contentMap.find(_hash);
+            if (TextureContentMap::Empty != idx
+            &&  m_elements.contains(idx))
+            {
+                const TextureImpl* texture = m_elements.get(idx);
+                if (_hash == texture->m_contentHash
+                &&  _size == texture->m_contentSize
+                &&  0 < m_refs[idx])
+                {
+                    ++m_refs[idx];
+
+                    const TextureHandle handle = { idx };
+                    return handle;
+                }
+            }
+
+            return TextureHandle::invalid();
+        }
+
+        // Content map entries of textures waiting for gc are removed first.
+        void unmapCleanup()
+        {
+            bx::MutexScope lock(m_mutex);
+            for (uint16_t ii = 0, end = m_cleanup.count(); ii < end; ++ii)
+            {
+                const uint16_t idx = m_cleanup.getValueAt(ii);
+                const TextureImpl* texture = m_elements.get(idx);
+                if (0 != texture->m_contentHash)
+                {
+                    m_contentMap.remove(texture->m_contentHash, idx);
+                }
+            }
+        }
+
+        void gc()
+        {
+            unmapCleanup();
+            BaseType::gc();
+        }
+
+        double gc(double _maxMs)
+        {
+            unmapCleanup();
+            return BaseType::gc(_maxMs);
+        }
+
+        uint16_t gc(uint16_t _maxNum)
+        {
+            unmapCleanup();
+            return BaseType::gc(_maxNum);
+        }
+
+        void destroyAll()
+        {
+            BaseType::destroyAll();
+
+            bx::MutexScope lock(m_mutex);
+            m_contentMap.reset();
+        }
+
+        // Shared textures may already be on the gpu.
+        void createGpuBuffers(TextureHandle _handle)
+        {
+            TextureImpl* texture = this->getImpl(_handle);
+            if (bgfx::invalidHandle == texture->m_bgfxHandle.idx)
+            {
+                texture->createGpuBuffers();
+            }
+        }
+
+        TextureContentMap m_contentMap; // Guarded by m_mutex.
+    };
+    static TextureResourceManager* s_textures;
+
+    TextureHandle loadTextureStripes()
+    {
+        const cs::TextureHandle tex = textureLoadRaw(g_stripesS, g_stripesSSize);
+        setName(tex, "Stripes");
+        return acquire(tex);
+    }
 
     TextureHandle textureStripes()
     {
@@ -876,6 +1562,147 @@ namespace cs
         return s_textures->loadRaw(_data, _size);
     }
 
+    struct TextureLoadRequest
+    {
+        char m_path[DM_PATH_LEN];
+        char m_name[128];
+        TextureHandle m_handle;
+        uint16_t m_userData;
+        MipFilter::Enum m_mipFilter;
+        MipContent::Enum m_mipContent;
+        TextureCompression::Enum m_compression;
+        bool m_shared; // Existing texture with the same content was returned.
+    };
+
+    // Decoded textures waiting for GPU upload, see gpuUploadQueue(). Only touched from the main thread.
+    struct TextureUploadQueue
+    {
+        enum { MaxRequests = 64 };
+
+        TextureUploadQueue()
+        {
+            m_numInFlight = 0;
+            m_numReady    = 0;
+        }
+
+        uint16_t m_numInFlight;
+        uint16_t m_numReady;
+        TextureLoadRequest* m_ready[MaxRequests];
+    };
+    static TextureUploadQueue s_textureUploads;
+
+    static int32_t textureDecodeFunc(void* _request)
+    {
+        TextureLoadRequest* request = (TextureLoadRequest*)_request;
+
+        bool loaded;
+        request->m_handle = s_textures->load(request->m_path
+                                           , UINT32_MAX
+                                           , request->m_mipFilter
+                                           , request->m_mipContent
+                                           , request->m_compression
+                                           , &loaded
+                                           , &request->m_shared
+                                           );
+
+        return loaded ? 0 : -1;
+    }
+
+    static void textureDecodeComplete(int32_t _result, void* _request)
+    {
+        TextureLoadRequest* request = (TextureLoadRequest*)_request;
+
+        if (0 != _result)
+        {
+            fprintf(stderr, "Texture '%s' could not be loaded.\n", request->m_path);
+
+            s_textures->release(request->m_handle);
+            BX_FREE(dm::mainAlloc, request);
+            s_textureUploads.m_numInFlight--;
+            return;
+        }
+
+        // Uploaded within the configured per frame budget, together with other queued resources.
+        if (bgfx::invalidHandle == s_textures->getImpl(request->m_handle)->m_bgfxHandle.idx)
+        {
+            gpuUploadQueue(request->m_handle);
+        }
+
+        s_textureUploads.m_ready[s_textureUploads.m_numReady++] = request;
+    }
+
+    bool textureLoadAsync(const char* _path
+                        , const char* _name
+                        , uint16_t _userData
+                        , MipFilter::Enum _mipFilter
+                        , MipContent::Enum _mipContent
+                        , TextureCompression::Enum _compression
+                        )
+    {
+        TextureUploadQueue& queue = s_textureUploads;
+        if (TextureUploadQueue::MaxRequests == queue.m_numInFlight)
+        {
+            return false;
+        }
+
+        TextureLoadRequest* request = (TextureLoadRequest*)BX_ALLOC(dm::mainAlloc, sizeof(TextureLoadRequest));
+        dm::strscpya(request->m_path, _path);
+        dm::strscpya(request->m_name, _name);
+        request->m_handle      = TextureHandle::invalid();
+        request->m_userData    = _userData;
+        request->m_mipFilter   = _mipFilter;
+        request->m_mipContent  = _mipContent;
+        request->m_compression = _compression;
+        request->m_shared      = false;
+
+        const JobHandle job = jobSubmit(textureDecodeFunc, request, JobPriority::Normal, textureDecodeComplete, request);
+        if (!isValid(job))
+        {
+            BX_FREE(dm::mainAlloc, request);
+            return false;
+        }
+
+        queue.m_numInFlight++;
+        return true;
+    }
+
+    uint16_t textureUploadPending(TextureHandle* _handles, uint16_t* _userData, uint16_t _max)
+    {
+        TextureUploadQueue& queue = s_textureUploads;
+
+        uint16_t num = 0;
+        while (num < _max
+           &&  num < queue.m_numReady
+           &&  bgfx::invalidHandle != s_textures->getImpl(queue.m_ready[num]->m_handle)->m_bgfxHandle.idx)
+        {
+            TextureLoadRequest* request = queue.m_ready[num];
+
+            // Shared texture keeps the name it was first loaded with.
+            if (!request->m_shared)
+            {
+                s_textures->setName(request->m_handle, request->m_name);
+            }
+
+            _handles[num]  = request->m_handle;
+            _userData[num] = request->m_userData;
+            num++;
+
+            BX_FREE(dm::mainAlloc, request);
+        }
+
+        // Keep the remaining ones in order for the next frame.
+        queue.m_numReady = uint16_t(queue.m_numReady - num);
+        memmove(queue.m_ready, &queue.m_ready[num], queue.m_numReady*sizeof(TextureLoadRequest*));
+        queue.m_numInFlight = uint16_t(queue.m_numInFlight - num);
+
+        return num;
+    }
+
+    uint16_t textureLoadsInFlight()
+    {
+        return s_textureUploads.m_numInFlight;
+    }
+
     bgfx::TextureHandle textureGetBgfxHandle(cs::TextureHandle _handle)
     {
         if (isValid(_handle))
@@ -1063,6 +1890,7 @@ namespace cs
 
         MaterialHandle acquire(MaterialHandle _handle)
         {
+            bx::MutexScope lock(m_mutex);
             ++m_refs[_handle.m_idx];
             return _handle;
         }
@@ -1743,18 +2571,152 @@ namespace cs
     // Environment.
     //-----
 
+    struct EnvironmentImpl;
+    static EnvironmentImpl* s_skyboxDetailEnv; // Environment which currently has a skybox detail level resident.
+
+    // Stays EnvironmentImpl::m_detailStream until skyboxStreamComplete() runs, m_file is in use by the job until then.
+    struct SkyboxStream
+    {
+        EnvironmentImpl* m_env; // NULL when the environment no longer waits for the stream.
+        FILE*    m_file;
+        uint8_t* m_data;
+        uint32_t m_dataSize;
+        uint8_t  m_level;
+        bool     m_cancelled; // Data is dropped on completion.
+        bool     m_closeFile; // Set when the environment discarded its levels while the file was in use, closed on completion.
+    };
+
+    // Builds skybox detail levels from the full resolution source on a job, writing them face by face to temporary files.
+    // Stays EnvironmentImpl::m_detailBuild until skyboxBuildComplete() runs.
+    struct SkyboxBuild
+    {
+        enum { MaxLevels = 4 };
+
+        EnvironmentImpl* m_env;    // NULL when the environment no longer waits for the levels.
+        cmft::Image m_source;      // Latlong or cubemap, owned by the job.
+        cmft::TextureFormat::Enum m_format;
+        uint32_t m_minFaceSize;    // Levels are written while their faces are bigger than this.
+        FILE*    m_file[MaxLevels];
+        uint32_t m_faceSize[MaxLevels];
+        uint32_t m_dataSize[MaxLevels];
+        uint8_t  m_num;
+    };
+
+    static bool skyboxBuildWriteFace(const void* _data, uint32_t _size, uint8_t /*_face*/, void* _file)
+    {
+        return 1 == fwrite(_data, _size, 1, (FILE*)_file);
+    }
+
+    static int32_t skyboxBuildFunc(void* _userData)
+    {
+        SkyboxBuild* build = (SkyboxBuild*)_userData;
+        const cmft::Image& source = build->m_source;
+
+        const bool latLong = cmft::imageIsLatLong(source);
+        const uint32_t srcFaceSize   = cmft::imageGetCubemapFaceSize(source);
+        const uint32_t bytesPerPixel = cmft::getImageDataInfo(build->m_format).m_bytesPerPixel;
+
+        for (uint32_t size = srcFaceSize; size > build->m_minFaceSize && build->m_num < SkyboxBuild::MaxLevels; size /= 2)
+        {
+            FILE* file = tmpfile();
+            if (NULL == file)
+            {
+                break;
+            }
+
+            bool written = true;
+            if (latLong)
+            {
+                written = imageCubemapFromLatLong(skyboxBuildWriteFace, (void*)file, source, size, build->m_format, dm::mainAlloc);
+            }
+            else if (size == srcFaceSize && build->m_format == source.m_format)
+            {
+                // Top mip faces are written as they are.
+                const uint32_t faceStride = source.m_dataSize/6;
+                for (uint8_t face = 0; face < 6 && written; ++face)
+                {
+                    written = skyboxBuildWriteFace((const uint8_t*)source.m_data + face*faceStride, size*size*bytesPerPixel, face, (void*)file);
+                }
+            }
+            else
+            {
+                written = imageCubemapResize(skyboxBuildWriteFace, (void*)file, source, size, build->m_format, dm::mainAlloc);
+            }
+
+            if (!written)
+            {
+                fclose(file);
+                break;
+            }
+
+            build->m_file[build->m_num]     = file;
+            build->m_faceSize[build->m_num] = size;
+            build->m_dataSize[build->m_num] = size*size*bytesPerPixel*6;
+            build->m_num++;
+        }
+
+        // Full resolution is only on disk from now on.
+        cmft::imageUnload(build->m_source);
+
+        return 0;
+    }
+
+    static void skyboxBuildComplete(int32_t _result, void* _userData);
+
+    static int32_t skyboxStreamFunc(void* _userData)
+    {
+        SkyboxStream* stream = (SkyboxStream*)_userData;
+
+        rewind(stream->m_file);
+        const size_t read = fread(stream->m_data, 1, stream->m_dataSize, stream->m_file);
+
+        return (read == stream->m_dataSize) ? 0 : -1;
+    }
+
+    static void skyboxStreamComplete(int32_t _result, void* _userData);
+
     struct EnvironmentImpl : public Environment, public ReadWriteI<EnvHandle>
     {
+        // Skybox faces bigger than MaxFaceSize are clamped. Full resolution is kept on disk as up to MaxDetailLevels
+        // detail levels (halving face size each time), at most one of them is resident on the GPU, see skyboxDetailUpdate().
+        enum
+        {
+            MaxFaceSize     = 1024,
+            MaxDetailLevels = SkyboxBuild::MaxLevels,
+        };
+
+        // Spill file slots, one per cubemap image plus the original skybox image.
+        enum
+        {
+            OrigSkyboxSlot = Environment::Count,
+            NumSpillSlots,
+        };
+
         EnvironmentImpl()
         {
             m_cubemap[Skybox] = TextureHandle::invalid();
             m_cubemap[Pmrem]  = TextureHandle::invalid();
             m_cubemap[Iem]    = TextureHandle::invalid();
 
-            m_origSkybox = TextureHandle::invalid();
+            m_origSkybox   = TextureHandle::invalid();
+            m_skyboxDetail = TextureHandle::invalid();
+
+            memset(m_gpuFormat, 0, sizeof(m_gpuFormat));
+            memset(&m_origGpuFormat, 0, sizeof(m_origGpuFormat));
+
+            m_detailFormat   = cmft::TextureFormat::RGBA16F;
+            m_detailNum      = 0;
+            m_detailResident = UINT8_MAX;
+            m_detailStream   = NULL;
+            m_detailJob      = JobHandle::invalid();
+            m_detailBuild    = NULL;
+
+            m_lastUse = g_frameNum;
+            m_evicted = false;
 
             memset(m_lights, 0, sizeof(m_lights));
             m_edgeFixup = cmft::EdgeFixup::None;
+            m_skyboxVersion = 0;
             m_lightsNum = 0;
             for (uint8_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
             {
@@ -1786,6 +2748,103 @@ namespace cs
             tex->m_freeData = false;
         }
 
+        static bool isCubeFormatSupported(bgfx::TextureFormat::Enum _format)
+        {
+            const uint8_t caps = bgfx::getCaps()->formats[_format];
+            return 0 != (caps&BGFX_CAPS_FORMAT_TEXTURE_COLOR)
+                && 0 == (caps&BGFX_CAPS_FORMAT_TEXTURE_EMULATED)
+                ;
+        }
+
+        // Float cubemaps are uploaded in the smallest format whose measured rgb error stays under MaxGpuFormatError,
+        // about the quantization step of 8-bit color. Cpu side images keep their format for filtering, editing and saving.
+        void setupTexture(Environment::Enum _which)
+        {
+            static const float MaxGpuFormatError = 0.004f;
+
+            cmft::Image& image = m_cubemapImage[_which];
+            imageToTextureRef(m_cubemap[_which], image);
+            spillInvalidate(m_spill[_which]);
+
+            TextureImpl* tex = s_textures->getImpl(m_cubemap[_which]);
+
+            EnvGpuFormat& info = m_gpuFormat[_which];
+            info.m_format   = tex->m_format;
+            info.m_srcSize  = image.m_dataSize;
+            info.m_gpuSize  = image.m_dataSize;
+            info.m_maxValue = 1.0f;
+            info.m_error    = 0.0f;
+
+            if (cmft::TextureFormat::RGBA32F != image.m_format
+            &&  cmft::TextureFormat::RGBA16F != image.m_format)
+            {
+                return;
+            }
+
+            HdrEncodingStats stats;
+            imageMeasureHdrEncoding(stats, image);
+            info.m_maxValue = stats.m_maxValue;
+
+            // Smallest first.
+            static const struct
+            {
+                HdrEncoding::Enum m_encoding;
+                bgfx::TextureFormat::Enum m_format;
+            } s_candidates[] =
+            {
+                { HdrEncoding::Rgb9e5,  bgfx::TextureFormat::RGB9E5F },
+                { HdrEncoding::Rgba16f, bgfx::TextureFormat::RGBA16F },
+            };
+
+            for (uint8_t ii = 0; ii < BX_COUNTOF(s_candidates); ++ii)
+            {
+                const HdrEncoding::Enum encoding = s_candidates[ii].m_encoding;
+                const bgfx::TextureFormat::Enum format = s_candidates[ii].m_format;
+
+                if (format == tex->m_format)
+                {
+                    break;
+                }
+
+                if (stats.m_error[encoding] > MaxGpuFormatError
+                ||  !isCubeFormatSupported(format))
+                {
+                    continue;
+                }
+
+                info.m_format = format;
+                info.m_error  = stats.m_error[encoding];
+                break;
+            }
+
+            if (info.m_format != tex->m_format)
+            {
+                encodeTexture(_which);
+            }
+        }
+
+        // Encodes upload copy of '_which' cubemap in the gpu format picked by setupTexture().
+        // The copy is released once the texture is on the GPU and encoded again if it is needed later, see createGpuBuffers().
+        void encodeTexture(Environment::Enum _which)
+        {
+            const cmft::Image& image = m_cubemapImage[_which];
+            TextureImpl* tex = s_textures->getImpl(m_cubemap[_which]);
+            EnvGpuFormat& info = m_gpuFormat[_which];
+
+            const HdrEncoding::Enum encoding = (bgfx::TextureFormat::RGB9E5F == info.m_format)
+                                             ? HdrEncoding::Rgb9e5
+                                             : HdrEncoding::Rgba16f
+                                             ;
+
+            void* data;
+            tex->m_size     = imageEncodeHdr(data, image, encoding, dm::mainAlloc);
+            tex->m_data     = data;
+            tex->m_format   = info.m_format;
+            tex->m_freeData = true;
+
+            info.m_gpuSize = tex->m_size;
+        }
+
         void create(uint32_t _rgba = 0x303030ff, uint32_t _size = 128)
         {
             dm::StackAllocScope scope(dm::stackAlloc);
@@ -1798,15 +2857,16 @@ namespace cs
             cmft::imageCopy(m_cubemapImage[Environment::Skybox], cubemap);
             cmft::imageCopy(m_cubemapImage[Environment::Pmrem ], cubemap);
             cmft::imageCopy(m_cubemapImage[Environment::Iem   ], cubemap);
-            imageToTextureRef(m_cubemap[Environment::Skybox], m_cubemapImage[Environment::Skybox]);
-            imageToTextureRef(m_cubemap[Environment::Pmrem],  m_cubemapImage[Environment::Pmrem]);
-            imageToTextureRef(m_cubemap[Environment::Iem],    m_cubemapImage[Environment::Iem]);
+            setupTexture(Environment::Skybox);
+            setupTexture(Environment::Pmrem);
+            setupTexture(Environment::Iem);
 
             // Cleanup.
             cmft::imageUnload(cubemap, dm::stackAlloc);
         }
 
         // Notice this takes ownership of '_image'.
+        // No full size intermediate copies are made, peak memory is about '_image' plus the output image.
         bool load(Environment::Enum _which, cmft::Image& _image)
         {
             if (!cmft::imageIsEnvironmentMap(_image, true))
@@ -1815,58 +2875,49 @@ namespace cs
                 return false;
             }
 
-            // Resize if input image is very big.
-            const uint32_t cubeFaceSize = cmft::imageGetCubemapFaceSize(_image);
-            if (cubeFaceSize > 1024)
-            {
-                cmft::imageResize(_image, 1024);
-            }
-
-            const bool isCubemap = cmft::imageIsCubemap(_image);
-            const bool isLatlong = cmft::imageIsLatLong(_image);
             const TextureFormatInfo tfi = cmftToBgfx(_image.m_format);
+            const cmft::TextureFormat::Enum format = tfi.convert() ? tfi.cmftFormat() : _image.m_format;
 
-            dm::StackAllocScope scope(dm::stackAlloc);
-
-            cmft::ImageHardRef imageRgba32f;
-            cmft::imageRefOrConvert(imageRgba32f, cmft::TextureFormat::RGBA32F, _image, dm::stackAlloc);
+            if (Environment::Skybox == _which)
+            {
+                skyboxDetailDiscard();
+                m_detailFormat = format;
+                m_skyboxVersion++;
+            }
 
-            // Cubemap image.
-            // Try to go the shortest path possible.
-            if (isLatlong)
+            uint32_t srcFaceSize;
+            if (cmft::imageIsLatLong(_image))
             {
-                dm::StackAllocScope scope(dm::stackAlloc);
+                srcFaceSize = cmft::imageGetCubemapFaceSize(_image);
 
-                cmft::Image tmp;
-                cmft::imageCubemapFromLatLong(tmp, imageRgba32f, true, dm::stackAlloc);
-                cmft::imageConvert(m_cubemapImage[_which], tfi.convert() ? tfi.cmftFormat() : _image.m_format, tmp);
-                cmft::imageUnload(tmp, dm::stackAlloc);
+                // Resampled face by face straight from the source format.
+                const uint32_t faceSize = dm::min(srcFaceSize, uint32_t(MaxFaceSize));
+                cs::imageCubemapFromLatLong(m_cubemapImage[_which], _image, faceSize, format, dm::mainAlloc);
             }
-            else if (tfi.convert())
+            else
             {
-                if (isCubemap)
+                // Cross and strip layouts are rearranged in the source format, the original layout is released right away.
+                if (!cmft::imageIsCubemap(_image))
                 {
-                    cmft::imageConvert(m_cubemapImage[_which], tfi.cmftFormat(), imageRgba32f);
+                    cmft::Image cubemap;
+                    cmft::imageToCubemap(cubemap, _image);
+                    cmft::imageMove(_image, cubemap);
                 }
-                else
-                {
-                    dm::StackAllocScope scope(dm::stackAlloc);
 
-                    cmft::Image cubemap;
-                    cmft::imageToCubemap(cubemap, imageRgba32f, dm::stackAlloc);
-                    cmft::imageConvert(m_cubemapImage[_which], tfi.cmftFormat(), cubemap);
-                    cmft::imageUnload(cubemap, dm::stackAlloc);
+                srcFaceSize = cmft::imageGetCubemapFaceSize(_image);
+                if (srcFaceSize > MaxFaceSize)
+                {
+                    // Resampled face by face straight from the source format, like latlong input.
+                    cs::imageCubemapResize(m_cubemapImage[_which], _image, MaxFaceSize, format, dm::mainAlloc);
                 }
-            }
-            else //if (!tfi.convert()).
-            {
-                if (isCubemap)
+                // Converted texel by texel, without an intermediate RGBA32F copy.
+                else if (tfi.convert())
                 {
-                    cmft::imageMove(m_cubemapImage[_which], _image);
+                    cmft::imageConvert(m_cubemapImage[_which], format, _image);
                 }
                 else
                 {
-                    cmft::imageToCubemap(m_cubemapImage[_which], _image);
+                    cmft::imageMove(m_cubemapImage[_which], _image);
                 }
             }
 
@@ -1881,10 +2932,16 @@ namespace cs
             }
 
             // Setup texture.
-            imageToTextureRef(m_cubemap[_which], m_cubemapImage[_which]);
+            setupTexture(_which);
+
+            // Keep detail levels of very big skyboxes on disk, the job takes over the source.
+            if (Environment::Skybox == _which
+            &&  srcFaceSize > MaxFaceSize)
+            {
+                skyboxDetailBuild(_image, format);
+            }
 
             // Cleanup.
-            cmft::imageUnload(imageRgba32f, dm::stackAlloc);
             cmft::imageUnload(_image);
 
             return true;
@@ -1931,36 +2988,70 @@ namespace cs
 
         void resize(Environment::Enum _which, uint32_t _faceSize)
         {
+            if (Environment::Skybox == _which)
+            {
+                skyboxDetailInvalidate();
+                m_skyboxVersion++;
+            }
+
             // Resize image.
             cmft::imageResize(m_cubemapImage[_which], _faceSize, _faceSize);
 
             // Setup and send texture to GPU.
-            imageToTextureRef(m_cubemap[_which], m_cubemapImage[_which]);
-            createGpuBuffers(m_cubemap[_which]);
+            setupTexture(_which);
+            createGpuBuffers(_which);
         }
 
         void transformArg(Environment::Enum _which, va_list _argList)
         {
+            if (Environment::Skybox == _which)
+            {
+                skyboxDetailInvalidate();
+                m_skyboxVersion++;
+            }
+
             // Transform image.
             cmft::imageTransformArg(m_cubemapImage[_which], _argList);
 
             // Setup and send texture to GPU.
-            imageToTextureRef(m_cubemap[_which], m_cubemapImage[_which]);
-            createGpuBuffers(m_cubemap[_which]);
+            setupTexture(_which);
+            createGpuBuffers(_which);
         }
 
         void convert(Environment::Enum _which, cmft::TextureFormat::Enum _format)
         {
+            if (Environment::Skybox == _which)
+            {
+                skyboxDetailInvalidate();
+                m_skyboxVersion++;
+            }
+
             // Convert image.
             cmft::imageConvert(m_cubemapImage[_which], _format);
 
             // Setup and send texture to GPU.
-            imageToTextureRef(m_cubemap[_which], m_cubemapImage[_which]);
-            createGpuBuffers(m_cubemap[_which]);
+            setupTexture(_which);
+            createGpuBuffers(_which);
         }
 
         void tonemapSkybox(float _gamma, float _minLum, float _lumRange)
         {
+            // Tonemap is always applied to the original image.
+            const bool hasOrig = cmft::imageIsValid(m_origSkyboxImage);
+            const cmft::Image& source = hasOrig ? m_origSkyboxImage : m_cubemapImage[Environment::Skybox];
+
+            cmft::Image tonemapped;
+            cs::imageTonemap(tonemapped, source, _gamma, _minLum, _lumRange);
+
+            setTonemappedSkybox(tonemapped);
+        }
+
+        void setTonemappedSkybox(cmft::Image& _image)
+        {
+            // Detail levels are kept for the original skybox.
+            skyboxDetailRelease();
+            m_skyboxVersion++;
+
             const bool hasOrig = cmft::imageIsValid(m_origSkyboxImage);
 
             if (!hasOrig)
@@ -1969,40 +3060,19 @@ namespace cs
                 cmft::imageMove(m_origSkyboxImage, m_cubemapImage[Environment::Skybox]);
                 m_origSkybox = m_cubemap[Environment::Skybox];
                 m_cubemap[Environment::Skybox] = cs::TextureHandle::invalid();
-            }
-
-            // Tonemapping is done in rgba32f format.
-            cmft::Image imageRgba32f;
-            cmft::imageConvert(imageRgba32f, cmft::TextureFormat::RGBA32F, m_origSkyboxImage);
-
-            // Get parameters.
-            const uint32_t totalNumChannels = cmft::imageGetNumPixels(imageRgba32f)
-                                            * cmft::getImageDataInfo(cmft::TextureFormat::RGBA32F).m_numChanels;
-            const float* end = (const float*)imageRgba32f.m_data + totalNumChannels;
-
-            // Tonemap.
-            const float invLumRange = 1.0f/_lumRange;
-            for (float* dst = (float*)imageRgba32f.m_data; dst < end; dst+=4)
-            {
-                dst[0] = (powf(dst[0], _gamma) - _minLum)*invLumRange;
-                dst[1] = (powf(dst[1], _gamma) - _minLum)*invLumRange;
-                dst[2] = (powf(dst[2], _gamma) - _minLum)*invLumRange;
-                //dst[3] = leave as is.
-            }
-
-            if (cmft::TextureFormat::RGBA32F == m_cubemapImage[Environment::Skybox].m_format)
-            {
-                cmft::imageMove(m_cubemapImage[Environment::Skybox], imageRgba32f);
+                m_origGpuFormat = m_gpuFormat[Environment::Skybox];
+                spillInvalidate(m_spill[OrigSkyboxSlot]);
             }
             else
             {
-                cmft::imageConvert(m_cubemapImage[Environment::Skybox], m_cubemapImage[Environment::Skybox].m_format, imageRgba32f);
-                cmft::imageUnload(imageRgba32f);
+                cmft::imageUnload(m_cubemapImage[Environment::Skybox]);
             }
 
+            cmft::imageMove(m_cubemapImage[Environment::Skybox], _image);
+
             // Setup and send texture to GPU.
-            imageToTextureRef(m_cubemap[Environment::Skybox], m_cubemapImage[Environment::Skybox]);
-            createGpuBuffers(m_cubemap[Environment::Skybox]);
+            setupTexture(Environment::Skybox);
+            createGpuBuffers(Environment::Skybox);
         }
 
         void restoreOriginalSkybox()
@@ -2010,6 +3080,8 @@ namespace cs
             // Move orig to skybox image and texture.
             if (cmft::imageIsValid(m_origSkyboxImage))
             {
+                m_skyboxVersion++;
+
                 // Move image.
                 cmft::imageMove(m_cubemapImage[Environment::Skybox], m_origSkyboxImage);
 
@@ -2020,6 +3092,183 @@ namespace cs
                 }
                 m_cubemap[Environment::Skybox] = m_origSkybox;
                 m_origSkybox = cs::TextureHandle::invalid();
+                m_gpuFormat[Environment::Skybox] = m_origGpuFormat;
+                spillInvalidate(m_spill[Environment::Skybox]);
+                spillInvalidate(m_spill[OrigSkyboxSlot]);
+            }
+        }
+
+        // Detail levels are written on a job, skyboxDetailSetLevels() picks them up. Takes ownership of '_source'.
+        void skyboxDetailBuild(cmft::Image& _source, cmft::TextureFormat::Enum _format)
+        {
+            SkyboxBuild* build = ::new (BX_ALLOC(dm::mainAlloc, sizeof(SkyboxBuild))) SkyboxBuild();
+            build->m_env         = this;
+            build->m_format      = _format;
+            build->m_minFaceSize = MaxFaceSize;
+            build->m_num         = 0;
+            cmft::imageMove(build->m_source, _source);
+
+            const JobHandle job = jobSubmit(skyboxBuildFunc, build, JobPriority::Low, skyboxBuildComplete, build);
+            if (!isValid(job))
+            {
+                // Skybox is kept at MaxFaceSize.
+                cmft::imageUnload(build->m_source);
+                BX_FREE(dm::mainAlloc, build);
+                return;
+            }
+
+            m_detailBuild = build;
+        }
+
+        void skyboxDetailSetLevels(const SkyboxBuild* _build)
+        {
+            for (uint8_t ii = 0; ii < _build->m_num; ++ii)
+            {
+                m_detailFile[ii]     = _build->m_file[ii];
+                m_detailFaceSize[ii] = _build->m_faceSize[ii];
+                m_detailDataSize[ii] = _build->m_dataSize[ii];
+            }
+            m_detailNum = _build->m_num;
+        }
+
+        // Picks the detail level for '_screenFaceSize' screen pixels per cubemap face and streams it to the GPU.
+        void skyboxDetailUpdate(uint32_t _screenFaceSize)
+        {
+            // Smallest level covering the screen, or the biggest one the GPU can take. Levels are sorted biggest first.
+            // Notice: detail levels don't apply to tonemapped skybox.
+            uint8_t level = UINT8_MAX;
+            if (!cmft::imageIsValid(m_origSkyboxImage)
+            &&  _screenFaceSize > m_cubemapImage[Skybox].m_width)
+            {
+                const uint32_t maxTextureSize = bgfx::getCaps()->maxTextureSize;
+                for (uint8_t ii = 0; ii < m_detailNum; ++ii)
+                {
+                    if (m_detailFaceSize[ii] <= maxTextureSize
+                    && (UINT8_MAX == level || m_detailFaceSize[ii] >= _screenFaceSize))
+                    {
+                        level = ii;
+                    }
+                }
+            }
+
+            if (level == m_detailResident
+            ||  NULL  != m_detailStream) // Decided again once the pending stream completes.
+            {
+                return;
+            }
+
+            if (UINT8_MAX == level)
+            {
+                skyboxDetailRelease();
+                return;
+            }
+
+            // Read from disk on a worker, texture is created on the main thread.
+            SkyboxStream* stream = (SkyboxStream*)BX_ALLOC(dm::mainAlloc, sizeof(SkyboxStream));
+            stream->m_env      = this;
+            stream->m_file     = m_detailFile[level];
+            stream->m_dataSize = m_detailDataSize[level];
+            stream->m_data     = (uint8_t*)BX_ALLOC(dm::mainAlloc, stream->m_dataSize);
+            stream->m_level    = level;
+            stream->m_cancelled = false;
+            stream->m_closeFile = false;
+
+            m_detailJob = jobSubmit(skyboxStreamFunc, stream, JobPriority::Normal, skyboxStreamComplete, stream);
+            if (!isValid(m_detailJob))
+            {
+                BX_FREE(dm::mainAlloc, stream->m_data);
+                BX_FREE(dm::mainAlloc, stream);
+                return;
+            }
+
+            m_detailStream = stream;
+        }
+
+        // Takes ownership of '_stream' data.
+        void skyboxDetailSet(SkyboxStream* _stream)
+        {
+            if (isValid(m_skyboxDetail))
+            {
+                release(m_skyboxDetail);
+            }
+            m_skyboxDetail = s_textures->create();
+
+            TextureImpl* tex = s_textures->getImpl(m_skyboxDetail);
+            tex->m_size     = _stream->m_dataSize;
+            tex->m_data     = _stream->m_data;
+            tex->m_numMips  = 1;
+            tex->m_width    = (uint16_t)m_detailFaceSize[_stream->m_level];
+            tex->m_height   = (uint16_t)m_detailFaceSize[_stream->m_level];
+            tex->m_format   = cmftToBgfx(m_detailFormat).bgfxFormat();
+            tex->m_type     = TextureImpl::Type::TexCube;
+            tex->m_freeData = true;
+
+            // Only the GPU copy is kept, level is read from disk again when needed.
+            createGpuBuffers(m_skyboxDetail);
+            tex->freeMem(true);
+
+            m_detailResident = _stream->m_level;
+        }
+
+        // Releases resident detail level and cancels pending stream. Levels on disk are kept.
+        // Notice: cancelled stream stays pending until it completes, no other stream is started meanwhile.
+        void skyboxDetailRelease()
+        {
+            if (NULL != m_detailStream)
+            {
+                m_detailStream->m_cancelled = true;
+            }
+
+            if (isValid(m_skyboxDetail))
+            {
+                release(m_skyboxDetail);
+                m_skyboxDetail = cs::TextureHandle::invalid();
+            }
+
+            m_detailResident = UINT8_MAX;
+        }
+
+        void skyboxDetailDiscard()
+        {
+            skyboxDetailRelease();
+
+            // Pending build is detached, its levels are closed on completion.
+            if (NULL != m_detailBuild)
+            {
+                m_detailBuild->m_env = NULL;
+                m_detailBuild = NULL;
+            }
+
+            // Pending stream may still be reading from its file. It is detached and closes the file on completion.
+            uint8_t streamLevel = UINT8_MAX;
+            if (NULL != m_detailStream)
+            {
+                streamLevel = m_detailStream->m_level;
+                m_detailStream->m_closeFile = true;
+                m_detailStream->m_env = NULL;
+                m_detailStream = NULL;
+            }
+
+            for (uint8_t ii = 0; ii < m_detailNum; ++ii)
+            {
+                if (ii != streamLevel)
+                {
+                    fclose(m_detailFile[ii]);
+                }
+            }
+            m_detailNum = 0;
+        }
+
+        // Detail levels are kept while the original skybox can still be restored.
+        void skyboxDetailInvalidate()
+        {
+            if (cmft::imageIsValid(m_origSkyboxImage))
+            {
+                skyboxDetailRelease();
+            }
+            else
+            {
+                skyboxDetailDiscard();
             }
         }
 
@@ -2034,11 +3283,35 @@ namespace cs
             }
         }
 
+        // Encoded upload copy is released right after the upload, like the skybox detail level.
+        void createGpuBuffers(Environment::Enum _which)
+        {
+            TextureImpl* cube = s_textures->getImpl(m_cubemap[_which]);
+            if (isValid(cube->m_bgfxHandle))
+            {
+                return;
+            }
+
+            if (m_gpuFormat[_which].m_format != cmftToBgfx(m_cubemapImage[_which].m_format).bgfxFormat()
+            &&  NULL == cube->m_data)
+            {
+                makeResident();
+                encodeTexture(_which);
+            }
+
+            createGpuBuffers(m_cubemap[_which]);
+
+            if (cube->m_freeData)
+            {
+                cube->freeMem(true);
+            }
+        }
+
         void createGpuBuffers()
         {
-            createGpuBuffers(m_cubemap[Environment::Skybox]);
-            createGpuBuffers(m_cubemap[Environment::Pmrem]);
-            createGpuBuffers(m_cubemap[Environment::Iem]);
+            createGpuBuffers(Environment::Skybox);
+            createGpuBuffers(Environment::Pmrem);
+            createGpuBuffers(Environment::Iem);
         }
 
         void read(dm::ReaderSeekerI* _reader, EnvHandle _handle = EnvHandle::invalid(), dm::StackAllocatorI* _stack = dm::stackAlloc)
@@ -2059,62 +3332,263 @@ namespace cs
             }
             for (uint16_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
             {
-                bx::read(_reader, m_lights[ii].m_colorStrenght, 4*sizeof(float));
-                bx::read(_reader, m_lights[ii].m_dirEnabled,    4*sizeof(float));
+                bx::read(_reader, m_lights[ii].m_colorStrenght, 4*sizeof(float));
+                bx::read(_reader, m_lights[ii].m_dirEnabled,    4*sizeof(float));
+            }
+            for (uint16_t ii = 0; ii < Environment::Count; ++ii)
+            {
+                cmft::Image image;
+                bx::read(_reader, image.m_width);
+                bx::read(_reader, image.m_height);
+                bx::read(_reader, image.m_dataSize);
+                bx::read(_reader, image.m_format);
+                bx::read(_reader, image.m_numMips);
+                bx::read(_reader, image.m_numFaces);
+                image.m_data = BX_ALLOC(dm::mainAlloc, image.m_dataSize);
+                bx::read(_reader, image.m_data, image.m_dataSize);
+                this->load(Environment::Enum(ii), image);
+            }
+        }
+
+        void write(bx::WriterI* _writer, uint16_t _id = ResourceId::Invalid) const
+        {
+            bx::write(_writer, _id);
+            bx::write(_writer, m_lightsNum);
+            bx::write(_writer, m_edgeFixup);
+            for (uint16_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
+            {
+                bx::write(_writer, m_lightUseBackgroundColor[ii]);
+            }
+            for (uint16_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
+            {
+                bx::write(_writer, m_lights[ii].m_colorStrenght, 4*sizeof(float));
+                bx::write(_writer, m_lights[ii].m_dirEnabled,    4*sizeof(float));
+            }
+            for (uint16_t ii = 0; ii < Environment::Count; ++ii)
+            {
+                bx::write(_writer, m_cubemapImage[ii].m_width);
+                bx::write(_writer, m_cubemapImage[ii].m_height);
+                bx::write(_writer, m_cubemapImage[ii].m_dataSize);
+                bx::write(_writer, m_cubemapImage[ii].m_format);
+                bx::write(_writer, m_cubemapImage[ii].m_numMips);
+                bx::write(_writer, m_cubemapImage[ii].m_numFaces);
+                bx::write(_writer, m_cubemapImage[ii].m_data, m_cubemapImage[ii].m_dataSize);
+            }
+        }
+
+        void freeMem()
+        {
+            spillTaskCancel(m_spillTask);
+
+            cmft::imageUnload(m_cubemapImage[Skybox]);
+            cmft::imageUnload(m_cubemapImage[Pmrem]);
+            cmft::imageUnload(m_cubemapImage[Iem]);
+            cmft::imageUnload(m_origSkyboxImage);
+
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
+            {
+                spillClose(m_spill[ii]);
+            }
+            m_evicted = false;
+        }
+
+        cmft::Image& spillImage(uint8_t _slot)
+        {
+            return (OrigSkyboxSlot == _slot) ? m_origSkyboxImage : m_cubemapImage[_slot];
+        }
+
+        // Bytes that evictBegin() would free. Environments are evicted only after all their cubemaps are on the GPU.
+        uint64_t evictableSize()
+        {
+            const cs::TextureHandle textures[] =
+            {
+                m_cubemap[Skybox],
+                m_cubemap[Pmrem],
+                m_cubemap[Iem],
+                m_origSkybox,
+            };
+
+            uint64_t size = 0;
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
+            {
+                if (isValid(textures[ii]))
+                {
+                    const TextureImpl* tex = s_textures->getImpl(textures[ii]);
+                    if (bgfx::invalidHandle == tex->m_bgfxHandle.idx)
+                    {
+                        return 0;
+                    }
+
+                    // Compact gpu format copies.
+                    if (tex->m_freeData && NULL != tex->m_data)
+                    {
+                        size += tex->m_size;
+                    }
+                }
+
+                const cmft::Image& image = spillImage(ii);
+                if (NULL != image.m_data)
+                {
+                    size += image.m_dataSize;
+                }
+            }
+
+            return size;
+        }
+
+        // Starts writing cpu side images to spill files on a job, evictEnd() releases them once the job is done.
+        // GPU textures are kept.
+        bool evictBegin()
+        {
+            if (m_spillTask.pending()
+            ||  0 == evictableSize())
+            {
+                return false;
+            }
+
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
+            {
+                cmft::Image& image = spillImage(ii);
+                if (NULL != image.m_data)
+                {
+                    spillTaskAdd(m_spillTask, m_spill[ii], image.m_data, image.m_dataSize);
+                }
+            }
+
+            return spillTaskSubmit(m_spillTask, SpillTask::Type::Write);
+        }
+
+        // Image descriptions stay valid, only image data is released.
+        // Images are read back by prefetch() or on the next cpu side access, see makeResident().
+        void evictEnd()
+        {
+            bx::MutexScope lock(s_residencyMutex);
+
+            jobWait(m_spillTask.m_job);
+
+            const cs::TextureHandle textures[] =
+            {
+                m_cubemap[Skybox],
+                m_cubemap[Pmrem],
+                m_cubemap[Iem],
+                m_origSkybox,
+            };
+
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
+            {
+                // Upload data is not needed anymore, textures are set up again from the images when they change.
+                if (isValid(textures[ii]))
+                {
+                    TextureImpl* tex = s_textures->getImpl(textures[ii]);
+                    if (tex->m_freeData)
+                    {
+                        tex->freeMem(true);
+                    }
+                    else
+                    {
+                        tex->m_data = NULL;
+                        tex->m_size = 0;
+                    }
+                }
+            }
+
+            for (uint8_t ii = 0; ii < m_spillTask.m_num; ++ii)
+            {
+                if (m_spillTask.m_done[ii])
+                {
+                    SpillFile* spill = m_spillTask.m_spill[ii];
+                    cmft::Image& image = spillImage(uint8_t(spill - m_spill));
+
+                    // Memory may still be referenced by bgfx.
+                    BX_FREE(cs::delayedFree, image.m_data);
+                    image.m_data = NULL;
+                    spill->m_evicted = true;
+                    m_evicted = true;
+                }
+            }
+            spillTaskReset(m_spillTask);
+        }
+
+        // Starts reading evicted images back on a job, readEnd() or makeResident() takes them over.
+        void prefetch()
+        {
+            m_lastUse = g_frameNum;
+
+            if (!m_evicted
+            ||  m_spillTask.pending())
+            {
+                return;
             }
-            for (uint16_t ii = 0; ii < Environment::Count; ++ii)
+
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
             {
-                cmft::Image image;
-                bx::read(_reader, image.m_width);
-                bx::read(_reader, image.m_height);
-                bx::read(_reader, image.m_dataSize);
-                bx::read(_reader, image.m_format);
-                bx::read(_reader, image.m_numMips);
-                bx::read(_reader, image.m_numFaces);
-                image.m_data = BX_ALLOC(dm::mainAlloc, image.m_dataSize);
-                bx::read(_reader, image.m_data, image.m_dataSize);
-                this->load(Environment::Enum(ii), image);
+                if (m_spill[ii].m_evicted)
+                {
+                    spillTaskAdd(m_spillTask, m_spill[ii]);
+                }
             }
+
+            spillTaskSubmit(m_spillTask, SpillTask::Type::Read);
         }
 
-        void write(bx::WriterI* _writer, uint16_t _id = ResourceId::Invalid) const
+        void readEnd()
         {
-            bx::write(_writer, _id);
-            bx::write(_writer, m_lightsNum);
-            bx::write(_writer, m_edgeFixup);
-            for (uint16_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
-            {
-                bx::write(_writer, m_lightUseBackgroundColor[ii]);
-            }
-            for (uint16_t ii = 0; ii < CS_MAX_LIGHTS; ++ii)
+            jobWait(m_spillTask.m_job);
+
+            for (uint8_t ii = 0; ii < m_spillTask.m_num; ++ii)
             {
-                bx::write(_writer, m_lights[ii].m_colorStrenght, 4*sizeof(float));
-                bx::write(_writer, m_lights[ii].m_dirEnabled,    4*sizeof(float));
+                SpillFile* spill = m_spillTask.m_spill[ii];
+                spillImage(uint8_t(spill - m_spill)).m_data = m_spillTask.m_data[ii];
+                spill->m_evicted = false;
             }
-            for (uint16_t ii = 0; ii < Environment::Count; ++ii)
+            spillTaskReset(m_spillTask);
+
+            m_evicted = false;
+            for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
             {
-                bx::write(_writer, m_cubemapImage[ii].m_width);
-                bx::write(_writer, m_cubemapImage[ii].m_height);
-                bx::write(_writer, m_cubemapImage[ii].m_dataSize);
-                bx::write(_writer, m_cubemapImage[ii].m_format);
-                bx::write(_writer, m_cubemapImage[ii].m_numMips);
-                bx::write(_writer, m_cubemapImage[ii].m_numFaces);
-                bx::write(_writer, m_cubemapImage[ii].m_data, m_cubemapImage[ii].m_dataSize);
+                m_evicted |= m_spill[ii].m_evicted;
             }
         }
 
-        void freeMem()
+        void makeResident()
         {
-            cmft::imageUnload(m_cubemapImage[Skybox]);
-            cmft::imageUnload(m_cubemapImage[Pmrem]);
-            cmft::imageUnload(m_cubemapImage[Iem]);
-            cmft::imageUnload(m_origSkyboxImage);
+            m_lastUse = g_frameNum;
+
+            if (m_evicted
+            ||  m_spillTask.pending())
+            {
+                bx::MutexScope lock(s_residencyMutex);
+
+                // Images read back by prefetch() are taken over. Images are still in memory while they are being written.
+                if (SpillTask::Type::Read == m_spillTask.m_type)
+                {
+                    readEnd();
+                }
+                spillTaskCancel(m_spillTask);
+
+                // Anything else is read on this thread.
+                for (uint8_t ii = 0; ii < NumSpillSlots; ++ii)
+                {
+                    if (m_spill[ii].m_evicted)
+                    {
+                        spillImage(ii).m_data = spillRead(m_spill[ii]);
+                        m_spill[ii].m_evicted = false;
+                    }
+                }
+                m_evicted = false;
+            }
         }
 
         void destroy()
         {
             freeMem();
 
+            skyboxDetailDiscard();
+            if (this == s_skyboxDetailEnv)
+            {
+                s_skyboxDetailEnv = NULL;
+            }
+
             #define CS_SAFE_TEXTURE_RELEASE(_tex) if (isValid(_tex)) { release(_tex); }
             CS_SAFE_TEXTURE_RELEASE(m_cubemap[Skybox]);
             CS_SAFE_TEXTURE_RELEASE(m_cubemap[Pmrem]);
@@ -2123,8 +3597,71 @@ namespace cs
             CS_SAFE_TEXTURE_RELEASE(m_origSkybox);
             #undef CS_SAFE_TEXTURE_RELEASE
         }
+
+        EnvGpuFormat m_origGpuFormat;
+        FILE*    m_detailFile[MaxDetailLevels];
+        uint32_t m_detailFaceSize[MaxDetailLevels];
+        uint32_t m_detailDataSize[MaxDetailLevels];
+        cmft::TextureFormat::Enum m_detailFormat;
+        uint8_t  m_detailNum;
+        uint8_t  m_detailResident;
+        SkyboxStream* m_detailStream;
+        JobHandle m_detailJob;
+        SkyboxBuild* m_detailBuild;
+        SpillFile m_spill[NumSpillSlots];
+        SpillTask m_spillTask;
+        uint32_t m_lastUse; // Frame number of the last cpu side access.
+        bool     m_evicted; // Set while any image is only in its spill file.
     };
 
+    static void skyboxStreamComplete(int32_t _result, void* _userData)
+    {
+        SkyboxStream* stream = (SkyboxStream*)_userData;
+        EnvironmentImpl* env = stream->m_env;
+
+        if (NULL != env)
+        {
+            env->m_detailStream = NULL;
+        }
+
+        if (NULL != env && 0 == _result && !stream->m_cancelled)
+        {
+            env->skyboxDetailSet(stream);
+        }
+        else
+        {
+            BX_FREE(dm::mainAlloc, stream->m_data);
+        }
+
+        if (stream->m_closeFile)
+        {
+            fclose(stream->m_file);
+        }
+
+        BX_FREE(dm::mainAlloc, stream);
+    }
+
+    static void skyboxBuildComplete(int32_t /*_result*/, void* _userData)
+    {
+        SkyboxBuild* build = (SkyboxBuild*)_userData;
+        EnvironmentImpl* env = build->m_env;
+
+        if (NULL != env)
+        {
+            env->m_detailBuild = NULL;
+            env->skyboxDetailSetLevels(build);
+        }
+        else
+        {
+            for (uint8_t ii = 0; ii < build->m_num; ++ii)
+            {
+                fclose(build->m_file[ii]);
+            }
+        }
+
+        BX_FREE(dm::mainAlloc, build);
+    }
+
     struct EnvironmentResourceManager : public ResourceManagerT<Environment, EnvironmentImpl, EnvHandle, CS_MAX_ENVIRONMENTS>
     {
         EnvHandle create(uint32_t _rgba)
@@ -2165,6 +3702,14 @@ namespace cs
     };
     static EnvironmentResourceManager* s_environments;
 
+    // Every cpu side access to environment image data goes through here, evicted images are read back from spill files.
+    static EnvironmentImpl* envGetResidentImpl(EnvHandle _handle)
+    {
+        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        env->makeResident();
+        return env;
+    }
+
     EnvHandle envCreateCmftStudioLogo()
     {
         const EnvHandle env = s_environments->load(g_logoSkybox, g_logoSkyboxSize
@@ -2194,19 +3739,19 @@ namespace cs
 
     void envLoad(EnvHandle _handle, Environment::Enum _which, cmft::Image& _image)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         env->load(_which, _image);
     }
 
     bool envLoad(EnvHandle _handle, Environment::Enum _which, const char* _filePath)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         return env->load(_which, _filePath);
     }
 
     void envTransform_UseMacroInstead(EnvHandle _handle, Environment::Enum _which, ...)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
 
         va_list argList;
         va_start(argList, _which);
@@ -2216,34 +3761,70 @@ namespace cs
 
     void envResize(EnvHandle _handle, Environment::Enum _which, uint32_t _faceSize)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         env->resize(_which, _faceSize);
     }
 
     void envConvert(EnvHandle _handle, Environment::Enum _which, cmft::TextureFormat::Enum _format)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         env->convert(_which, _format);
     }
 
     void envTonemap(EnvHandle _handle, float _gamma, float _minLum, float _lumRange)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         env->tonemapSkybox(_gamma, _minLum, _lumRange);
     }
 
+    void envTonemap(EnvHandle _handle, cmft::Image& _tonemapped)
+    {
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
+        env->setTonemappedSkybox(_tonemapped);
+    }
+
     void envRestoreSkybox(EnvHandle _handle)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         env->restoreOriginalSkybox();
     }
 
+    void envUpdateSkyboxDetail(EnvHandle _handle, float _fov, float _viewportHeight)
+    {
+        EnvironmentImpl* env = isValid(_handle) ? s_environments->getImpl(_handle) : NULL;
+
+        // Only the visible environment keeps its detail level on the GPU.
+        if (NULL != s_skyboxDetailEnv
+        &&  env  != s_skyboxDetailEnv)
+        {
+            s_skyboxDetailEnv->skyboxDetailRelease();
+        }
+        s_skyboxDetailEnv = env;
+
+        if (NULL != env)
+        {
+            // Cubemap face spans 90 degrees, that is tan(45deg) = 1 on each side of its center.
+            const float screenFaceSize = _viewportHeight/tanf(bx::toRad(_fov)*0.5f);
+            env->skyboxDetailUpdate(uint32_t(screenFaceSize));
+        }
+    }
+
     cmft::Image& envGetImage(EnvHandle _handle, Environment::Enum _which)
     {
-        EnvironmentImpl* env = s_environments->getImpl(_handle);
+        EnvironmentImpl* env = envGetResidentImpl(_handle);
         return env->m_cubemapImage[_which];
     }
 
+    Environment& envGetResident(EnvHandle _handle)
+    {
+        return *envGetResidentImpl(_handle);
+    }
+
+    void envPrefetch(EnvHandle _handle)
+    {
+        s_environments->getImpl(_handle)->prefetch();
+    }
+
     // Lists.
     //-----
 
@@ -2702,9 +4283,316 @@ namespace cs
         env->createGpuBuffers();
     }
 
+    // Gpu upload.
+    //-----
+
+    struct GpuUploadQueue
+    {
+        enum { MaxPending = CS_MAX_TEXTURES+CS_MAX_MESHES+CS_MAX_ENVIRONMENTS };
+
+        struct Type
+        {
+            enum Enum
+            {
+                Texture,
+                Mesh,
+                Env,
+            };
+        };
+
+        struct Entry
+        {
+            Type::Enum m_type;
+            uint16_t m_idx;
+        };
+
+        GpuUploadQueue()
+        {
+            m_maxBytes = DM_MEGABYTES(16);
+            m_maxMs    = 4.0;
+            m_head     = 0;
+            m_count    = 0;
+            memset(&m_stats, 0, sizeof(m_stats));
+        }
+
+        uint32_t size(const Entry& _entry) const
+        {
+            uint32_t size = 0;
+
+            if (Type::Texture == _entry.m_type)
+            {
+                const TextureHandle handle = { _entry.m_idx };
+                size = s_textures->getImpl(handle)->m_size;
+            }
+            else if (Type::Mesh == _entry.m_type)
+            {
+                const MeshHandle handle = { _entry.m_idx };
+                MeshImpl* mesh = s_meshes->getImpl(handle);
+                for (uint32_t ii = 0, end = mesh->m_groups.count(); ii < end; ++ii)
+                {
+                    size += mesh->m_groups[ii].m_vertexSize + mesh->m_groups[ii].m_indexSize;
+                }
+            }
+            else //if (Type::Env == _entry.m_type).
+            {
+                const EnvHandle handle = { _entry.m_idx };
+                const EnvironmentImpl* env = s_environments->getImpl(handle);
+                for (uint8_t ii = 0; ii < Environment::Count; ++ii)
+                {
+                    size += env->m_gpuFormat[ii].m_gpuSize;
+                }
+            }
+
+            return size;
+        }
+
+        // Creates gpu buffers and releases the reference taken by push().
+        void upload(const Entry& _entry)
+        {
+            if (Type::Texture == _entry.m_type)
+            {
+                const TextureHandle handle = { _entry.m_idx };
+                createGpuBuffers(handle);
+                release(handle);
+            }
+            else if (Type::Mesh == _entry.m_type)
+            {
+                const MeshHandle handle = { _entry.m_idx };
+                createGpuBuffers(handle);
+                release(handle);
+            }
+            else //if (Type::Env == _entry.m_type).
+            {
+                const EnvHandle handle = { _entry.m_idx };
+                createGpuBuffers(handle);
+                release(handle);
+            }
+        }
+
+        void push(Type::Enum _type, uint16_t _idx)
+        {
+            const Entry entry = { _type, _idx };
+
+            // New batch, statistics start over.
+            if (0 == m_count)
+            {
+                memset(&m_stats, 0, sizeof(m_stats));
+            }
+
+            // Full queue is not expected, upload right away.
+            if (MaxPending == m_count)
+            {
+                upload(entry);
+                return;
+            }
+
+            m_entries[(m_head+m_count)%MaxPending] = entry;
+            m_count++;
+            m_stats.m_numPending = m_count;
+        }
+
+        // Uploads queued resources in order while both budgets allow it, at least one per call.
+        void update(bool _ignoreBudget)
+        {
+            if (0 == m_count)
+            {
+                return;
+            }
+
+            const double beginMs = timerCurrentMs();
+            uint32_t frameBytes = 0;
+
+            while (0 != m_count)
+            {
+                const Entry& entry = m_entries[m_head];
+                const uint32_t entrySize = size(entry);
+
+                if (!_ignoreBudget
+                &&  0 != frameBytes
+                && (frameBytes + entrySize > m_maxBytes || timerCurrentMs() - beginMs > m_maxMs))
+                {
+                    break;
+                }
+
+                upload(entry);
+                frameBytes += entrySize;
+
+                m_head = (m_head+1)%MaxPending;
+                m_count--;
+                m_stats.m_numUploaded++;
+            }
+
+            const double frameMs = timerCurrentMs() - beginMs;
+
+            m_stats.m_numFrames++;
+            m_stats.m_numPending = m_count;
+            m_stats.m_totalBytes += frameBytes;
+            m_stats.m_totalMs    += frameMs;
+            m_stats.m_maxFrameMs  = dm::max(m_stats.m_maxFrameMs, frameMs);
+            m_stats.m_mbPerSec    = (0.0 != m_stats.m_totalMs)
+                                  ? double(m_stats.m_totalBytes)/(1024.0*1024.0)/(m_stats.m_totalMs*0.001)
+                                  : 0.0
+                                  ;
+        }
+
+        uint32_t m_maxBytes;
+        double   m_maxMs;
+        uint16_t m_head;
+        uint16_t m_count;
+        GpuUploadStats m_stats;
+        Entry m_entries[MaxPending];
+    };
+    static GpuUploadQueue s_gpuUploads;
+
+    void gpuUploadSetBudget(uint32_t _maxBytesPerFrame, double _maxMsPerFrame)
+    {
+        s_gpuUploads.m_maxBytes = _maxBytesPerFrame;
+        s_gpuUploads.m_maxMs    = _maxMsPerFrame;
+    }
+
+    void gpuUploadQueue(TextureHandle _handle)
+    {
+        s_gpuUploads.push(GpuUploadQueue::Type::Texture, acquire(_handle).m_idx);
+    }
+
+    void gpuUploadQueue(MeshHandle _handle)
+    {
+        s_gpuUploads.push(GpuUploadQueue::Type::Mesh, acquire(_handle).m_idx);
+    }
+
+    void gpuUploadQueue(EnvHandle _handle)
+    {
+        s_gpuUploads.push(GpuUploadQueue::Type::Env, acquire(_handle).m_idx);
+    }
+
+    uint16_t gpuUploadUpdate()
+    {
+        s_gpuUploads.update(false);
+        return s_gpuUploads.m_count;
+    }
+
+    void gpuUploadFlush()
+    {
+        s_gpuUploads.update(true);
+    }
+
+    const GpuUploadStats& gpuUploadStats()
+    {
+        return s_gpuUploads.m_stats;
+    }
+
+    // Host memory residency.
+    //-----
+
+    static uint64_t s_residencyBudget;
+
+    void residencySetBudget(uint64_t _budget)
+    {
+        s_residencyBudget = _budget;
+    }
+
+    void residencyUpdate()
+    {
+        // Resources accessed in the last few frames are kept, visible environment is accessed every frame.
+        enum { MinIdleFrames = 3 };
+
+        TextureHandle textures[CS_MAX_TEXTURES];
+        EnvHandle     envs[CS_MAX_ENVIRONMENTS];
+        const uint16_t numTextures = s_textures->getHandles(textures);
+        const uint16_t numEnvs     = s_environments->getHandles(envs);
+
+        // Sum up resident cpu copies and find the least recently used one. Finished spill jobs are picked up on the way.
+        uint64_t resident = 0;
+        uint32_t maxIdle  = MinIdleFrames-1;
+        bool     writing  = false;
+        TextureImpl*     lruTex = NULL;
+        EnvironmentImpl* lruEnv = NULL;
+        TextureImpl*     mapped = NULL;
+
+        for (uint16_t ii = 0; ii < numTextures; ++ii)
+        {
+            TextureImpl* tex = s_textures->getImpl(textures[ii]);
+            if (tex->m_spillTask.done())
+            {
+                tex->evictEnd();
+            }
+            writing |= tex->m_spillTask.pending();
+
+            if (NULL != tex->m_mapped
+            &&  bgfx::invalidHandle != tex->m_bgfxHandle.idx
+            &&  !tex->m_spillTask.pending())
+            {
+                mapped = tex;
+            }
+
+            const uint32_t size = tex->evictableSize();
+            const uint32_t idle = g_frameNum - tex->m_lastUse;
+
+            resident += size;
+            if (0 != size && idle > maxIdle && !tex->m_spillTask.pending())
+            {
+                maxIdle = idle;
+                lruTex  = tex;
+                lruEnv  = NULL;
+            }
+        }
+
+        for (uint16_t ii = 0; ii < numEnvs; ++ii)
+        {
+            EnvironmentImpl* env = s_environments->getImpl(envs[ii]);
+            if (env->m_spillTask.done())
+            {
+                if (SpillTask::Type::Write == env->m_spillTask.m_type)
+                {
+                    env->evictEnd();
+                }
+                else
+                {
+                    bx::MutexScope lock(s_residencyMutex);
+                    env->readEnd();
+                }
+            }
+            writing |= (SpillTask::Type::Write == env->m_spillTask.m_type);
+
+            const uint64_t size = env->evictableSize();
+            const uint32_t idle = g_frameNum - env->m_lastUse;
+
+            resident += size;
+            if (0 != size && idle > maxIdle && !env->m_spillTask.pending())
+            {
+                maxIdle = idle;
+                lruTex  = NULL;
+                lruEnv  = env;
+            }
+        }
+
+        // Spill files are written on a job, one resource at a time. Uploaded mapped files are released regardless of the budget.
+        if (writing)
+        {
+            return;
+        }
+
+        if (NULL != mapped)
+        {
+            mapped->unmapBegin();
+        }
+        else if (0 != s_residencyBudget
+             &&  resident > s_residencyBudget)
+        {
+            if (NULL != lruTex)
+            {
+                lruTex->evictBegin();
+            }
+            else if (NULL != lruEnv)
+            {
+                lruEnv->evictBegin();
+            }
+        }
+    }
+
     void write(bx::WriterI* _writer, TextureHandle _handle)
     {
-        const cs::TextureImpl* tex = s_textures->getImpl(_handle);
+        cs::TextureImpl* tex = s_textures->getImpl(_handle);
         const char* texName = s_textures->getName(_handle);
 
         // Write name.
@@ -2714,6 +4602,7 @@ namespace cs
         bx::write(_writer, name, nameLen);
 
         // Write object.
+        tex->makeResident();
         tex->write(_writer, _handle.m_idx);
     }
 
@@ -2749,7 +4638,7 @@ namespace cs
 
     void write(bx::WriterI* _writer, EnvHandle _handle)
     {
-        const cs::EnvironmentImpl* env = s_environments->getImpl(_handle);
+        const cs::EnvironmentImpl* env = envGetResidentImpl(_handle);
         const char* envName = s_environments->getName(_handle);
 
         // Write name.
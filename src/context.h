@@ -11,6 +11,8 @@
 
 #include "common/cmft.h"            // cmft::Image
 #include "common/datastructures.h"
+#include "common/mipmap.h"          // cs::MipFilter, cs::MipContent
+#include "common/texcompress.h"     // cs::TextureCompression
 
 #include <bgfx/bgfx.h>              // bgfx::TextureHandle
 #include <dm/readerwriter.h>        // bx::WriterI, bx::ReaderSeekerI
@@ -211,6 +213,25 @@ namespace cs
     cs::TextureHandle   textureLoad(const char* _path);
     cs::TextureHandle   textureLoad(const void* _data, uint32_t _size);
     cs::TextureHandle   textureLoadRaw(const void* _data, uint32_t _size);
+
+    /// Decodes '_path' on a job worker, GPU texture is created later from textureUploadPending(). '_userData' is handed back with
+    /// the texture. Decoded 8-bit images get the full mip chain, filtered according to '_mipContent', and are block compressed
+    /// on the worker when '_compression' is set. Returns false when too many loads are in flight or job queue is full.
+    bool                textureLoadAsync(const char* _path
+                                       , const char* _name
+                                       , uint16_t _userData = 0
+                                       , MipFilter::Enum _mipFilter = MipFilter::Kaiser
+                                       , MipContent::Enum _mipContent = MipContent::Linear
+                                       , TextureCompression::Enum _compression = TextureCompression::None
+                                       );
+
+    /// Call once per frame from the main thread. Decoded files are uploaded through gpuUploadQueue(), this hands back textures
+    /// that are on the GPU, in completion order. Up to '_max' textures and their user data are written out, returns their count.
+    uint16_t            textureUploadPending(cs::TextureHandle* _handles, uint16_t* _userData, uint16_t _max);
+
+    /// Number of textureLoadAsync() requests not yet handed back by textureUploadPending().
+    uint16_t            textureLoadsInFlight();
+
     bgfx::TextureHandle textureGetBgfxHandle(cs::TextureHandle _handle);
 
 
@@ -262,6 +283,16 @@ namespace cs
     // Environment.
     //-----
 
+    // Format of environment cubemap on the GPU, chosen per map from measured range and error.
+    struct EnvGpuFormat
+    {
+        bgfx::TextureFormat::Enum m_format;
+        uint32_t m_srcSize;  // Cpu side image size in bytes.
+        uint32_t m_gpuSize;  // Uploaded size in bytes.
+        float    m_maxValue; // Biggest rgb channel value, 1.0 for 8-bit formats.
+        float    m_error;    // Relative rgb error of m_format compared to the cpu side image.
+    };
+
     struct Environment
     {
         enum Enum
@@ -278,8 +309,11 @@ namespace cs
         cs::TextureHandle m_cubemap[Count];
         cs::TextureHandle m_latlong[Count];
         cs::TextureHandle m_origSkybox;
+        cs::TextureHandle m_skyboxDetail; // Higher resolution skybox level, valid while resident, see envUpdateSkyboxDetail().
+        EnvGpuFormat m_gpuFormat[Count];
         DirectionalLight m_lights[CS_MAX_LIGHTS];
         cmft::EdgeFixup::Enum m_edgeFixup;
+        uint32_t m_skyboxVersion; // Incremented each time the skybox image is replaced or modified.
         uint8_t m_lightsNum;
         bool m_lightUseBackgroundColor[CS_MAX_LIGHTS];
     };
@@ -295,8 +329,12 @@ namespace cs
     void         envResize(EnvHandle _handle, Environment::Enum _which, uint32_t _faceSize);
     void         envConvert(EnvHandle _handle, Environment::Enum _which, cmft::TextureFormat::Enum _format);
     void         envTonemap(EnvHandle _handle, float _gamma, float _minLum, float _lumRange);
+    void         envTonemap(EnvHandle _handle, cmft::Image& _tonemapped); // Notice: this takes ownership of '_tonemapped'.
     void         envRestoreSkybox(EnvHandle _handle);
+    void         envUpdateSkyboxDetail(EnvHandle _handle, float _fov, float _viewportHeight); // Call once per frame with visible skybox env or invalid handle.
     cmft::Image& envGetImage(EnvHandle _handle, Environment::Enum _which);
+    Environment& envGetResident(EnvHandle _handle); // Like getObj(), evicted image data is read back first.
+    void         envPrefetch(EnvHandle _handle); // Keeps environment in memory, evicted images are read back on a job.
 
 
     // Resource resolver.
@@ -432,6 +470,41 @@ namespace cs
     void createGpuBuffers(MeshHandle _handle);
     void createGpuBuffers(EnvHandle _handle);
 
+    // Gpu upload.
+    //-----
+
+    /// Statistics of the current upload batch. A batch starts when a resource is queued to an empty queue.
+    struct GpuUploadStats
+    {
+        uint64_t m_totalBytes;
+        double   m_totalMs;    // Time spent uploading, summed over frames.
+        double   m_maxFrameMs;
+        double   m_mbPerSec;
+        uint16_t m_numUploaded;
+        uint16_t m_numPending;
+        uint16_t m_numFrames;
+    };
+
+    /// Resources are uploaded in queue order, at least one per frame and more while both budgets allow it.
+    void     gpuUploadSetBudget(uint32_t _maxBytesPerFrame, double _maxMsPerFrame);
+    void     gpuUploadQueue(TextureHandle _handle);
+    void     gpuUploadQueue(MeshHandle _handle);
+    void     gpuUploadQueue(EnvHandle _handle);
+    uint16_t gpuUploadUpdate(); // Call once per frame from the main thread, returns the number of resources still pending.
+    void     gpuUploadFlush();  // Uploads everything pending, regardless of the budget.
+    const GpuUploadStats& gpuUploadStats();
+
+    // Host memory residency.
+    //-----
+
+    /// Cpu copies of textures and environment images that are already on the GPU are moved to temporary files, least recently
+    /// used first, while they take more than '_budget' bytes. Zero keeps everything in memory. Spill files are written on a job.
+    /// Textures loaded from mapped files are moved to spill files after the upload regardless of the budget, files are not kept open.
+    /// Image descriptions stay valid, getObj(EnvHandle) does not read data back. Data is read back by envPrefetch() on a job,
+    /// or on the next access that needs it: envGetResident(), envGetImage(), env*() and write().
+    void residencySetBudget(uint64_t _budget);
+    void residencyUpdate(); // Call once per frame from the main thread, while no background job reads resource data.
+
     void write(bx::WriterI* _writer, TextureHandle _handle);
     void write(bx::WriterI* _writer, MaterialHandle _handle);
     void write(bx::WriterI* _writer, MeshHandle _handle);
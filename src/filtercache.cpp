@@ -0,0 +1,367 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common/common.h"
+#include "filtercache.h"
+
+#include <stdio.h>          // rename, remove
+#include <string.h>         // strcmp, strstr
+#include <time.h>           // time
+#include <sys/stat.h>       // mkdir
+#include <bx/string.h>      // bx::snprintf, bx::strlcat
+#include <bx/thread.h>      // bx::Mutex
+#include <dm/misc.h>        // DM_PATH_LEN, dm::homeDir, dm::fileExists
+
+#if BX_PLATFORM_WINDOWS
+#   include <direct.h>      // _mkdir
+#   include <sys/utime.h>   // _utime
+#else
+#   include <utime.h>       // utime
+#endif // BX_PLATFORM_WINDOWS
+
+#include "common/cmft.h"
+#include "common/hash.h"    // cs::hash64()
+#include "backgroundjobs.h" // CmftFilterThreadParams
+
+/// Notice: Always call tinydir functions between push/pop(_stackAlloc);
+#define _TINYDIR_MALLOC(_size) DM_ALLOC(dm::stackAlloc, _size)
+#define _TINYDIR_FREE(_ptr)    DM_FREE(dm::stackAlloc, _ptr)
+#include <tinydir/tinydir.h>
+
+struct FilterCache
+{
+    enum
+    {
+        MaxEntries = 1024,
+        Version    = 2, // Bump when filter output changes for the same input, invalidates all entries.
+    };
+
+    struct Entry
+    {
+        uint64_t m_key;
+        uint64_t m_size;
+        uint64_t m_lastUse; // Seconds since epoch, file modification time on disk.
+    };
+
+    FilterCache()
+    {
+        m_maxSize    = 0;
+        m_totalSize  = 0;
+        m_numEntries = 0;
+        m_tmpCounter = 0;
+        m_dir[0]     = '\0';
+    }
+
+    bool enabled() const
+    {
+        return 0 != m_maxSize;
+    }
+
+    void entryPath(char* _path, uint64_t _key) const
+    {
+        bx::snprintf(_path, DM_PATH_LEN, "%s" DM_DIRSLASH "%016llx.dds", m_dir, (unsigned long long)_key);
+    }
+
+    Entry* find(uint64_t _key)
+    {
+        for (uint16_t ii = 0; ii < m_numEntries; ++ii)
+        {
+            if (_key == m_entries[ii].m_key)
+            {
+                return &m_entries[ii];
+            }
+        }
+
+        return NULL;
+    }
+
+    void add(uint64_t _key, uint64_t _size, uint64_t _lastUse)
+    {
+        Entry* entry = find(_key);
+        if (NULL != entry)
+        {
+            m_totalSize -= entry->m_size;
+        }
+        else
+        {
+            entry = &m_entries[m_numEntries++];
+            entry->m_key = _key;
+        }
+
+        entry->m_size    = _size;
+        entry->m_lastUse = _lastUse;
+        m_totalSize += _size;
+    }
+
+    // Removes least recently used entries until '_required' more bytes and one more entry fit in.
+    void evict(uint64_t _required)
+    {
+        while (0 != m_numEntries
+           && (m_totalSize + _required > m_maxSize || MaxEntries == m_numEntries))
+        {
+            uint16_t lru = 0;
+            for (uint16_t ii = 1; ii < m_numEntries; ++ii)
+            {
+                if (m_entries[ii].m_lastUse < m_entries[lru].m_lastUse)
+                {
+                    lru = ii;
+                }
+            }
+
+            char path[DM_PATH_LEN];
+            entryPath(path, m_entries[lru].m_key);
+            remove(path);
+
+            m_totalSize -= m_entries[lru].m_size;
+            m_entries[lru] = m_entries[--m_numEntries];
+        }
+    }
+
+    bx::Mutex m_mutex;
+    uint64_t m_maxSize;
+    uint64_t m_totalSize;
+    uint16_t m_numEntries;
+    uint32_t m_tmpCounter;
+    char m_dir[DM_PATH_LEN];
+    Entry m_entries[MaxEntries];
+};
+static FilterCache s_filterCache;
+
+static bool filterCacheMakeDir(const char* _path)
+{
+    #if BX_PLATFORM_WINDOWS
+    _mkdir(_path);
+    #else
+    mkdir(_path, 0755);
+    #endif // BX_PLATFORM_WINDOWS
+
+    return dm::fileExists(_path);
+}
+
+static void filterCacheTouch(const char* _path)
+{
+    #if BX_PLATFORM_WINDOWS
+    _utime(_path, NULL);
+    #else
+    utime(_path, NULL);
+    #endif // BX_PLATFORM_WINDOWS
+}
+
+static bool filterCacheParseKey(uint64_t& _key, const char* _name)
+{
+    // Expected "<16 hex digits>.dds".
+    uint64_t key = 0;
+    for (uint8_t ii = 0; ii < 16; ++ii)
+    {
+        const char ch = _name[ii];
+        uint64_t digit;
+        if      ('0' <= ch && ch <= '9') { digit = ch - '0';      }
+        else if ('a' <= ch && ch <= 'f') { digit = ch - 'a' + 10; }
+        else                             { return false;          }
+
+        key = (key<<4) | digit;
+    }
+
+    if (0 != strcmp(&_name[16], ".dds"))
+    {
+        return false;
+    }
+
+    _key = key;
+    return true;
+}
+
+void filterCacheInit(const char* _dir, uint64_t _maxSize)
+{
+    FilterCache& cache = s_filterCache;
+    cache.m_maxSize    = 0;
+    cache.m_totalSize  = 0;
+    cache.m_numEntries = 0;
+
+    if (0 == _maxSize)
+    {
+        return;
+    }
+
+    if ('\0' != _dir[0])
+    {
+        dm::strscpya(cache.m_dir, _dir);
+    }
+    else
+    {
+        dm::homeDir(cache.m_dir);
+        bx::strlcat(cache.m_dir, DM_DIRSLASH ".cmftStudio", DM_PATH_LEN);
+        filterCacheMakeDir(cache.m_dir);
+        bx::strlcat(cache.m_dir, DM_DIRSLASH "cache", DM_PATH_LEN);
+    }
+
+    if (!filterCacheMakeDir(cache.m_dir))
+    {
+        fprintf(stderr, "Filter cache: directory '%s' could not be created, cache is disabled.\n", cache.m_dir);
+        return;
+    }
+
+    cache.m_maxSize = _maxSize;
+
+    // Index existing entries, leftovers of interrupted writes are removed.
+    dm::StackAllocScope scope(dm::stackAlloc);
+
+    tinydir_dir dir;
+    if (-1 == tinydir_open(&dir, cache.m_dir))
+    {
+        return;
+    }
+
+    for (; dir.has_next; tinydir_next(&dir))
+    {
+        tinydir_file file;
+        if (-1 == tinydir_readfile(&dir, &file)
+        ||  !file.is_reg)
+        {
+            continue;
+        }
+
+        uint64_t key;
+        if (filterCacheParseKey(key, file.name)
+        &&  FilterCache::MaxEntries != cache.m_numEntries)
+        {
+            cache.add(key, uint64_t(file._s.st_size), uint64_t(file._s.st_mtime));
+        }
+        else if (NULL != strstr(file.name, ".tmp"))
+        {
+            remove(file.path);
+        }
+    }
+
+    tinydir_close(&dir);
+
+    // Cache size limit might have been lowered since the last run.
+    cache.evict(0);
+}
+
+uint64_t filterCacheKey(const CmftFilterThreadParams& _params)
+{
+    const cmft::Image& input = _params.m_input;
+
+    uint64_t key = FilterCache::Version;
+    key = cs::hash64(input.m_data, input.m_dataSize, key);
+    key = cs::hash64Value(input.m_width,  key);
+    key = cs::hash64Value(input.m_height, key);
+    key = cs::hash64Value(uint32_t(input.m_format), key);
+    key = cs::hash64Value(input.m_numMips,  key);
+    key = cs::hash64Value(input.m_numFaces, key);
+
+    // Notice: parameters which don't affect the output (cpu thread count, OpenCL usage) are left out.
+    key = cs::hash64Value(uint32_t(_params.m_filterType), key);
+    key = cs::hash64Value(_params.m_dstSize,     key);
+    key = cs::hash64Value(_params.m_inputGamma,  key);
+    key = cs::hash64Value(_params.m_outputGamma, key);
+
+    if (cs::Environment::Pmrem == _params.m_filterType)
+    {
+        key = cs::hash64Value(_params.m_srcSize,    key);
+        key = cs::hash64Value(_params.m_mipCount,   key);
+        key = cs::hash64Value(_params.m_glossScale, key);
+        key = cs::hash64Value(_params.m_glossBias,  key);
+        key = cs::hash64Value(uint32_t(_params.m_lightingModel), key);
+        key = cs::hash64Value(uint32_t(_params.m_edgeFixup),     key);
+        key = cs::hash64Value(uint8_t(_params.m_excludeBase),    key);
+    }
+
+    return key;
+}
+
+bool filterCacheLoad(cmft::Image& _output, uint64_t _key)
+{
+    FilterCache& cache = s_filterCache;
+    if (!cache.enabled())
+    {
+        return false;
+    }
+
+    char path[DM_PATH_LEN];
+    {
+        bx::MutexScope lock(cache.m_mutex);
+
+        FilterCache::Entry* entry = cache.find(_key);
+        if (NULL == entry)
+        {
+            return false;
+        }
+
+        entry->m_lastUse = uint64_t(time(NULL));
+        cache.entryPath(path, _key);
+    }
+
+    // Notice: entry could have been evicted in the meantime, failed load is treated as a miss.
+    if (!cmft::imageLoad(_output, path, cmft::TextureFormat::RGBA32F))
+    {
+        return false;
+    }
+
+    // Keep lru order across runs.
+    filterCacheTouch(path);
+
+    return true;
+}
+
+void filterCacheStore(const cmft::Image& _image, uint64_t _key)
+{
+    FilterCache& cache = s_filterCache;
+    if (!cache.enabled()
+    ||  _image.m_dataSize > cache.m_maxSize)
+    {
+        return;
+    }
+
+    // Write to a temporary file first, so that concurrent loads never see a partially written entry.
+    // Notice: cmft appends file extension.
+    char tmpPath[DM_PATH_LEN];
+    {
+        bx::MutexScope lock(cache.m_mutex);
+        bx::snprintf(tmpPath, DM_PATH_LEN, "%s" DM_DIRSLASH "%016llx.tmp%u", cache.m_dir, (unsigned long long)_key, cache.m_tmpCounter++);
+    }
+
+    const bool saved = cmft::imageSave(_image
+                                     , tmpPath
+                                     , cmft::ImageFileType::DDS
+                                     , cmft::OutputType::Cubemap
+                                     , cmft::TextureFormat::RGBA32F
+                                     , false
+                                     );
+    bx::strlcat(tmpPath, ".dds", DM_PATH_LEN);
+    if (!saved)
+    {
+        remove(tmpPath);
+        return;
+    }
+
+    uint64_t size = 0;
+    FILE* file = fopen(tmpPath, "rb");
+    if (NULL != file)
+    {
+        size = uint64_t(dm::fsize(file));
+        fclose(file);
+    }
+
+    bx::MutexScope lock(cache.m_mutex);
+
+    cache.evict(size);
+
+    char path[DM_PATH_LEN];
+    cache.entryPath(path, _key);
+    remove(path); // Rename doesn't overwrite on Windows.
+
+    if (0 == rename(tmpPath, path))
+    {
+        cache.add(_key, size, uint64_t(time(NULL)));
+    }
+    else
+    {
+        remove(tmpPath);
+    }
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_FILTERCACHE_H_HEADER_GUARD
+#define CMFTSTUDIO_FILTERCACHE_H_HEADER_GUARD
+
+#include <stdint.h>
+
+namespace cmft { struct Image; }
+struct CmftFilterThreadParams;
+
+/// On-disk cache of cmft filter results, addressed by content hash of the input image and filter parameters.
+/// Total size is kept under '_maxSize' by evicting least recently used entries. Zero '_maxSize' disables the cache.
+/// Empty '_dir' uses "<home>/.cmftStudio/cache". Call from the main thread, before any filter job is started.
+void filterCacheInit(const char* _dir, uint64_t _maxSize);
+
+/// Returns cache key for input image and parameters of '_params'. Output buffer is not used.
+uint64_t filterCacheKey(const CmftFilterThreadParams& _params);
+
+/// Loads cached result for '_key' into '_output' as RGBA32F. Returns false on cache miss. Thread safe.
+bool filterCacheLoad(cmft::Image& _output, uint64_t _key);
+
+/// Stores '_image' under '_key', evicting old entries if needed. Thread safe.
+void filterCacheStore(const cmft::Image& _image, uint64_t _key);
+
+#endif // CMFTSTUDIO_FILTERCACHE_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#include "common/common.h"
+#include "filtertune.h"
+
+#include <math.h>         // sinf, cosf
+#include <bx/cpu.h>       // bx::atomicFetchAndAdd()
+#include <dm/misc.h>      // dm::min
+
+#include "common/cmft.h"
+#include "common/jobs.h"  // cs::cpuNumCores()
+#include "common/timer.h" // timerCurrentSec()
+#include "clpool.h"       // clPoolAcquire(), clPoolRelease()
+
+// Big enough for the mip chain to dominate over per call overhead, as with real skyboxes.
+enum
+{
+    FilterTuneFaceSize    = 256,
+    FilterTuneMipCount    = 9,
+    FilterTuneRepetitions = 3,
+};
+
+// Smooth pattern with a few bright spots, cost of the filter doesn't depend on content.
+static void filterTuneSource(cmft::Image& _image)
+{
+    cmft::imageCreate(_image, FilterTuneFaceSize, FilterTuneFaceSize, 0x0, 1, 6, cmft::TextureFormat::RGBA32F);
+
+    float* dst = (float*)_image.m_data;
+    for (uint32_t face = 0; face < 6; ++face)
+    {
+        for (uint32_t yy = 0; yy < FilterTuneFaceSize; ++yy)
+        {
+            for (uint32_t xx = 0; xx < FilterTuneFaceSize; ++xx)
+            {
+                const float uu = float(xx)/float(FilterTuneFaceSize);
+                const float vv = float(yy)/float(FilterTuneFaceSize);
+                const float spot = (0 == xx%32 && 0 == yy%32) ? 16.0f : 0.0f;
+
+                dst[0] = 0.5f + 0.5f*sinf(uu*6.0f + float(face)) + spot;
+                dst[1] = 0.5f + 0.5f*cosf(vv*6.0f - float(face)) + spot;
+                dst[2] = uu*vv + spot;
+                dst[3] = 1.0f;
+                dst += 4;
+            }
+        }
+    }
+}
+
+static inline bool filterTuneCanceled(volatile int32_t* _cancel)
+{
+    return 0 != bx::atomicFetchAndAdd(_cancel, 0);
+}
+
+// Returns filter duration in seconds, or a negative value on failure.
+static double filterTuneMeasure(const cmft::Image& _source, uint8_t _numCpuThreads, cmft::ClContext* _clContext)
+{
+    // Notice: Nvidia crashes the driver if memory is not from crt allcator, same as in cmftFilter().
+    cs::JobAllocator allocator(NULL != _clContext ? dm::crtAlloc : dm::mainAlloc);
+
+    cmft::Image image;
+    cmft::imageCopy(image, _source, &allocator);
+
+    const double begin = timerCurrentSec();
+    const bool success = cmft::imageRadianceFilter(image
+                                                 , FilterTuneFaceSize
+                                                 , cmft::LightingModel::BlinnBrdf
+                                                 , false
+                                                 , FilterTuneMipCount
+                                                 , 10
+                                                 , 3
+                                                 , cmft::EdgeFixup::None
+                                                 , _numCpuThreads
+                                                 , _clContext
+                                                 , &allocator
+                                                 );
+    const double duration = timerCurrentSec() - begin;
+
+    cmft::imageUnload(image, &allocator);
+
+    return success ? duration : -1.0;
+}
+
+// Best of FilterTuneRepetitions runs, so that a run disturbed by other work doesn't decide. Negative value on failure or cancel.
+static double filterTuneMeasureBest(const cmft::Image& _source, uint8_t _numCpuThreads, cmft::ClContext* _clContext, volatile int32_t* _cancel)
+{
+    double best = -1.0;
+    for (uint8_t ii = 0; ii < FilterTuneRepetitions; ++ii)
+    {
+        if (filterTuneCanceled(_cancel))
+        {
+            return -1.0;
+        }
+
+        const double duration = filterTuneMeasure(_source, _numCpuThreads, _clContext);
+        if (duration < 0.0)
+        {
+            return -1.0;
+        }
+
+        best = (best < 0.0) ? duration : dm::min(best, duration);
+    }
+
+    return best;
+}
+
+bool filterTune(uint8_t& _numCpuThreads, bool& _useOpenCL, volatile int32_t* _cancel)
+{
+    cmft::Image source;
+    filterTuneSource(source);
+
+    // Thread counts doubling up to the number of cores, the core count itself is always measured.
+    const uint8_t numCores = cs::cpuNumCores();
+
+    uint8_t bestThreads  = 1;
+    double  bestDuration = filterTuneMeasureBest(source, 1, NULL, _cancel);
+    for (uint32_t threads = 2; ; threads *= 2)
+    {
+        const uint8_t numThreads = uint8_t(dm::min(threads, uint32_t(numCores)));
+        const double duration = filterTuneMeasureBest(source, numThreads, NULL, _cancel);
+
+        // More threads have to be noticeably faster, otherwise they are not worth occupying.
+        if (duration > 0.0
+        &&  duration < bestDuration*0.95)
+        {
+            bestThreads  = numThreads;
+            bestDuration = duration;
+        }
+
+        if (numThreads == numCores)
+        {
+            break;
+        }
+    }
+
+    // OpenCL, together with the best cpu thread count and alone.
+    bool useOpenCL = false;
+    cmft::ClContext* clContext = filterTuneCanceled(_cancel) ? NULL : clPoolAcquire();
+    if (NULL != clContext)
+    {
+        // First run includes kernel compilation, it is not measured.
+        filterTuneMeasure(source, bestThreads, clContext);
+
+        const double withCpu = filterTuneMeasureBest(source, bestThreads, clContext, _cancel);
+        if (withCpu > 0.0
+        &&  withCpu < bestDuration)
+        {
+            bestDuration = withCpu;
+            useOpenCL    = true;
+        }
+
+        const double alone = filterTuneMeasureBest(source, 0, clContext, _cancel);
+        if (alone > 0.0
+        &&  alone < bestDuration)
+        {
+            bestDuration = alone;
+            bestThreads  = 0;
+            useOpenCL    = true;
+        }
+
+        clPoolRelease(clContext);
+    }
+
+    cmft::imageUnload(source);
+
+    if (filterTuneCanceled(_cancel))
+    {
+        return false;
+    }
+
+    _numCpuThreads = bestThreads;
+    _useOpenCL     = useOpenCL;
+
+    return true;
+}
+
+/* vim: set sw=4 ts=4 expandtab: */
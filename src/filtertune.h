@@ -0,0 +1,19 @@
+/*
+ * Copyright 2014-2015 Dario Manesku. All rights reserved.
+ * License: http://www.opensource.org/licenses/BSD-2-Clause
+ */
+
+#ifndef CMFTSTUDIO_FILTERTUNE_H_HEADER_GUARD
+#define CMFTSTUDIO_FILTERTUNE_H_HEADER_GUARD
+
+#include <stdint.h>
+
+/// Radiance filter calibration. Filters a 256 pixel synthetic cubemap with different cpu thread counts, with and without
+/// OpenCL, and returns the fastest configuration, each measured as the best of a few runs. Takes several seconds, meant to
+/// be run once and stored in the config. Thread safe, but should not run together with other work as it would skew the
+/// measurements. '_cancel' is checked between measurements, once it is non-zero calibration stops and false is returned.
+bool filterTune(uint8_t& _numCpuThreads, bool& _useOpenCL, volatile int32_t* _cancel);
+
+#endif // CMFTSTUDIO_FILTERTUNE_H_HEADER_GUARD
+
+/* vim: set sw=4 ts=4 expandtab: */
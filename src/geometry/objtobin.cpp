@@ -12,6 +12,8 @@
 #include "geometry.h"           // write(vertices, indices..)
 #include "../common/utils.h"
 #include "../common/memblock.h"
+#include "../common/jobs.h"       // cs::jobParallelFor()
+#include "../common/mappedfile.h" // cs::mappedFileOpen()
 #include <dm/misc.h>            // dm::NoCopyNoAssign
 
 // This code is altered from: https://github.com/bkaradzic/bgfx/blob/master/tools/geometryc/geometryc.cpp
@@ -35,7 +37,6 @@
 #   define CS_STL stl
 #else
 #   include <vector>
-#   include <unordered_map>
 #   define CS_STL std
 #endif
 
@@ -49,7 +50,6 @@
 #include <bx/hash.h>
 #include <bx/uint32_t.h>
 #include <bx/fpumath.h>
-#include <bx/tokenizecmd.h>
 
 struct Vector3
 {
@@ -65,14 +65,94 @@ struct Index3
     int32_t m_position;
     int32_t m_texcoord;
     int32_t m_normal;
-    int32_t m_vertexIndex;
+    int32_t m_vertexIndex;  // Valid only when m_generation matches current output buffer generation.
+    uint32_t m_generation;
 };
 
-typedef CS_STL::unordered_map<uint64_t, Index3> Index3Map;
+typedef CS_STL::vector<Index3> Index3Array;
+
+// Unique position/texcoord/normal tuples. Open addressing with linear probing, slots store indices into m_entries or UINT32_MAX.
+// Keys are compared exactly, entries are kept in insertion order.
+struct Index3Map
+{
+    Index3Map()
+        : m_mask(0)
+    {
+    }
+
+    static inline uint32_t hash(int32_t _position, int32_t _texcoord, int32_t _normal)
+    {
+        uint64_t key = (uint64_t(uint32_t(_position))<<32 | uint32_t(_texcoord)) ^ (uint64_t(uint32_t(_normal))*0x9e3779b97f4a7c15ULL);
+        key ^= key>>33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key>>33;
+        return uint32_t(key);
+    }
+
+    // Returns index of the entry matching '_index', adds it when not present.
+    uint32_t insert(const Index3& _index)
+    {
+        // Keep load factor under 1/2.
+        if (m_entries.size()*2 >= m_slots.size() )
+        {
+            grow();
+        }
+
+        uint32_t slot = hash(_index.m_position, _index.m_texcoord, _index.m_normal) & m_mask;
+        for (;; slot = (slot+1) & m_mask)
+        {
+            const uint32_t entry = m_slots[slot];
+            if (UINT32_MAX == entry)
+            {
+                m_slots[slot] = (uint32_t)m_entries.size();
+                m_entries.push_back(_index);
+                return m_slots[slot];
+            }
+
+            const Index3& other = m_entries[entry];
+            if (other.m_position == _index.m_position
+            &&  other.m_texcoord == _index.m_texcoord
+            &&  other.m_normal   == _index.m_normal)
+            {
+                return entry;
+            }
+        }
+    }
+
+    void grow()
+    {
+        const uint32_t numSlots = dm::max(uint32_t(m_slots.size())*2, uint32_t(1024));
+        m_slots.resize(numSlots);
+        memset(&m_slots[0], 0xff, numSlots*sizeof(uint32_t) );
+        m_mask = numSlots-1;
+
+        for (uint32_t ii = 0, end = (uint32_t)m_entries.size(); ii < end; ++ii)
+        {
+            const Index3& index = m_entries[ii];
+            uint32_t slot = hash(index.m_position, index.m_texcoord, index.m_normal) & m_mask;
+            while (UINT32_MAX != m_slots[slot])
+            {
+                slot = (slot+1) & m_mask;
+            }
+            m_slots[slot] = ii;
+        }
+    }
+
+    // Slots are only needed while inserting.
+    void freeSlots()
+    {
+        CS_STL::vector<uint32_t>().swap(m_slots);
+        m_mask = 0;
+    }
+
+    Index3Array m_entries;
+    CS_STL::vector<uint32_t> m_slots;
+    uint32_t m_mask;
+};
 
 struct Triangle
 {
-    uint64_t m_index[3];
+    uint32_t m_index[3]; // Into Index3Map::m_entries.
 };
 
 typedef CS_STL::vector<Triangle> TriangleArray;
@@ -220,15 +300,455 @@ struct GroupSortByMaterial
     }
 };
 
-uint32_t objToBin(const uint8_t* _objData
-                , bx::WriterSeekerI* _writer
-                , uint32_t _packUv
-                , uint32_t _packNormal
-                , bool _ccw
-                , bool _flipV
-                , bool _hasTangent
-                , float _scale
-                )
+// Obj scanner.
+//-----
+
+// Lines are scanned in place, every helper stops at '_eol'. Input doesn't need to be null terminated.
+
+static inline bool objIsSpace(char _ch)
+{
+    return ' ' == _ch || '\t' == _ch || '\r' == _ch;
+}
+
+static inline bool objIsDigit(char _ch)
+{
+    return uint8_t(_ch - '0') < 10;
+}
+
+static inline const char* objSkipSpace(const char* _ptr, const char* _eol)
+{
+    while (_ptr < _eol && objIsSpace(*_ptr))
+    {
+        ++_ptr;
+    }
+    return _ptr;
+}
+
+static inline const char* objTokenEnd(const char* _ptr, const char* _eol)
+{
+    while (_ptr < _eol && !objIsSpace(*_ptr))
+    {
+        ++_ptr;
+    }
+    return _ptr;
+}
+
+// Parses decimal and scientific notation without locale lookups. Digits past what fits into 64bit mantissa only move the exponent.
+// Anything else (inf, nan, hex floats) falls back to atof().
+static const char* objParseFloat(const char* _ptr, const char* _eol, float& _value)
+{
+    static const double s_pow10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    const char* ptr = _ptr;
+
+    const bool negative = (ptr < _eol && '-' == *ptr);
+    if (ptr < _eol && ('-' == *ptr || '+' == *ptr))
+    {
+        ++ptr;
+    }
+
+    uint64_t mantissa  = 0;
+    int32_t  exponent  = 0;
+    bool     hasDigits = false;
+
+    for (; ptr < _eol && objIsDigit(*ptr); ++ptr)
+    {
+        hasDigits = true;
+        if (mantissa < 1000000000000000000ULL)
+        {
+            mantissa = mantissa*10 + uint64_t(*ptr - '0');
+        }
+        else
+        {
+            ++exponent;
+        }
+    }
+
+    if (ptr < _eol && '.' == *ptr)
+    {
+        for (++ptr; ptr < _eol && objIsDigit(*ptr); ++ptr)
+        {
+            hasDigits = true;
+            if (mantissa < 1000000000000000000ULL)
+            {
+                mantissa = mantissa*10 + uint64_t(*ptr - '0');
+                --exponent;
+            }
+        }
+    }
+
+    if (!hasDigits)
+    {
+        char token[64];
+        const char* end = objTokenEnd(_ptr, _eol);
+        const size_t len = dm::min(size_t(end-_ptr), sizeof(token)-1);
+        memcpy(token, _ptr, len);
+        token[len] = '\0';
+
+        _value = (float)atof(token);
+        return end;
+    }
+
+    if (ptr < _eol && ('e' == *ptr || 'E' == *ptr))
+    {
+        const char* exp = ptr+1;
+
+        const bool negativeExp = (exp < _eol && '-' == *exp);
+        if (exp < _eol && ('-' == *exp || '+' == *exp))
+        {
+            ++exp;
+        }
+
+        if (exp < _eol && objIsDigit(*exp))
+        {
+            int32_t value = 0;
+            for (; exp < _eol && objIsDigit(*exp); ++exp)
+            {
+                value = dm::min(value*10 + int32_t(*exp - '0'), 9999);
+            }
+
+            exponent += negativeExp ? -value : value;
+            ptr = exp;
+        }
+    }
+
+    // Powers of ten up to 1e22 are exact in double precision.
+    double value = double(mantissa);
+    if (0 != mantissa)
+    {
+        for (; exponent > 22; exponent -= 22)
+        {
+            value *= s_pow10[22];
+        }
+        for (; exponent < -22; exponent += 22)
+        {
+            value /= s_pow10[22];
+        }
+        value = (exponent < 0) ? value/s_pow10[-exponent] : value*s_pow10[exponent];
+    }
+
+    _value = float(negative ? -value : value);
+    return ptr;
+}
+
+static inline const char* objParseInt(const char* _ptr, const char* _eol, int32_t& _value)
+{
+    const bool negative = (_ptr < _eol && '-' == *_ptr);
+    if (_ptr < _eol && ('-' == *_ptr || '+' == *_ptr))
+    {
+        ++_ptr;
+    }
+
+    int32_t value = 0;
+    for (; _ptr < _eol && objIsDigit(*_ptr); ++_ptr)
+    {
+        value = value*10 + int32_t(*_ptr - '0');
+    }
+
+    _value = negative ? -value : value;
+    return _ptr;
+}
+
+// Parses up to '_max' floats, returns the number parsed.
+static inline uint32_t objParseFloats(const char* _ptr, const char* _eol, float* _values, uint32_t _max)
+{
+    uint32_t num = 0;
+    for (_ptr = objSkipSpace(_ptr, _eol); num < _max && _ptr < _eol; _ptr = objSkipSpace(_ptr, _eol))
+    {
+        _ptr = objTokenEnd(objParseFloat(_ptr, _eol, _values[num++]), _eol);
+    }
+
+    return num;
+}
+
+// Parses one face vertex: 'v', 'v/t', 'v//n' or 'v/t/n'. Missing indices are left 0, same as unset indices in Index3.
+static inline const char* objParseFaceVertex(const char* _ptr, const char* _eol, int32_t& _pos, int32_t& _tex, int32_t& _nrm)
+{
+    _tex = 0;
+    _nrm = 0;
+
+    _ptr = objParseInt(_ptr, _eol, _pos);
+    if (_ptr < _eol && '/' == *_ptr)
+    {
+        ++_ptr;
+        if (_ptr < _eol && '/' != *_ptr)
+        {
+            _ptr = objParseInt(_ptr, _eol, _tex);
+        }
+
+        if (_ptr < _eol && '/' == *_ptr)
+        {
+            _ptr = objParseInt(_ptr+1, _eol, _nrm);
+        }
+    }
+
+    return objTokenEnd(_ptr, _eol);
+}
+
+// Obj chunks.
+//-----
+
+// Input is split at line boundaries and chunks are parsed in parallel. Negative obj indices count back from the last element parsed
+// so far, within a chunk only local elements are known. Such indices are marked relative and chunk bases are added during merge.
+
+struct ObjCorner
+{
+    int32_t m_index[3]; // Position, texcoord and normal.
+    uint8_t m_relative; // Bit per index.
+};
+
+struct ObjTriangle
+{
+    ObjCorner m_corner[3];
+};
+
+typedef CS_STL::vector<ObjTriangle> ObjTriangleArray;
+
+// Group changes, replayed in order during merge. Triangle counts are local to the chunk.
+struct ObjGroupEvent
+{
+    enum Enum
+    {
+        Vertex,   // Any 'v*' line, ends the current group.
+        Name,     // 'g'
+        Material, // 'usemtl'
+    };
+
+    Enum m_type;
+    uint32_t m_numTriangles;
+    std::string m_value;
+};
+
+typedef CS_STL::vector<ObjGroupEvent> ObjGroupEventArray;
+
+struct ObjChunk
+{
+    const char* m_begin;
+    const char* m_end;
+    Vector3Array m_positions;
+    Vector3Array m_normals;
+    Vector3Array m_texcoords;
+    ObjTriangleArray m_triangles;
+    ObjGroupEventArray m_events;
+    uint32_t m_numLines;
+    bool m_hasVp;
+    bool m_error;
+};
+
+struct ObjParseParams
+{
+    ObjChunk* m_chunks;
+    float m_scale;
+    bool m_ccw;
+};
+
+// Obj indices are 1-based, missing index maps to 0.
+static inline void objCorner(ObjCorner& _corner, int32_t _idx, int32_t _numLocal, uint8_t _which)
+{
+    if (_idx < 0)
+    {
+        _corner.m_index[_which] = _idx+_numLocal;
+        _corner.m_relative |= uint8_t(1<<_which);
+    }
+    else
+    {
+        _corner.m_index[_which] = dm::max(_idx-1, 0);
+    }
+}
+
+static void objParseChunk(ObjChunk& _chunk, bool _ccw, float _scale)
+{
+    uint32_t vertexEventTriangles = UINT32_MAX;
+
+    for (const char* line = _chunk.m_begin, *eol; line < _chunk.m_end; line = eol+1, ++_chunk.m_numLines)
+    {
+        eol = (const char*)memchr(line, '\n', _chunk.m_end-line);
+        eol = (NULL != eol) ? eol : _chunk.m_end;
+
+        const char* cmd = objSkipSpace(line, eol);
+        if (eol - cmd < 2)
+        {
+            continue;
+        }
+
+        // Dispatch on the first two characters, comments and unsupported tags (mtllib, o, s) are skipped.
+        const char ch0 = cmd[0];
+        const char ch1 = cmd[1];
+        if ('f' == ch0 && objIsSpace(ch1))
+        {
+            ObjTriangle triangle;
+
+            const int32_t numPositions = (int32_t)_chunk.m_positions.size();
+            const int32_t numTexcoords = (int32_t)_chunk.m_texcoords.size();
+            const int32_t numNormals   = (int32_t)_chunk.m_normals.size();
+
+            uint32_t edge = 0;
+            for (const char* vertex = objSkipSpace(cmd+1, eol); vertex < eol; vertex = objSkipSpace(vertex, eol), ++edge)
+            {
+                int32_t pos, tex, nn;
+                vertex = objParseFaceVertex(vertex, eol, pos, tex, nn);
+
+                ObjCorner corner;
+                corner.m_relative = 0;
+                objCorner(corner, pos, numPositions, 0);
+                objCorner(corner, tex, numTexcoords, 1);
+                objCorner(corner, nn,  numNormals,   2);
+
+                switch (edge)
+                {
+                case 0:
+                case 1:
+                case 2:
+                    triangle.m_corner[edge] = corner;
+                    if (2 == edge)
+                    {
+                        if (_ccw)
+                        {
+                            std::swap(triangle.m_corner[1], triangle.m_corner[2]);
+                        }
+                        _chunk.m_triangles.push_back(triangle);
+                    }
+                    break;
+
+                default:
+                    if (_ccw)
+                    {
+                        triangle.m_corner[2] = triangle.m_corner[1];
+                        triangle.m_corner[1] = corner;
+                    }
+                    else
+                    {
+                        triangle.m_corner[1] = triangle.m_corner[2];
+                        triangle.m_corner[2] = corner;
+                    }
+                    _chunk.m_triangles.push_back(triangle);
+                    break;
+                }
+            }
+        }
+        else if ('v' == ch0)
+        {
+            // Repeated ones without triangles in between don't change anything.
+            const uint32_t numTriangles = (uint32_t)_chunk.m_triangles.size();
+            if (vertexEventTriangles != numTriangles)
+            {
+                vertexEventTriangles = numTriangles;
+
+                ObjGroupEvent event;
+                event.m_type = ObjGroupEvent::Vertex;
+                event.m_numTriangles = numTriangles;
+                _chunk.m_events.push_back(event);
+            }
+
+            if (objIsSpace(ch1))
+            {
+                float xyzw[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                objParseFloats(cmd+1, eol, xyzw, 4);
+
+                const float invW = _scale/xyzw[3];
+
+                Vector3 pos;
+                pos.x = xyzw[0]*invW;
+                pos.y = xyzw[1]*invW;
+                pos.z = xyzw[2]*invW;
+
+                _chunk.m_positions.push_back(pos);
+            }
+            else if ('n' == ch1)
+            {
+                Vector3 normal = { 0.0f, 0.0f, 0.0f };
+                objParseFloats(cmd+2, eol, &normal.x, 3);
+
+                _chunk.m_normals.push_back(normal);
+            }
+            else if ('t' == ch1)
+            {
+                Vector3 texcoord = { 0.0f, 0.0f, 0.0f };
+                objParseFloats(cmd+2, eol, &texcoord.x, 3);
+
+                _chunk.m_texcoords.push_back(texcoord);
+            }
+            else if ('p' == ch1)
+            {
+                _chunk.m_hasVp = true;
+            }
+        }
+        else if ('g' == ch0 && objIsSpace(ch1))
+        {
+            const char* name = objSkipSpace(cmd+1, eol);
+            if (name == eol)
+            {
+                _chunk.m_error = true;
+                return;
+            }
+
+            ObjGroupEvent event;
+            event.m_type = ObjGroupEvent::Name;
+            event.m_numTriangles = (uint32_t)_chunk.m_triangles.size();
+            event.m_value.assign(name, objTokenEnd(name, eol) );
+            _chunk.m_events.push_back(event);
+        }
+        else if ('u' == ch0
+             &&  eol - cmd > 6
+             &&  0 == memcmp(cmd, "usemtl", 6)
+             &&  objIsSpace(cmd[6]) )
+        {
+            const char* name = objSkipSpace(cmd+6, eol);
+
+            ObjGroupEvent event;
+            event.m_type = ObjGroupEvent::Material;
+            event.m_numTriangles = (uint32_t)_chunk.m_triangles.size();
+            event.m_value.assign(name, objTokenEnd(name, eol) );
+            _chunk.m_events.push_back(event);
+        }
+    }
+}
+
+static void objParseChunks(uint32_t _begin, uint32_t _end, void* _userData)
+{
+    const ObjParseParams& params = *(const ObjParseParams*)_userData;
+
+    for (uint32_t ii = _begin; ii < _end; ++ii)
+    {
+        objParseChunk(params.m_chunks[ii], params.m_ccw, params.m_scale);
+    }
+}
+
+static inline void objGroupEnd(MeshGroup& _group, BgfxGroupArray& _groups, uint32_t _numTriangles)
+{
+    _group.m_numTriangles = _numTriangles - _group.m_startTriangle;
+    if (0 < _group.m_numTriangles)
+    {
+        _groups.push_back(_group);
+        _group.m_startTriangle = _numTriangles;
+        _group.m_numTriangles = 0;
+    }
+}
+
+static void objAppend(Vector3Array& _dst, const Vector3Array& _src)
+{
+    if (!_src.empty() )
+    {
+        const size_t size = _dst.size();
+        _dst.resize(size + _src.size() );
+        memcpy(&_dst[size], &_src[0], _src.size()*sizeof(Vector3) );
+    }
+}
+
+static uint32_t objToBin(const char* _obj
+                       , uint32_t _size
+                       , bx::WriterSeekerI* _writer
+                       , uint32_t _packUv
+                       , uint32_t _packNormal
+                       , bool _ccw
+                       , bool _flipV
+                       , bool _hasTangent
+                       , float _scale
+                       )
 {
     int64_t parseElapsed = -bx::getHPCounter();
     int64_t triReorderElapsed = 0;
@@ -250,231 +770,121 @@ uint32_t objToBin(const uint8_t* _objData
     group.m_name = "";
     group.m_material = "";
 
-    char commandLine[2048];
-    uint32_t len = sizeof(commandLine);
-    int argc;
-    char* argv[64];
-    const char* next = (const char*)_objData;
-    do
+    // Chunks end at line boundaries. There are a few per core for balance, small files are parsed in one piece.
+    enum { MinChunkSize = 256<<10 };
+    const uint32_t maxChunks = (uint32_t(cs::jobsNumWorkers())+1)*4;
+    const uint32_t numChunks = dm::max(dm::min(_size/uint32_t(MinChunkSize), maxChunks), uint32_t(1));
+
+    CS_STL::vector<ObjChunk> chunks(numChunks);
+
+    const char* objEnd = _obj + _size;
+    const char* chunkBegin = _obj;
+    for (uint32_t ii = 0; ii < numChunks; ++ii)
     {
-        next = bx::tokenizeCommandLine(next, commandLine, len, argc, argv, BX_COUNTOF(argv), '\n');
-        if (0 < argc)
+        const char* chunkEnd = objEnd;
+        if (ii+1 < numChunks)
         {
-            if (0 == strcmp(argv[0], "#") )
-            {
-                if (2 < argc
-                &&  0 == strcmp(argv[2], "polygons") )
-                {
-                }
-            }
-            else if (0 == strcmp(argv[0], "f") )
-            {
-                Triangle triangle;
-                memset(&triangle, 0, sizeof(Triangle) );
+            chunkEnd = dm::max(_obj + uint64_t(_size)*(ii+1)/numChunks, chunkBegin);
+            chunkEnd = (const char*)memchr(chunkEnd, '\n', objEnd-chunkEnd);
+            chunkEnd = (NULL != chunkEnd) ? chunkEnd+1 : objEnd;
+        }
 
-                const int numNormals   = (int)normals.size();
-                const int numTexcoords = (int)texcoords.size();
-                const int numPositions = (int)positions.size();
-                for (uint32_t edge = 0, numEdges = argc-1; edge < numEdges; ++edge)
-                {
-                    Index3 index;
-                    index.m_texcoord = 0;
-                    index.m_normal = 0;
-                    index.m_vertexIndex = -1;
-
-                    char* vertex = argv[edge+1];
-                    char* texcoord = strchr(vertex, '/');
-                    if (NULL != texcoord)
-                    {
-                        *texcoord++ = '\0';
+        ObjChunk& chunk = chunks[ii];
+        chunk.m_begin    = chunkBegin;
+        chunk.m_end      = chunkEnd;
+        chunk.m_numLines = 0;
+        chunk.m_hasVp    = false;
+        chunk.m_error    = false;
 
-                        char* normal = strchr(texcoord, '/');
-                        if (NULL != normal)
-                        {
-                            *normal++ = '\0';
-                            const int nn = atoi(normal);
-                            index.m_normal = (nn < 0) ? nn+numNormals : nn-1;
-                        }
+        chunkBegin = chunkEnd;
+    }
 
-                        const int tex = atoi(texcoord);
-                        index.m_texcoord = (tex < 0) ? tex+numTexcoords : tex-1;
-                    }
+    ObjParseParams params;
+    params.m_chunks = &chunks[0];
+    params.m_scale  = _scale;
+    params.m_ccw    = _ccw;
+    cs::jobParallelFor(objParseChunks, &params, numChunks);
 
-                    const int pos = atoi(vertex);
-                    index.m_position = (pos < 0) ? pos+numPositions : pos-1;
+    // Merge in order, relative indices get bases of all preceding chunks.
+    int32_t base[3] = { 0, 0, 0 };
+    for (uint32_t ii = 0; ii < numChunks; ++ii)
+    {
+        const ObjChunk& chunk = chunks[ii];
+        if (chunk.m_error)
+        {
+            CS_PRINT("Error parsing *.obj file.\n");
+            return 0;
+        }
 
-                    uint64_t hash0 = index.m_position;
-                    uint64_t hash1 = uint64_t(index.m_texcoord)<<20;
-                    uint64_t hash2 = uint64_t(index.m_normal)<<40;
-                    uint64_t hash = hash0^hash1^hash2;
+        if (chunk.m_hasVp)
+        {
+            static bool once = true;
+            if (once)
+            {
+                once = false;
+                CS_PRINT("warning: 'parameter space vertices' are unsupported.\n");
+            }
+        }
 
-                    CS_STL::pair<Index3Map::iterator, bool> result = indexMap.insert(CS_STL::make_pair(hash, index) );
-                    if (!result.second)
-                    {
-                        Index3& oldIndex = result.first->second;
-                        BX_UNUSED(oldIndex);
-                        BX_CHECK(oldIndex.m_position == index.m_position
-                            && oldIndex.m_texcoord == index.m_texcoord
-                            && oldIndex.m_normal == index.m_normal
-                            , "Hash collision!"
-                            );
-                    }
+        num += chunk.m_numLines;
 
-                    switch (edge)
-                    {
-                    case 0:
-                    case 1:
-                    case 2:
-                        triangle.m_index[edge] = hash;
-                        if (2 == edge)
-                        {
-                            if (_ccw)
-                            {
-                                std::swap(triangle.m_index[1], triangle.m_index[2]);
-                            }
-                            triangles.push_back(triangle);
-                        }
-                        break;
+        const uint32_t triangleBase = (uint32_t)triangles.size();
+        for (ObjGroupEventArray::const_iterator it = chunk.m_events.begin(), itEnd = chunk.m_events.end(); it != itEnd; ++it)
+        {
+            const uint32_t numTriangles = triangleBase + it->m_numTriangles;
 
-                    default:
-                        if (_ccw)
-                        {
-                            triangle.m_index[2] = triangle.m_index[1];
-                            triangle.m_index[1] = hash;
-                        }
-                        else
-                        {
-                            triangle.m_index[1] = triangle.m_index[2];
-                            triangle.m_index[2] = hash;
-                        }
-                        triangles.push_back(triangle);
-                        break;
-                    }
-                }
+            if (ObjGroupEvent::Vertex == it->m_type)
+            {
+                objGroupEnd(group, groups, numTriangles);
             }
-            else if (0 == strcmp(argv[0], "g") )
+            else if (ObjGroupEvent::Name == it->m_type)
             {
-                if (1 >= argc)
-                {
-                    CS_PRINT("Error parsing *.obj file.\n");
-                    return 0;
-                }
-                group.m_name = argv[1];
+                group.m_name = it->m_value;
             }
-            else if (*argv[0] == 'v')
+            else //if (ObjGroupEvent::Material == it->m_type).
             {
-                group.m_numTriangles = (uint32_t)(triangles.size() ) - group.m_startTriangle;
-                if (0 < group.m_numTriangles)
-                {
-                    groups.push_back(group);
-                    group.m_startTriangle = (uint32_t)(triangles.size() );
-                    group.m_numTriangles = 0;
-                }
-
-                if (0 == strcmp(argv[0], "vn") )
-                {
-                    Vector3 normal;
-                    normal.x = (float)atof(argv[1]);
-                    normal.y = (float)atof(argv[2]);
-                    normal.z = (float)atof(argv[3]);
-
-                    normals.push_back(normal);
-                }
-                else if (0 == strcmp(argv[0], "vp") )
-                {
-                    static bool once = true;
-                    if (once)
-                    {
-                        once = false;
-                        CS_PRINT("warning: 'parameter space vertices' are unsupported.\n");
-                    }
-                }
-                else if (0 == strcmp(argv[0], "vt") )
-                {
-                    Vector3 texcoord;
-                    texcoord.x = (float)atof(argv[1]);
-                    texcoord.y = 0.0f;
-                    texcoord.z = 0.0f;
-                    switch (argc)
-                    {
-                    case 4:
-                        texcoord.z = (float)atof(argv[3]);
-                        // fallthrough
-                    case 3:
-                        texcoord.y = (float)atof(argv[2]);
-                        break;
-
-                    default:
-                        break;
-                    }
-
-                    texcoords.push_back(texcoord);
-                }
-                else
+                if (it->m_value != group.m_material)
                 {
-                    float px = (float)atof(argv[1]);
-                    float py = (float)atof(argv[2]);
-                    float pz = (float)atof(argv[3]);
-                    float pw = 1.0f;
-                    if (argc > 4)
-                    {
-                        pw = (float)atof(argv[4]);
-                    }
-
-                    float invW = _scale/pw;
-                    px *= invW;
-                    py *= invW;
-                    pz *= invW;
-
-                    Vector3 pos;
-                    pos.x = px;
-                    pos.y = py;
-                    pos.z = pz;
-
-                    positions.push_back(pos);
+                    objGroupEnd(group, groups, numTriangles);
                 }
+                group.m_material = it->m_value;
             }
-            else if (0 == strcmp(argv[0], "usemtl") )
+        }
+
+        triangles.reserve(triangles.size() + chunk.m_triangles.size() );
+        for (ObjTriangleArray::const_iterator it = chunk.m_triangles.begin(), itEnd = chunk.m_triangles.end(); it != itEnd; ++it)
+        {
+            Triangle triangle;
+            for (uint32_t corner = 0; corner < 3; ++corner)
             {
-                std::string material(argv[1]);
+                const ObjCorner& src = it->m_corner[corner];
 
-                if (material != group.m_material)
-                {
-                    group.m_numTriangles = (uint32_t)(triangles.size() ) - group.m_startTriangle;
-                    if (0 < group.m_numTriangles)
-                    {
-                        groups.push_back(group);
-                        group.m_startTriangle = (uint32_t)(triangles.size() );
-                        group.m_numTriangles = 0;
-                    }
-                }
+                Index3 index;
+                index.m_position    = src.m_index[0] + ( (src.m_relative&1) ? base[0] : 0);
+                index.m_texcoord    = src.m_index[1] + ( (src.m_relative&2) ? base[1] : 0);
+                index.m_normal      = src.m_index[2] + ( (src.m_relative&4) ? base[2] : 0);
+                index.m_vertexIndex = -1;
+                index.m_generation  = 0;
 
-                group.m_material = material;
+                triangle.m_index[corner] = indexMap.insert(index);
             }
-// unsupported tags
-//              else if (0 == strcmp(argv[0], "mtllib") )
-//              {
-//              }
-//              else if (0 == strcmp(argv[0], "o") )
-//              {
-//              }
-//              else if (0 == strcmp(argv[0], "s") )
-//              {
-//              }
+            triangles.push_back(triangle);
         }
 
-        ++num;
-    }
-    while ('\0' != *next);
+        objAppend(positions, chunk.m_positions);
+        objAppend(texcoords, chunk.m_texcoords);
+        objAppend(normals,   chunk.m_normals);
 
-    group.m_numTriangles = (uint32_t)(triangles.size() ) - group.m_startTriangle;
-    if (0 < group.m_numTriangles)
-    {
-        groups.push_back(group);
-        group.m_startTriangle = (uint32_t)(triangles.size() );
-        group.m_numTriangles = 0;
+        base[0] = (int32_t)positions.size();
+        base[1] = (int32_t)texcoords.size();
+        base[2] = (int32_t)normals.size();
     }
 
+    objGroupEnd(group, groups, (uint32_t)triangles.size() );
+    indexMap.freeSlots();
+
+    Index3Array& indices3 = indexMap.m_entries;
+
     int64_t now = bx::getHPCounter();
     parseElapsed += now;
     int64_t convertElapsed = -now;
@@ -485,18 +895,18 @@ uint32_t objToBin(const uint8_t* _objData
     bool hasNormal;
     bool hasTexcoord;
     {
-        Index3Map::const_iterator it = indexMap.begin();
-        hasNormal   = 0 != it->second.m_normal;
-        hasTexcoord = 0 != it->second.m_texcoord;
+        const Index3& first = indices3.front();
+        hasNormal   = 0 != first.m_normal;
+        hasTexcoord = 0 != first.m_texcoord;
 
         if (!hasTexcoord
         &&  texcoords.size() == positions.size() )
         {
             hasTexcoord = true;
 
-            for (Index3Map::iterator it = indexMap.begin(), itEnd = indexMap.end(); it != itEnd; ++it)
+            for (Index3Array::iterator it = indices3.begin(), itEnd = indices3.end(); it != itEnd; ++it)
             {
-                it->second.m_texcoord = it->second.m_position;
+                it->m_texcoord = it->m_position;
             }
         }
 
@@ -505,9 +915,9 @@ uint32_t objToBin(const uint8_t* _objData
         {
             hasNormal = true;
 
-            for (Index3Map::iterator it = indexMap.begin(), itEnd = indexMap.end(); it != itEnd; ++it)
+            for (Index3Array::iterator it = indices3.begin(), itEnd = indices3.end(); it != itEnd; ++it)
             {
-                it->second.m_normal = it->second.m_position;
+                it->m_normal = it->m_position;
             }
         }
     }
@@ -580,6 +990,9 @@ uint32_t objToBin(const uint8_t* _objData
     prim.m_startVertex = 0;
     prim.m_startIndex  = 0;
 
+    // Bumped for each written vertex buffer instead of resetting m_vertexIndex of all entries.
+    uint32_t generation = 1;
+
     uint32_t positionOffset = decl.getOffset(bgfx::Attrib::Position);
     uint32_t color0Offset   = decl.getOffset(bgfx::Attrib::Color0);
 
@@ -623,10 +1036,7 @@ uint32_t objToBin(const uint8_t* _objData
                     );
                 primitives.clear();
 
-                for (Index3Map::iterator indexIt = indexMap.begin(); indexIt != indexMap.end(); ++indexIt)
-                {
-                    indexIt->second.m_vertexIndex = -1;
-                }
+                ++generation;
 
                 vertices = vertexData;
                 indices = indexData;
@@ -642,10 +1052,10 @@ uint32_t objToBin(const uint8_t* _objData
             Triangle& triangle = triangles[tri];
             for (uint32_t edge = 0; edge < 3; ++edge)
             {
-                uint64_t hash = triangle.m_index[edge];
-                Index3& index = indexMap[hash];
-                if (index.m_vertexIndex == -1)
+                Index3& index = indices3[triangle.m_index[edge]];
+                if (index.m_generation != generation)
                 {
+                    index.m_generation  = generation;
                     index.m_vertexIndex = numVertices++;
 
                     float* position = (float*)(vertices + positionOffset);
@@ -755,26 +1165,37 @@ uint32_t objToBin(const char* _filePath
                 , float _scale
                 )
 {
-    FILE* file = fopen(_filePath, "rb");
+    // Parsed straight from the mapped pages.
+    cs::MappedFile* file = cs::mappedFileOpen(_filePath);
     if (NULL == file)
     {
         CS_PRINT("Unable to open input file '%s'.", _filePath);
         return 0;
     }
 
-    uint32_t size = (uint32_t)dm::fsize(file);
-    char* data = new char[size+1];
-    size = (uint32_t)fread(data, 1, size, file);
-    data[size] = '\0';
-    fclose(file);
-
-    const uint32_t dataSize = objToBin((uint8_t*)data, _writer, _packUv, _packNormal, _ccw, _flipV, _hasTangent, _scale);
+    const char* data = (const char*)cs::mappedFileData(file);
+    const uint32_t size = cs::mappedFileSize(file);
+    const uint32_t dataSize = objToBin(data, size, _writer, _packUv, _packNormal, _ccw, _flipV, _hasTangent, _scale);
 
-    delete [] data;
+    cs::mappedFileRelease(file);
 
     return dataSize;
 }
 
+uint32_t objToBin(const uint8_t* _objData
+                , bx::WriterSeekerI* _writer
+                , uint32_t _packUv
+                , uint32_t _packNormal
+                , bool _ccw
+                , bool _flipV
+                , bool _hasTangent
+                , float _scale
+                )
+{
+    const char* data = (const char*)_objData;
+    return objToBin(data, (uint32_t)strlen(data), _writer, _packUv, _packNormal, _ccw, _flipV, _hasTangent, _scale);
+}
+
 uint32_t objToBin(const char* _filePath
                 , void*& _outData
                 , uint32_t& _outDataSize
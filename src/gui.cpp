@@ -23,6 +23,7 @@
 #include "renderpipeline.h"
 #include "staticres.h"              // gui_res.h
 #include "common/utils.h"           // vecFromLatLong(), latLongFromVec()
+#include "common/jobs.h"            // cs::cpuNumCores()
 #include "geometry/loadermanager.h" // cs::geometryLoaderCount(), cs::geometryLoaderGetExtensions()
 
 /// Notice: Always call tinydir functions between push/pop(_stackAlloc);
@@ -1248,7 +1249,8 @@ void imguiCmftPmremWidget(cs::EnvHandle _env
     imguiIndent();
     {
         imguiBool("Use OpenCL", _state.m_useOpenCL);
-        imguiSlider("Num CPU processing threads",  _state.m_numCpuThreads,  0.0f, 12.0f, 1.0f, true, ImguiAlign::CenterIndented);
+        const float maxCpuThreads = float(dm::max(cs::cpuNumCores(), uint8_t(12)));
+        imguiSlider("Num CPU processing threads",  _state.m_numCpuThreads,  0.0f, maxCpuThreads, 1.0f, true, ImguiAlign::CenterIndented);
         imguiSeparator();
     }
     imguiUnindent();
@@ -160,6 +160,20 @@ struct StatusManager
         }
     }
 
+    void setText(StatusWindowId::Enum _id, const char* _msg)
+    {
+        for (uint16_t ii = m_messageList.count(); ii--; )
+        {
+            Message* msg = m_messageList.getAt(ii);
+            if (msg->m_id == _id)
+            {
+                msg->m_width = imguiGetTextLength(_msg, Fonts::StatusFont);
+                msg->m_posX  = (float(g_width)-msg->m_width)*0.5f;
+                dm::strscpy(msg->m_str, _msg, 128);
+            }
+        }
+    }
+
     struct Message
     {
         float m_endTime;
@@ -203,6 +217,11 @@ void imguiRemoveStatusMessage(StatusWindowId::Enum _id)
     s_statusManager.remove(_id);
 }
 
+void imguiStatusMessageSetText(StatusWindowId::Enum _id, const char* _msg)
+{
+    s_statusManager.setText(_id, _msg);
+}
+
 uint16_t imguiGetStatusEvent()
 {
     return s_statusManager.getNextEvent();
@@ -220,7 +239,6 @@ struct CircularStringArray
 
     void clear()
     {
-        bx::MutexScope lock(m_mutex);
         m_last       = UINT16_MAX;
         m_lastListed = UINT16_MAX;
         m_count      = 0;
@@ -234,31 +252,6 @@ struct CircularStringArray
         ++m_unlisted;
     }
 
-    void addSplitNewLine(const char _str[OutputWindowState::LineLength])
-    {
-        char temp[2048];
-        dm::strscpy(temp, _str, 2048);
-
-        bx::MutexScope lock(m_mutex);
-
-        const char* ptr = strtok(temp, "\n");
-        do
-        {
-            enum { LineLength = 105 };
-
-            // Split and add line by line of specified length.
-            while (strlen(ptr) > LineLength)
-            {
-                add(ptr, LineLength);
-                ptr += (LineLength-1);
-            }
-
-            // Add the rest.
-            add(ptr);
-        }
-        while ((ptr = strtok(NULL, "\n")) != NULL);
-    }
-
     char* getLine(uint16_t _idx)
     {
         return m_lines[wrapAround(_idx)];
@@ -266,8 +259,6 @@ struct CircularStringArray
 
     uint16_t getLines(char** _ptrs)
     {
-        bx::MutexScope lock(m_mutex);
-
         for (uint16_t ii = 0; ii < m_count; ++ii)
         {
             _ptrs[ii] = getLine(m_lastListed-ii);
@@ -283,8 +274,6 @@ struct CircularStringArray
             return;
         }
 
-        bx::MutexScope lock(m_mutex);
-
         --m_unlisted;
         ++m_lastListed;
         m_count = (++m_count > OutputWindowState::MaxLines) ? uint16_t(OutputWindowState::MaxLines) : m_count;
@@ -302,25 +291,110 @@ public:
     uint16_t m_count;
     uint16_t m_unlisted;
     char m_lines[OutputWindowState::MaxLines][OutputWindowState::LineLength];
-    bx::Mutex m_mutex;
 };
-static CircularStringArray s_csa;
+static CircularStringArray s_csa; // Main thread only.
 
-static const char* printfVargs(const char* _format, va_list _argList)
+// Lines printed from any thread, moved into s_csa on the main thread by outputWindowUpdate().
+struct OutputLineQueue
 {
-    static char s_buffer[8192];
+    OutputLineQueue()
+    {
+        m_first = 0;
+        m_count = 0;
+        m_clear = false;
+    }
+
+    void push(const char* _str)
+    {
+        bx::MutexScope lock(m_mutex);
+
+        const char* ptr = _str;
+        for (;;)
+        {
+            enum { LineLength = 105 };
+
+            const char* eol = strchr(ptr, '\n');
+            uint32_t len = (NULL != eol) ? uint32_t(eol-ptr) : uint32_t(strlen(ptr));
+
+            // Split and add line by line of specified length.
+            while (len > LineLength)
+            {
+                add(ptr, LineLength);
+                ptr += (LineLength-1);
+                len -= (LineLength-1);
+            }
+
+            // Add the rest, empty lines are skipped.
+            if (0 != len)
+            {
+                add(ptr, len+1);
+            }
 
-    char* out = s_buffer;
-    int32_t len = bx::vsnprintf(out, sizeof(s_buffer), _format, _argList);
-    if ((int32_t)sizeof(s_buffer) < len)
+            if (NULL == eol)
+            {
+                break;
+            }
+            ptr = eol+1;
+        }
+    }
+
+    void clear()
     {
-        out = (char*)alloca(len+1);
-        len = bx::vsnprintf(out, len, _format, _argList);
+        bx::MutexScope lock(m_mutex);
+
+        m_first = 0;
+        m_count = 0;
+        m_clear = true;
     }
-    out[len] = '\0';
 
-    return out;
-}
+    // Returns true if the output window was cleared since the last call.
+    bool moveTo(CircularStringArray& _csa)
+    {
+        bx::MutexScope lock(m_mutex);
+
+        const bool cleared = m_clear;
+        if (cleared)
+        {
+            _csa.clear();
+            m_clear = false;
+        }
+
+        for (uint16_t ii = 0; ii < m_count; ++ii)
+        {
+            _csa.add(m_lines[wrapAround(m_first+ii)]);
+        }
+        m_first = 0;
+        m_count = 0;
+
+        return cleared;
+    }
+
+private:
+    void add(const char* _str, uint32_t _len)
+    {
+        // When full, the oldest line is dropped, s_csa would not keep it anyway.
+        if (OutputWindowState::MaxLines == m_count)
+        {
+            m_first = wrapAround(m_first+1);
+            --m_count;
+        }
+
+        dm::strscpy(m_lines[wrapAround(m_first+m_count)], _str, dm::min(_len, uint32_t(OutputWindowState::LineLength)));
+        ++m_count;
+    }
+
+    static inline uint16_t wrapAround(uint16_t _idx)
+    {
+        return _idx&(OutputWindowState::MaxLines-1);
+    }
+
+    uint16_t m_first;
+    uint16_t m_count;
+    bool m_clear;
+    char m_lines[OutputWindowState::MaxLines][OutputWindowState::LineLength];
+    bx::Mutex m_mutex;
+};
+static OutputLineQueue s_outputQueue;
 
 // Output window.
 //-----
@@ -355,16 +429,24 @@ void outputWindowInit(OutputWindowState* _state)
 
 void outputWindowPrint(const char* _format, ...)
 {
+    // Called from background jobs too, format into a buffer on this thread's stack.
+    char str[2048];
     va_list argList;
     va_start(argList, _format);
-    const char* str = printfVargs(_format, argList);
+    bx::vsnprintf(str, sizeof(str), _format, argList);
     va_end(argList);
+    str[sizeof(str)-1] = '\0';
 
-    s_csa.addSplitNewLine(str);
+    s_outputQueue.push(str);
 }
 
 void outputWindowUpdate(float _deltaTime/*sec*/, float _updateFreq = 0.014f/*sec*/)
 {
+    if (s_outputQueue.moveTo(s_csa))
+    {
+        s_outputWindowState->m_scroll = 0;
+    }
+
     static float timeNow = 0.0f;
     timeNow += _deltaTime;
 
@@ -386,8 +468,7 @@ void outputWindowUpdate(float _deltaTime/*sec*/, float _updateFreq = 0.014f/*sec
 
 void outputWindowClear()
 {
-    s_outputWindowState->m_scroll = 0;
-    s_csa.clear();
+    s_outputQueue.clear();
 }
 
 void outputWindowShow()
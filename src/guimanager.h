@@ -35,6 +35,17 @@ struct StatusWindowId
     };
 };
 
+struct StatusEvent
+{
+    enum Enum
+    {
+        None, // Status messages without a button.
+
+        CancelFilterPmrem,
+        CancelFilterIem,
+    };
+};
+
 void imguiStatusMessage(const char* _msg
                       , float _durationSec
                       , bool _isWarning          = false
@@ -43,6 +54,7 @@ void imguiStatusMessage(const char* _msg
                       , StatusWindowId::Enum _id = StatusWindowId::None
                       );
 void imguiRemoveStatusMessage(StatusWindowId::Enum _id);
+void imguiStatusMessageSetText(StatusWindowId::Enum _id, const char* _msg); // Replaces text of a visible message, used for progress.
 uint16_t imguiGetStatusEvent();
 
 // Output window.
@@ -418,8 +418,11 @@ struct RenderPipelineImpl : public RenderPipeline
             uniforms.m_edgeFixup = 0.0f;
         }
 
-        // Texture.
-        const cs::TextureHandle envTex = env.m_cubemap[_which];
+        // Texture. Use higher resolution skybox level when resident.
+        const cs::TextureHandle envTex = (cs::Environment::Skybox == _which && cs::isValid(env.m_skyboxDetail))
+                                       ? env.m_skyboxDetail
+                                       : env.m_cubemap[_which]
+                                       ;
         cs::setTexture(cs::TextureUniform::Skybox, envTex, EnvTexFlags);
 
         // Geometry.